@@ -0,0 +1,90 @@
+#ifndef __BANK_H
+#define __BANK_H
+
+#include <stdint.h>
+
+#ifdef BANKED_RAM
+// Bank switched RAM, like the memory boards with a bank register that came
+// after the KIM-1. The 4K window at A000-AFFF shows one of BANK_COUNT banks
+// at a time, and writing a bank's number to BANK_SELECT in page 12 switches
+// to it. The banks live in flash, and the last BANK_FRAMES of them used are
+// kept in SRAM, so switching between those is only a pointer. A bank that
+// has never been written is all zeros.
+#define BANK_PAGE 0x12
+#define BANK_WINDOW 0xa000
+#define BANK_SIZE 0x1000
+
+#ifndef BANK_COUNT
+#define BANK_COUNT 64
+#endif
+#ifndef BANK_FRAMES
+#define BANK_FRAMES 2
+#endif
+#if BANK_COUNT > 256
+#error BANK_SELECT can only pick one of 256 banks
+#endif
+
+#define BANK_SELECT 0x00        // 1200, writing it switches banks
+#define BANK_COMMAND 0x01       // 1201, writing it runs the command
+#define BANK_STATUS 0x02        // 1202, the error from the last switch or command
+#define BANK_SWITCHES 0x04      // 1204-1207, switches, little-endian like the rest
+#define BANK_HITS 0x08          // 1208-120B, switches to a bank that was in SRAM
+#define BANK_WRITES 0x0c        // 120C-120F, banks written to flash
+#define BANK_ERASES 0x10        // 1210-1213, flash pages erased
+#define BANK_LATENCY 0x14       // 1214-1217, microseconds the last switch took
+#define BANK_WORST 0x18         // 1218-121B, and the longest one
+#define BANK_REGISTERS 0x1c
+
+enum {
+    BANK_FLUSH = 1,             // write every changed bank to flash
+    BANK_CLEAR_COUNTERS,        // zero SWITCHES through WORST
+};
+
+#define BANK_FULL 0x80          // in STATUS, a changed bank didn't fit in flash, so it is still in SRAM
+#define BANK_BAD 0x01           // in STATUS, there is no such bank or command
+
+// The store in flash works like the virtual tape, in two halves that take
+// turns. Each half starts with a BANK_HEADER, and the half with the higher
+// generation is the store. Writing a bank back adds a BANK_RECORD and the
+// bank's data, LZ4 compressed if that is shorter, after the last one, and
+// the newest record for a bank is its contents. When a half fills up, the
+// newest record of each bank is copied to the other half, so every page of
+// flash is erased as often as every other.
+#define BANK_MAGIC 0x424d494bUL       // "KIMB"
+#define BANK_VERSION 1
+
+typedef struct BANK_HEADER {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t generation;
+} BANK_HEADER;
+
+enum { BANK_RAW, BANK_LZ4 };
+
+typedef struct BANK_RECORD {
+    uint16_t packed;        // bytes of data, erased (FFFF) past the last record
+    uint8_t bank;
+    uint8_t encoding;       // BANK_RAW or BANK_LZ4
+    uint16_t reserved;
+    uint16_t done;          // programmed to 0 once all the data is written
+} BANK_RECORD;
+
+// The bank in the window, and whether it has been written since it was
+// last in flash
+extern uint8_t *bank_window;
+extern uint8_t *bank_changed;
+
+#define BANK_WRITE(addr, val) { \
+    bank_window[(addr) - BANK_WINDOW] = (val); \
+    *bank_changed = 1; \
+}
+
+// Finds the store in flash and puts bank 0 in the window
+void bank_init();
+
+uint8_t bank_read(uint16_t address);
+void bank_write(uint16_t address, uint8_t value);
+#endif
+
+#endif /* __BANK_H */
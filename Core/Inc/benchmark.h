@@ -0,0 +1,23 @@
+#ifndef __BENCHMARK_H
+#define __BENCHMARK_H
+
+#include <stdint.h>
+
+// Typing this character at the serial console (control-B) prints the
+// emulation speed since the last time it was typed
+#define BENCHMARK_CHAR 0x02
+
+#ifdef BENCHMARK
+extern uint32_t bench_instructions;
+
+#define BENCHMARK_COUNT(n) bench_instructions += (n)
+
+void benchmark_reset();
+void benchmark_report();
+void benchmark_wait_start();
+void benchmark_wait_end();
+#else
+#define BENCHMARK_COUNT(n)
+#endif
+
+#endif /* __BENCHMARK_H */
@@ -0,0 +1,43 @@
+#ifndef __BLOCKMOVE_H
+#define __BLOCKMOVE_H
+
+#include <stdint.h>
+
+#ifdef BLOCK_MOVE
+// A block move and fill device in page 15, next to the math coprocessor.
+// Write the addresses and length, then a command, and the move is done by
+// the time the write finishes. Addresses and the length are little-endian,
+// and a length of 0 does nothing.
+#define MOVE_PAGE 0x15
+
+#define MOVE_SOURCE 0x00        // 1500-1501
+#define MOVE_DEST 0x02          // 1502-1503
+#define MOVE_LENGTH 0x04        // 1504-1505
+#define MOVE_FILL 0x06          // 1506, the byte MOVE_SET fills with
+#define MOVE_COMMAND 0x07       // 1507, writing it runs the command
+#define MOVE_STATUS 0x08        // 1508, reading it clears the interrupt
+#define MOVE_CONTROL 0x09       // 1509
+#define MOVE_REGISTERS 0x0a
+
+enum {
+    MOVE_COPY = 1,              // copy LENGTH bytes from SOURCE to DEST, even if they overlap
+    MOVE_SET,                   // fill LENGTH bytes at DEST with FILL
+};
+
+// What a command costs, in emulated cycles added to clockticks6502 as it
+// runs, as if a DMA controller had the bus for one cycle for each byte it
+// reads or writes. The 6502 doesn't run in the meantime, so the VIA and
+// anything else going by the cycle count sees a 4K copy take 8192 cycles,
+// where a 6502 loop would take 40000 or more.
+#define MOVE_COPY_CYCLES 2      // a read and a write a byte
+#define MOVE_SET_CYCLES 1       // a write a byte
+
+#define MOVE_DONE 0x80          // in STATUS, the last command has finished
+#define MOVE_ERROR 0x01         // in STATUS, the last command wasn't one of the above
+#define MOVE_IRQ_ENABLE 0x80    // in CONTROL, hold IRQ low from when a command finishes until STATUS is read
+
+uint8_t move_read(uint16_t address);
+void move_write(uint16_t address, uint8_t value);
+#endif
+
+#endif /* __BLOCKMOVE_H */
@@ -0,0 +1,58 @@
+#ifndef __BUS_H
+#define __BUS_H
+
+#include <stdint.h>
+#include "fake6502.h"
+#include "dirty.h"
+#include "memmap.h"
+#include "bank.h"
+
+// The fast paths of read6502 and write6502, so fake6502.c can have them
+// inlined into every instruction rather than making a call for each byte.
+// RAM and ROM are found the same way read6502 and write6502 find them,
+// RAM_DIRECT and then the page tables, and everything else, the RIOTs and whatever is on the
+// expansion bus, still goes through main.c.
+//
+// Inlined, they make fake6502.c a good deal bigger, so a MinSizeRel build,
+// where gcc defines __OPTIMIZE_SIZE__, keeps every access a call as before.
+#ifdef __OPTIMIZE_SIZE__
+#define bus_read read6502
+#define bus_write write6502
+#else
+static inline uint8_t bus_read(uint16_t addr) {
+    if (RAM_DIRECT(addr)) return RAM[addr];
+    const uint8_t *page = read_table[addr >> 8];
+    if (page) return page[addr & 0xff];
+#ifdef BANKED_RAM
+    if ((addr & 0xf000) == BANK_WINDOW) return bank_window[addr - BANK_WINDOW];
+#endif
+    return read6502(addr);
+}
+
+static inline void bus_write(uint16_t addr, uint8_t val) {
+    if (RAM_DIRECT(addr)) {
+        CACHE_WRITE(addr);
+        DIRTY_WRITE(addr);
+        RAM[addr] = val;
+        return;
+    }
+    uint8_t *page = page_table[addr >> 8];
+    if (page) {
+        CACHE_WRITE(addr);
+        DIRTY_WRITE(addr);
+        page[addr & 0xff] = val;
+        return;
+    }
+#ifdef BANKED_RAM
+    if ((addr & 0xf000) == BANK_WINDOW) {
+        CACHE_WRITE(addr);
+        DIRTY_WRITE(addr);
+        BANK_WRITE(addr, val);
+        return;
+    }
+#endif
+    write6502(addr, val);
+}
+#endif
+
+#endif /* __BUS_H */
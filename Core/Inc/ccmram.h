@@ -0,0 +1,17 @@
+#ifndef __CCMRAM_H
+#define __CCMRAM_H
+
+// Place a zero-initialized variable in the 8K of core coupled memory
+#define CCMBSS __attribute__((section(".ccmbss")))
+
+// With CCMRAM_HOTPATH, functions marked HOTPATH are copied into CCM RAM by
+// the startup code and run from there instead of from flash. Calls between
+// flash and CCM RAM are too far apart for a bl, so the linker adds a veneer,
+// which is why the callees of hot functions should be hot too.
+#ifdef CCMRAM_HOTPATH
+#define HOTPATH __attribute__((section(".ccmram")))
+#else
+#define HOTPATH
+#endif
+
+#endif /* __CCMRAM_H */
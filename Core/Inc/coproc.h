@@ -0,0 +1,47 @@
+#ifndef __COPROC_H
+#define __COPROC_H
+
+#include <stdint.h>
+
+#ifdef COPROCESSOR
+// A math coprocessor in page 14, which nothing else on the KIM-1 uses.
+// Write the operands, then a command, and the result is there as soon as
+// the write finishes. Every register is little-endian, and all of them can
+// be read back and written.
+#define COPROC_PAGE 0x14
+
+#define COPROC_A 0x00           // 1400-1403, the first operand
+#define COPROC_B 0x04           // 1404-1407, the second operand
+#define COPROC_R 0x08           // 1408-140F, the result
+#define COPROC_COMMAND 0x10     // 1410, writing it runs the command
+#define COPROC_STATUS 0x11      // 1411, COPROC_ERROR if the last command failed
+#define COPROC_REGISTERS 0x12
+
+#define COPROC_ERROR 0x80
+
+// What a command costs, in emulated cycles added to clockticks6502 as it
+// runs, so the timers see it take time the way the block move device's
+// moves do: a fixed amount for any command, about what a multiply/divide
+// chip on the bus would take, and for CRC16 and CRC32 a cycle more for
+// each byte read, as the block move charges. 6502 code doing the same
+// work takes hundreds of cycles a multiply and over a hundred a CRC byte.
+#define COPROC_CYCLES 16        // any command, even one that fails
+#define COPROC_CRC_CYCLES 1     // and each byte a CRC reads
+
+enum {
+    COPROC_MUL16 = 1,   // R(32) = A(16) * B(16)
+    COPROC_MUL32,       // R(64) = A(32) * B(32)
+    COPROC_DIV16,       // R0-1 = A(16) / B(16), R4-5 = the remainder
+    COPROC_DIV32,       // R0-3 = A(32) / B(32), R4-7 = the remainder
+    COPROC_SQRT,        // R0-1 = the square root of A(32), R4-7 = what's left over
+    COPROC_BIN2BCD,     // R0-4 = A(32) as 10 BCD digits, lowest two in R0
+    COPROC_BCD2BIN,     // R0-3 = A(32), 8 BCD digits, in binary
+    COPROC_CRC16,       // R0-1 = the CRC-16/XMODEM of B(16) bytes at A(16), carrying on from R0-1
+    COPROC_CRC32,       // R0-3 = the CRC-32 of B(16) bytes at A(16), carrying on from R0-3
+};
+
+uint8_t coproc_read(uint16_t address);
+void coproc_write(uint16_t address, uint8_t value);
+#endif
+
+#endif /* __COPROC_H */
@@ -0,0 +1,31 @@
+#ifndef __DIRTY_H
+#define __DIRTY_H
+
+#include <stdint.h>
+
+#ifdef DIRTY_PAGES
+// One bit for each 256 byte page of the 6502 address space that has been
+// written since the last dirty_clear. write6502 has to use DIRTY_WRITE on
+// every write, and anything that changes memory behind write6502's back
+// has to call dirty_range, the same as CACHE_WRITE and cache_flush.
+extern uint32_t dirty_pages[8];
+#define DIRTY_WRITE(addr) dirty_pages[(addr) >> 13] |= 1UL << (((addr) >> 8) & 31)
+
+void dirty_clear();
+void dirty_range(uint16_t address, uint32_t length);
+
+// Returns nonzero if the page has been written
+#define dirty_page(page) (dirty_pages[(page) >> 5] & (1UL << ((page) & 31)))
+
+// Returns the first written page at or after page, or -1 if there isn't
+// one, so for (int p = dirty_next(0); p >= 0; p = dirty_next(p + 1))
+// goes through all of them
+int dirty_next(int page);
+
+// Returns how many pages have been written
+int dirty_count();
+#else
+#define DIRTY_WRITE(addr)
+#endif
+
+#endif /* __DIRTY_H */
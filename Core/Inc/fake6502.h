@@ -0,0 +1,88 @@
+#ifndef __FAKE6502_H
+#define __FAKE6502_H
+
+#include <stdint.h>
+
+// 6502 CPU registers. With GLOBAL_REGISTERS they are kept in ARM registers
+// that CMakeLists.txt takes away from the compiler with -ffixed-r5 through
+// -ffixed-r10, so every file that touches them has to include this.
+// r5 holds the running count of emulated clock cycles. With SP_REGISTER
+// the stack pointer goes in r11 as well, which leaves the compiler one
+// register fewer for everything else, so it stays in memory unless that
+// turns out to be quicker on the board.
+#ifdef GLOBAL_REGISTERS
+register uint32_t clockticks6502 asm ("r5");
+register uint16_t pc asm ("r6");
+register uint8_t a asm ("r7");
+register uint8_t x asm ("r8");
+register uint8_t y asm ("r9");
+register uint8_t status asm ("r10");
+#ifdef SP_REGISTER
+register uint8_t sp asm ("r11");
+#else
+extern uint8_t sp;
+#endif
+
+#else
+extern uint32_t clockticks6502;
+extern uint16_t pc;
+extern uint8_t sp, a, x, y, status;
+#endif
+
+void reset6502();
+void exec6502(uint32_t);
+int step6502();
+void irq6502();
+void nmi6502();
+void trace6502(int);
+
+// Base cycle count of each opcode, not counting page crossings or taken branches
+extern const uint8_t ticktable[256];
+// Length in bytes of each instruction
+extern const uint8_t oplength[256];
+
+#ifdef BLOCK_CACHE
+// One bit for each 256 byte page that has decoded code in the block cache.
+// write6502 has to use CACHE_WRITE on every write so that changing code
+// throws away the stale copy, and anything that changes memory behind
+// write6502's back has to call cache_flush.
+extern uint32_t code_pages[8];
+void cache_invalidate(uint8_t page);
+void cache_flush();
+#define CACHE_WRITE(addr) { \
+    if (code_pages[(addr) >> 13] & (1UL << (((addr) >> 8) & 31))) cache_invalidate((addr) >> 8); \
+}
+#else
+#define CACHE_WRITE(addr)
+#endif
+
+#ifdef SUPERINSTRUCTIONS
+// Superinstructions have to be off while single stepping, since each one
+// counts as a single step
+void fuse6502(int enable);
+int fuse_check();
+#endif
+
+#ifdef ROM_TRANSLATE
+void translate6502(int enable);
+int rom_translated(uint16_t address);
+#endif
+
+#ifdef JIT
+// Translated blocks run several instructions as one step, so translation
+// has to be off while single stepping too
+void jit6502(int enable);
+int jit_check();
+#endif
+
+// Supplied by main.c
+uint8_t read6502(uint16_t address);
+void write6502(uint16_t address, uint8_t value);
+// Returns 1 for the addresses main.c checks pc against after each step
+int watch6502(uint16_t address);
+// Returns where length bytes of RAM from address are kept, or NULL if they
+// aren't all RAM in the same one of main.c's arrays. Writing through it goes
+// around write6502, so the caller has to keep the block cache up to date.
+uint8_t *span6502(uint16_t address, uint32_t length);
+
+#endif /* __FAKE6502_H */
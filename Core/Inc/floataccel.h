@@ -0,0 +1,65 @@
+#ifndef __FLOATACCEL_H
+#define __FLOATACCEL_H
+
+#include <stdint.h>
+
+#ifdef FLOAT_ACCEL
+// A floating point unit in page 16 for Microsoft BASIC and anything else
+// that uses its 5 byte numbers. It works on BASIC's own FAC and ARG in
+// zero page, wherever FLOAT_FAC says the FAC is, laid out the way every
+// 6502 version of BASIC with 4 byte mantissas has them:
+//
+//   FAC     exponent, 4 byte mantissa with the top bit set, sign in bit 7
+//   FAC+8   ARG, the same
+//   FAC+14  SGNCPR, ARG's sign EOR FAC's
+//   FAC+15  FACEXT, the byte of the FAC's mantissa below the other four
+//
+// An exponent of 0 means the number is 0. Packed in memory a number is the
+// exponent, then the mantissa with the sign in place of its top bit.
+// Results are rounded to the nearest 4 byte mantissa, leaving FACEXT 0.
+#define FLOAT_PAGE 0x16
+
+#define FLOAT_FAC 0x00          // 1600-1601, the address of the FAC
+#define FLOAT_ADDRESS 0x02      // 1602-1603, a packed number in memory
+#define FLOAT_INT 0x04          // 1604-1607, a signed 32 bit integer
+#define FLOAT_COMMAND 0x08      // 1608, writing it runs the command
+#define FLOAT_STATUS 0x09       // 1609, the error from the last command
+#define FLOAT_COMPARE 0x0a      // 160A, 01, 00 or FF as the FAC is more than, equal to or less than the number at ADDRESS
+#define FLOAT_ERROR 0x0b        // 160B-160C, where a trap goes on an error
+#define FLOAT_OVERFLOW_CODE 0x0d // 160D, what it puts in X for an overflow
+#define FLOAT_DIVZERO_CODE 0x0e // 160E, and for dividing by zero
+#define FLOAT_REGISTERS 0x0f
+
+enum {
+    FLOAT_ADD = 1,      // FAC = ARG + FAC
+    FLOAT_SUB,          // FAC = ARG - FAC
+    FLOAT_MUL,          // FAC = ARG * FAC
+    FLOAT_DIV,          // FAC = ARG / FAC
+    FLOAT_CMP,          // sets COMPARE
+    FLOAT_LOAD_ARG,     // ARG = the number at ADDRESS
+    FLOAT_LOAD_FAC,     // FAC = the number at ADDRESS
+    FLOAT_STORE,        // the number at ADDRESS = the FAC, rounded with FACEXT
+    FLOAT_FROM_INT,     // FAC = INT
+    FLOAT_TO_INT,       // INT = the FAC without its fraction
+};
+
+#define FLOAT_OVERFLOW 0x80     // in STATUS, the result was too big
+#define FLOAT_DIVZERO 0x40      // in STATUS, dividing by zero
+#define FLOAT_BAD_COMMAND 0x01  // in STATUS, the command wasn't one of the above
+
+// Going to 1680 plus a command runs it on the FAC and returns with RTS, so
+// a JMP at the start of one of BASIC's routines hands it over to this. For
+// the ones that take a number in memory, ADDRESS comes from A and Y the way
+// BASIC passes it. If there is an error and FLOAT_ERROR has been set, it
+// goes there with the error's code in X, like BASIC's own error handler
+// expects, instead of returning.
+#define FLOAT_TRAPS 0x1680
+
+uint8_t float_read(uint16_t address);
+void float_write(uint16_t address, uint8_t value);
+
+// Runs the trap pc has gone to, for check_pc
+void float_trap();
+#endif
+
+#endif /* __FLOATACCEL_H */
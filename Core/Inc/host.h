@@ -0,0 +1,30 @@
+#ifndef __HOST_H
+#define __HOST_H
+
+#include <stdint.h>
+
+#ifdef HOST_SERVICES
+// Counters from the emulator in page 13, for 6502 programs to time
+// themselves with. They are read-only, little-endian and free-running.
+// Each counter changes between one LDA and the next, so to read all four
+// bytes of one at once, write anything to HOST_LATCH and read the copies.
+#define HOST_PAGE 0x13
+
+#define HOST_CYCLES 0x00        // 1300-1303, emulated clock cycles
+#define HOST_MILLIS 0x04        // 1304-1307, milliseconds since reset, from HAL_GetTick
+#define HOST_INSTRUCTIONS 0x08  // 1308-130B, 6502 instructions run
+#define HOST_LATCH 0x0c         // 130C, writing it copies the three counters to 1310-131B
+#define HOST_LATCHED 0x10       // 1310-131B, cycles, milliseconds and instructions
+#define HOST_REGISTERS 0x1c
+
+extern uint32_t host_instructions;
+
+#define HOST_COUNT(n) host_instructions += (n)
+
+uint8_t host_read(uint16_t address);
+void host_write(uint16_t address, uint8_t value);
+#else
+#define HOST_COUNT(n)
+#endif
+
+#endif /* __HOST_H */
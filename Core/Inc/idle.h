@@ -0,0 +1,15 @@
+#ifndef __IDLE_H
+#define __IDLE_H
+
+#include <stdint.h>
+
+#ifdef IDLE_SKIP
+// How much idle looping the emulator has skipped. idle_skipped_cycles and
+// idle_skips count timer and VIA waits that were fast-forwarded, idle_sleeps
+// counts the times the ARM core slept waiting for a key or a serial character.
+extern uint32_t idle_skipped_cycles;
+extern uint32_t idle_skips;
+extern uint32_t idle_sleeps;
+#endif
+
+#endif /* __IDLE_H */
@@ -0,0 +1,44 @@
+#ifndef __IMAGE_H
+#define __IMAGE_H
+
+#include <stdint.h>
+#include "lz4.h"
+
+#if defined(SNAPSHOT) || defined(LIBRARY)
+// Runs of 6502 memory kept in flash, by snapshots and the program library.
+// Each run is an IMAGE_RECORD followed by its data, padded to an even
+// length, and a run never goes past the end of one of the parts of the
+// address space that hold RAM: 0000-01FF, 0200-0FFF, 1780-17BF, 17C0-17FF,
+// the expansion RAM in SRAM, 2000-8FFF unless memmap.h says otherwise, and
+// with EXPANDED_RAM the rest of the expansion RAM in CCM RAM, 9000-9BFF.
+enum { IMAGE_RAW, IMAGE_LZ4 };
+
+typedef struct IMAGE_RECORD {
+    uint16_t address;       // 6502 address of the first byte
+    uint16_t length;        // bytes of memory
+    uint16_t packed;        // bytes of data after the record
+    uint8_t encoding;       // IMAGE_RAW or IMAGE_LZ4
+    uint8_t reserved;
+} IMAGE_RECORD;
+
+// Makes sure length bytes of records are all whole and go somewhere in RAM.
+// Returns nonzero if not.
+int image_check(const uint8_t *records, uint32_t length);
+
+// Copies records that image_check passed into memory. Since this goes
+// around write6502, the caller has to flush the block cache afterwards.
+// Returns nonzero if a compressed run turns out to be damaged.
+int image_load(const uint8_t *records, uint32_t length);
+
+#ifdef SNAPSHOT
+// Passes a record for each run of RAM pages that aren't all zero to output,
+// or with changed set, each run of pages DIRTY_PAGES has seen written,
+// zero or not
+void image_save(LZ4_OUTPUT output, void *context, int changed);
+
+// Zeroes all of RAM
+void image_clear();
+#endif
+#endif
+
+#endif /* __IMAGE_H */
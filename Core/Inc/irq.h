@@ -0,0 +1,26 @@
+#ifndef __IRQ_H
+#define __IRQ_H
+
+#include <stdint.h>
+
+// IRQ is level-triggered, the same as on the real board. Each device that
+// can pull it low has a bit in irq_pending, and keeps it set until the 6502
+// does whatever clears it. Rather than the main loop looking at every device
+// after every step, a device sets irq_check when it raises IRQ, and CLI,
+// PLP and RTI set it when they clear the I flag with something pending, so
+// between steps there is only irq_check to look at.
+#define IRQ_RIOT003 0x01        // the application RIOT's timer, written at 170C-170F
+#define IRQ_RIOT002 0x02        // the system RIOT's timer, written at 174C-174F
+#define IRQ_BLOCK_MOVE 0x04     // the block move device, see blockmove.h
+#define IRQ_VIA 0x08            // the 6522 VIA, see via.h
+
+extern uint8_t irq_pending;
+extern uint8_t irq_check;
+
+#define irq_raise(source) { irq_pending |= (source); irq_check = 1; }
+#define irq_lower(source) irq_pending &= ~(source)
+
+// Takes the IRQ if anything is holding it low and the I flag allows it
+void irq_service();
+
+#endif /* __IRQ_H */
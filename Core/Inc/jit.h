@@ -0,0 +1,106 @@
+#ifndef __JIT_H
+#define __JIT_H
+
+#include <stdint.h>
+
+#ifdef JIT
+// Translation of hot 6502 blocks into Thumb-2. A block of 6502 code is
+// first turned into a JIT_BLOCK, a list of simple operations on the 6502
+// registers and memory, and then the JIT_BLOCK is turned into ARM code
+// that works directly on the registers fake6502.h pins: a in r7, x in r8,
+// y in r9, status in r10, pc in r6 and the cycle count in r5. Memory goes
+// through read6502 and write6502, just as it does for the interpreter.
+//
+// Only a subset of the instruction set is translated. A block stops at the
+// first instruction that isn't in it and the interpreter takes over from
+// there. Nothing that touches the stack, any I/O or its own page of code
+// is translated, so a translated block always runs to the end, and the
+// cycle count only has to be right by then.
+
+#define JIT_BLOCK_MAX 16
+
+// Operations
+enum {
+    JIT_NONE,
+    JIT_LOAD,   // reg = value
+    JIT_STORE,  // memory = reg
+    JIT_MOVE,   // reg = register arg (TAX and friends)
+    JIT_INC,    // read-modify-write operations, on reg with JIT_REGISTER,
+    JIT_DEC,    // otherwise on memory
+    JIT_ASL,
+    JIT_LSR,
+    JIT_ROL,
+    JIT_ROR,
+    JIT_AND,    // a = a op value
+    JIT_ORA,
+    JIT_EOR,
+    JIT_ADC,
+    JIT_SBC,
+    JIT_CMP,    // flags from reg - value
+    JIT_CLC,
+    JIT_SEC,
+    JIT_NOP,
+    JIT_BRANCH, // only at the end of a block
+    JIT_JUMP,
+};
+
+// Where an operation's value or memory location comes from
+enum {
+    JIT_REGISTER,   // no operand, the operation is on reg
+    JIT_IMMEDIATE,  // arg is the value
+    JIT_ZP,         // arg is a zero page address
+    JIT_ZPX,        // arg plus x, wrapped to the zero page
+    JIT_ABSOLUTE,   // arg is the address
+};
+
+// The registers, numbered to match r7, r8 and r9
+enum { JIT_A, JIT_X, JIT_Y };
+
+typedef struct JIT_OP {
+    uint8_t kind;
+    uint8_t reg;
+    uint8_t mode;
+    uint8_t flags;      // the flags this operation has to set, the ones some later
+                        // operation or the code after the block could look at
+    uint16_t arg;
+} JIT_OP;
+
+typedef struct JIT_BLOCK {
+    uint16_t start;
+    uint16_t next;          // the pc after the last instruction
+    uint16_t target;        // where a taken branch or a jump goes
+    uint8_t exit;           // JIT_NONE to fall through, JIT_BRANCH or JIT_JUMP
+    uint8_t branch_flag;    // the flag a branch tests
+    uint8_t branch_set;     // nonzero if the branch is taken when the flag is set
+    uint8_t taken_cycles;   // extra cycles for a taken branch
+    uint8_t cycles;         // cycles for the whole block when no branch is taken
+    uint8_t instructions;   // 6502 instructions in the block, including the exit
+    uint8_t count;          // entries used in op
+    JIT_OP op[JIT_BLOCK_MAX];
+} JIT_BLOCK;
+
+// Fills in block with the code at start. Returns the number of 6502
+// instructions it covers, which is 0 if the first one can't be translated.
+int jit_decode(JIT_BLOCK *block, uint16_t start);
+
+// Runs a decoded block the way the translated code would, setting only the
+// flags the liveness pass kept. This is the reference model for the
+// translator, it is how a JIT_BLOCK can be checked against the interpreter
+// on a machine that can't run Thumb code. Returns the instruction count.
+int jit_interpret(const JIT_BLOCK *block);
+
+// Writes the ARM code for block into the code buffer and returns it as a
+// function that returns the number of instructions it ran, or NULL if the
+// buffer is full
+int (*jit_emit(const JIT_BLOCK *block))();
+
+// Empties the code buffer. Anything that points into it has to be dropped
+// first.
+void jit_reset();
+
+// The code buffer and how many halfwords of it are used
+extern uint16_t jit_buffer[JIT_BUFFER_SIZE / 2];
+extern uint32_t jit_used;
+#endif
+
+#endif /* __JIT_H */
@@ -0,0 +1,37 @@
+#ifndef __LIBRARY_H
+#define __LIBRARY_H
+
+#include <stdint.h>
+
+#ifdef LIBRARY
+// Going to F0nn, with AD F 0 n n GO on the keypad or F0nn G at the serial
+// console, loads program nn from the library and runs it. Nothing else is
+// mapped there.
+#define LIBRARY_PAGE 0xf0
+
+// The library is a LIBRARY_HEADER, a LIBRARY_PROGRAM for each program, and
+// then each program's memory as image records (see image.h), all
+// little-endian. tools/kimlib builds it.
+#define LIBRARY_MAGIC 0x4c4d494bUL    // "KIML"
+#define LIBRARY_VERSION 1
+
+typedef struct LIBRARY_HEADER {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;         // programs in the directory
+} LIBRARY_HEADER;
+
+typedef struct LIBRARY_PROGRAM {
+    char name[16];          // padded with zeros, not always terminated
+    uint16_t start;         // where to run it from
+    uint16_t reserved;
+    uint32_t offset;        // where its records are, from the start of the library
+    uint32_t length;        // bytes of records
+} LIBRARY_PROGRAM;
+
+// Loads a program into memory. Returns its directory entry, or NULL, with
+// memory left alone, if there isn't a good one with that number.
+const LIBRARY_PROGRAM *library_load(uint8_t number);
+#endif
+
+#endif /* __LIBRARY_H */
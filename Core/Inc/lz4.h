@@ -0,0 +1,24 @@
+#ifndef __LZ4_H
+#define __LZ4_H
+
+#include <stdint.h>
+
+#if defined(SNAPSHOT) || defined(LIBRARY) || defined(BANKED_RAM)
+// Compression in the LZ4 block format, which is quick to decompress and
+// simple enough to read on the host without a library. The compressor is a
+// small greedy one, with a hash table of LZ4_HASH_BITS bits in SRAM.
+#define LZ4_HASH_BITS 9
+
+// Receives the compressed bytes one at a time
+typedef void (*LZ4_OUTPUT)(void *context, uint8_t b);
+
+// Compresses len bytes, at most 65535, from src and returns the compressed
+// length. With a NULL output it only works out the length.
+uint32_t lz4_compress(const uint8_t *src, uint32_t len, LZ4_OUTPUT output, void *context);
+
+// Decompresses packed bytes from src into exactly len bytes at dst. Returns
+// nonzero if the data is damaged or comes out to a different length.
+int lz4_decompress(const uint8_t *src, uint32_t packed, uint8_t *dst, uint32_t len);
+#endif
+
+#endif /* __LZ4_H */
@@ -34,10 +34,25 @@ extern "C" {
 /* USER CODE BEGIN Includes */
 #include <stdio.h>
 #include <string.h>
+#include "ccmram.h"
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
+typedef struct TIMER {
+    uint32_t mult;
+    uint32_t tick_accum;
+    uint32_t start_value;
+    int32_t count;
+    uint32_t timeout;
+    uint32_t irq;           // the IRQ_ bit it raises when it times out, or 0
+} TIMER;
+
+typedef struct RIOT {
+    uint8_t padd, sad;
+    uint8_t pbdd, sbd;
+    TIMER timer;
+} RIOT;
 
 /* USER CODE END ET */
 
@@ -0,0 +1,96 @@
+#ifndef __MEMMAP_H
+#define __MEMMAP_H
+
+#include <stdint.h>
+
+// Where the 6502's RAM lives. 0000-0FFF is always in RAM, apart from the
+// zero page and stack with CCMRAM_ZEROPAGE, and expansion RAM starts at
+// 2000 and goes on for EXPANSION_PAGES pages. RAM holds the first 4K and
+// then the expansion pages that are in SRAM.
+//
+// This is the one description of the map. memmap.c turns it into
+// page_table and read_table, and read6502, write6502, span6502 and the
+// inlined accesses in bus.h all find RAM and ROM through those, after
+// RAM_DIRECT below, so nothing else has its own idea of where anything is.
+//
+// With EXPANDED_RAM the expansion RAM carries on into CCM RAM after the
+// SRAM pages run out, which the tables hide. The expansion RAM can go up
+// to 9BFF, where the mirror of the system RIOT's 64 bytes of RAM starts,
+// repeating through 9FFF.
+//
+// With BANKED_RAM the bank frames take 4K each of the SRAM the expansion
+// RAM would otherwise have.
+#define EXPANSION_START 0x2000
+#define EXPANSION_LIMIT 0x9c00
+
+#ifdef BANKED_RAM
+#include "bank.h"
+#define EXPANSION_SRAM_DEFAULT (112 - BANK_FRAMES * (BANK_SIZE / 256))
+#else
+#define EXPANSION_SRAM_DEFAULT 112
+#endif
+
+#ifdef EXPANDED_RAM
+#ifndef EXPANSION_SRAM_PAGES
+#define EXPANSION_SRAM_PAGES EXPANSION_SRAM_DEFAULT
+#endif
+#ifndef EXPANSION_CCM_PAGES
+#define EXPANSION_CCM_PAGES 12
+#endif
+#else
+#define EXPANSION_SRAM_PAGES EXPANSION_SRAM_DEFAULT
+#define EXPANSION_CCM_PAGES 0
+#endif
+
+#define EXPANSION_PAGES (EXPANSION_SRAM_PAGES + EXPANSION_CCM_PAGES)
+#define EXPANSION_SPLIT (EXPANSION_START + EXPANSION_SRAM_PAGES * 256)
+#define EXPANSION_END (EXPANSION_START + EXPANSION_PAGES * 256)
+
+#if EXPANSION_END > EXPANSION_LIMIT
+#error Expansion RAM has to end by 9BFF, so there can only be 124 pages of it
+#endif
+
+#define RAM_SIZE (0x1000 + EXPANSION_SRAM_PAGES * 256)
+
+extern uint8_t RAM[RAM_SIZE];
+#ifdef CCMRAM_ZEROPAGE
+extern uint8_t ZP_RAM[0x200];
+#endif
+
+// The monitor ROMs, in kimroms.c
+extern const uint8_t RIOT002_ROM[1024];
+extern const uint8_t RIOT003_ROM[1024];
+
+// The zero page and the stack are plain RAM in every layout, so fake6502.c
+// reads and writes them here directly when the addressing mode can't reach
+// anything else
+#ifdef CCMRAM_ZEROPAGE
+#define LOW_RAM ZP_RAM
+#else
+#define LOW_RAM RAM
+#endif
+
+// The rest of the low 4K, and the zero page and stack too unless they are
+// in CCM RAM, is at the same offset in RAM in every layout, and it is
+// where most accesses that aren't to the zero page go. So the accesses
+// check for it before looking in the tables, which on the board are in
+// flash and cost wait states.
+#ifdef CCMRAM_ZEROPAGE
+#define RAM_DIRECT(addr) ((uint16_t) ((addr) - 0x200) < 0xe00)
+#else
+#define RAM_DIRECT(addr) ((addr) < 0x1000)
+#endif
+
+#if EXPANSION_CCM_PAGES
+extern uint8_t CCM_RAM[EXPANSION_CCM_PAGES * 256];
+#endif
+
+// The memory behind each page of the 6502 address space that is plain RAM,
+// or NULL for ROM, I/O, the RIOT RAM and nothing at all
+extern uint8_t *const page_table[256];
+
+// The same for reading, with the ROM pages too, so a fetch from the
+// monitor is one look in the table as well
+extern const uint8_t *const read_table[256];
+
+#endif /* __MEMMAP_H */
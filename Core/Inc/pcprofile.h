@@ -0,0 +1,27 @@
+#ifndef __PCPROFILE_H
+#define __PCPROFILE_H
+
+#include <stdint.h>
+
+// Typing this character at the serial console (control-R) sends the PC
+// histogram to the host in the binary format described in pcprofile.c
+#define PC_PROFILE_DUMP_CHAR 0x12
+
+// How many times a second the timer interrupt samples the 6502 pc
+#ifndef PC_SAMPLE_HZ
+#define PC_SAMPLE_HZ 1000
+#endif
+
+// Each histogram bucket covers 1 << PC_SAMPLE_SHIFT bytes of 6502 address
+// space. 8 gives a bucket per page, 0 gives a bucket per address but needs
+// more RAM than the chip has.
+#ifndef PC_SAMPLE_SHIFT
+#define PC_SAMPLE_SHIFT 8
+#endif
+
+#define PC_SAMPLE_BUCKETS (0x10000 >> PC_SAMPLE_SHIFT)
+
+void pc_sample();
+void pc_profile_dump();
+
+#endif /* __PCPROFILE_H */
@@ -0,0 +1,31 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdint.h>
+
+// Typing this character at the serial console (control-P) dumps the profile
+#define PROFILE_DUMP_CHAR 0x10
+
+#ifdef OPCODE_PROFILE
+#include "stm32f3xx.h"
+
+extern uint32_t opcode_count[256];
+extern uint32_t opcode_cycles[256];
+
+// Wrap an opcode handler call to count it and charge it with the DWT cycles
+// it took to run. Without OPCODE_PROFILE these expand to nothing.
+#define PROFILE_START() uint32_t profile_start = DWT->CYCCNT
+#define PROFILE_END(opcode) { \
+    opcode_cycles[opcode] += DWT->CYCCNT - profile_start; \
+    opcode_count[opcode]++; \
+}
+
+void profile_init();
+void profile_dump();
+
+#else
+#define PROFILE_START()
+#define PROFILE_END(opcode)
+#endif
+
+#endif /* __PROFILE_H */
@@ -0,0 +1,54 @@
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <stdint.h>
+
+// How long ST or RS has to be held down to save or restore a snapshot
+#define SNAPSHOT_HOLD_TIME 2000
+
+#ifdef SNAPSHOT
+// A snapshot in flash is a SNAPSHOT_HEADER followed by header_size -
+// sizeof(SNAPSHOT_HEADER) bytes a later version might add, and then the
+// memory as image records (see image.h). With DIRTY_PAGES, later saves can
+// add deltas after it, each with the same kind of header, at the next
+// multiple of 4 bytes, holding the pages written since the save before.
+// Everything is little-endian. tools/snapshot reads them.
+#define SNAPSHOT_MAGIC 0x534d494bUL   // "KIMS"
+#define SNAPSHOT_DELTA 0x444d494bUL   // "KIMD"
+#define SNAPSHOT_VERSION 2
+
+// The CPU registers, the RIOT registers and timers, and the emulator modes
+typedef struct SNAPSHOT_STATE {
+    uint32_t clockticks;
+    uint32_t timer[2][5];   // mult, tick_accum, start_value, count and timeout
+                            // for the 6530-002 and then the 6530-003
+    uint16_t pc;
+    uint8_t a, x, y, sp, status;
+    uint8_t serial_mode;
+    uint8_t sst_mode;
+    uint8_t riot[2][4];     // padd, sad, pbdd and sbd, in the same order
+    uint8_t irq;            // IRQ_RIOT002 and IRQ_RIOT003 if their timers interrupt
+    uint8_t reserved[2];
+} SNAPSHOT_STATE;
+
+typedef struct SNAPSHOT_HEADER {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t length;        // bytes of records after the header
+    uint32_t checksum;      // Adler-32 of those bytes
+    SNAPSHOT_STATE state;
+    uint32_t previous;      // for a delta, Adler-32 of the whole header before it
+} SNAPSHOT_HEADER;
+
+// Saves the machine to flash, as a delta if memory still matches the
+// snapshot there and the delta fits. Returns how many bytes it wrote, or 0
+// if it couldn't.
+uint32_t snapshot_save();
+
+// Puts the machine back the way the snapshot in flash has it. Returns
+// nonzero, and leaves everything alone, if there isn't a good one.
+int snapshot_restore();
+#endif
+
+#endif /* __SNAPSHOT_H */
@@ -0,0 +1,73 @@
+#ifndef __STORAGE_H
+#define __STORAGE_H
+
+#include <stdint.h>
+
+// The top of the 256K of flash is kept out of the FLASH region in
+// STM32F303CCTX_FLASH.ld so the emulator can keep things there. Everything
+// here is erased in 2K pages, so each area starts on a page boundary.
+#define STORAGE_PAGE_SIZE 0x800
+#define STORAGE_PAGE_END(address) (((address) + STORAGE_PAGE_SIZE - 1) & ~(STORAGE_PAGE_SIZE - 1))
+
+// The virtual cassette tape, as two halves that take turns holding it
+#define TAPE_FLASH 0x08028000UL
+#define TAPE_FLASH_END 0x08030000UL
+
+// The program library, which tools/kimlib builds and stm32flash writes
+#define LIBRARY_FLASH 0x08030000UL
+#define LIBRARY_FLASH_END 0x08036000UL
+
+// Room for a snapshot of the whole machine, enough for every page of RAM
+// even if none of it compresses
+#define SNAPSHOT_FLASH 0x08036000UL
+#define SNAPSHOT_FLASH_END 0x08040000UL
+
+#ifdef BANKED_RAM
+// The banked RAM's store, just below the tape. It comes off the end of
+// the firmware's part of flash, which is why CMake hands the same size to
+// the linker script.
+#ifndef BANK_FLASH_SIZE
+#define BANK_FLASH_SIZE 0x8000UL
+#endif
+#define BANK_FLASH_END TAPE_FLASH
+#define BANK_FLASH (BANK_FLASH_END - BANK_FLASH_SIZE)
+#endif
+
+#if defined(SNAPSHOT) || defined(TAPE) || defined(BANKED_RAM)
+// Writes a stream of bytes into flash, erasing each page just before the
+// first byte goes into it. Flash is programmed a halfword at a time, so an
+// odd byte waits in pending until the next one arrives.
+typedef struct STORAGE_WRITER {
+    uint32_t address;   // where the next byte goes
+    uint32_t end;       // the end of the area, writing past it is an error
+    uint32_t erased;    // everything from the start of the area to here is erased
+    uint16_t pending;
+    int error;
+} STORAGE_WRITER;
+
+// Unlocks the flash and erases the page address is in
+void storage_open(STORAGE_WRITER *writer, uint32_t address, uint32_t end);
+// Unlocks the flash to carry on writing after something written before.
+// Everything from address up to erased has to be erased already, and the
+// pages after that are erased as the writer gets to them. A log that was
+// erased to the end when it was started passes end, so nothing is erased
+// twice, and otherwise STORAGE_PAGE_END(address) is always safe.
+void storage_append(STORAGE_WRITER *writer, uint32_t address, uint32_t end, uint32_t erased);
+// Leaves an even number of bytes erased, for something like a header to be
+// written later with storage_program
+void storage_skip(STORAGE_WRITER *writer, uint32_t len);
+void storage_put(STORAGE_WRITER *writer, uint8_t b);
+void storage_write(STORAGE_WRITER *writer, const void *data, uint32_t len);
+// Writes out any odd byte and locks the flash again. Returns nonzero if
+// anything failed or didn't fit.
+int storage_close(STORAGE_WRITER *writer);
+
+// Every page of flash erased since power on, for wear counters
+extern uint32_t storage_erases;
+
+// Programs len bytes at an even address that a writer has already erased
+// but not written, such as a header it skipped over
+int storage_program(uint32_t address, const void *data, uint32_t len);
+#endif
+
+#endif /* __STORAGE_H */
@@ -0,0 +1,47 @@
+#ifndef __TAPE_H
+#define __TAPE_H
+
+#include <stdint.h>
+
+#ifdef TAPE
+// The ROM's cassette routines, DUMPT at 1800 and LOADT at 1873, save to and
+// load from a virtual tape in flash instead of toggling port B.
+#define TAPE_DUMPT 0x1800
+#define TAPE_LOADT 0x1873
+
+// The tape lives in one half of its area at a time. Each half starts with a
+// TAPE_HEADER, and the half with the higher generation is the tape. Files
+// follow one after another, each a TAPE_FILE and then its data, padded to
+// an even length. When a new file doesn't fit, the newest file with each
+// other ID is copied to the other half along with it, and that half's
+// header is written last, so losing power part way leaves the old tape.
+#define TAPE_MAGIC 0x544d494bUL       // "KIMT"
+#define TAPE_VERSION 1
+
+typedef struct TAPE_HEADER {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t generation;
+} TAPE_HEADER;
+
+typedef struct TAPE_FILE {
+    uint16_t length;        // bytes of data, erased (FFFF) past the last file
+    uint16_t address;       // where it was dumped from, SAL and SAH
+    uint8_t id;
+    uint8_t reserved;
+    uint16_t checksum;      // the ROM's, the sum of SAL, SAH and the data
+    uint16_t done;          // programmed to 0 once all the data is written
+} TAPE_FILE;
+
+// Dumps length bytes from address, through read6502, as file id. Returns the
+// new file, or NULL if the tape is full or the flash couldn't be written.
+const TAPE_FILE *tape_save(uint8_t id, uint16_t address, uint16_t length);
+
+// Returns the newest file with id, or the newest file of all for ID 00 or
+// FF, which the ROM takes to mean any file, or NULL if there isn't one.
+// Its data follows it.
+const TAPE_FILE *tape_find(uint8_t id);
+#endif
+
+#endif /* __TAPE_H */
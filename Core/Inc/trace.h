@@ -0,0 +1,19 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+
+// Typing this character at the serial console (control-T) sends the trace
+// buffer to the host in the binary format described in trace.c
+#define TRACE_DUMP_CHAR 0x14
+
+// Number of instructions kept in the CCM RAM ring buffer, a power of two.
+// Each one takes 10 bytes.
+#ifndef TRACE_ENTRIES
+#define TRACE_ENTRIES 512
+#endif
+
+void trace_record(uint8_t opcode);
+void trace_dump();
+
+#endif /* __TRACE_H */
@@ -0,0 +1,61 @@
+#ifndef __VIA_H
+#define __VIA_H
+
+#include <stdint.h>
+
+#ifdef VIA
+// A 6522 VIA on the expansion bus, like the ones on KIM-1 expansion
+// boards, at the 16 bytes from VIA_ADDRESS. The timers aren't ticked. The
+// VIA works out where they are from clockticks6502 whenever it is read or
+// written, and via_event says when the next interrupt flag is due, so the
+// main loop only calls via_update when one is.
+//
+// Nothing is wired to its pins, so the ports read back what they drive
+// and read 1 on input bits, CA1, CA2, CB1 and CB2 never interrupt, T2
+// never counts PB6 pulses, and the shift register only runs under T2 or
+// the clock, shifting in 1s from CB2.
+#ifndef VIA_ADDRESS
+#define VIA_ADDRESS 0x1100
+#endif
+#if VIA_ADDRESS & 0x0f
+#error VIA_ADDRESS has to be a multiple of 16
+#endif
+
+#define VIA_ORB 0x00            // port B
+#define VIA_ORA 0x01            // port A
+#define VIA_DDRB 0x02
+#define VIA_DDRA 0x03
+#define VIA_T1CL 0x04           // reading it clears the T1 interrupt
+#define VIA_T1CH 0x05           // writing it starts T1 from the latches
+#define VIA_T1LL 0x06
+#define VIA_T1LH 0x07           // writing it clears the T1 interrupt
+#define VIA_T2CL 0x08           // reading it clears the T2 interrupt
+#define VIA_T2CH 0x09           // writing it starts T2
+#define VIA_SR 0x0a             // reading or writing it starts a shift
+#define VIA_ACR 0x0b
+#define VIA_PCR 0x0c
+#define VIA_IFR 0x0d            // writing 1s clears those flags
+#define VIA_IER 0x0e            // bit 7 says whether the other 1s set or clear
+#define VIA_ORA_NH 0x0f         // port A without the handshake
+
+#define VIA_IRQ_SR 0x04         // in IFR and IER, 8 bits have been shifted
+#define VIA_IRQ_T2 0x20         // T2 has timed out
+#define VIA_IRQ_T1 0x40         // T1 has timed out
+#define VIA_IRQ_ANY 0x80        // in IFR, an enabled flag is set
+
+#define VIA_T1_FREE_RUN 0x40    // in ACR, T1 reloads from its latches
+#define VIA_T2_COUNT 0x20       // in ACR, T2 counts pulses on PB6
+#define VIA_SR_MODE 0x1c        // in ACR, the shift register's mode
+
+// The cycle the next interrupt flag is due on
+extern uint32_t via_event;
+
+void via_reset();
+uint8_t via_read(uint16_t address);
+void via_write(uint16_t address, uint8_t value);
+
+// Sets the flags that are due by now, for the main loop
+void via_update();
+#endif
+
+#endif /* __VIA_H */
@@ -0,0 +1,351 @@
+// Bank switched RAM, compiled in with BANKED_RAM. There is far more flash
+// than SRAM, so the banks live in flash and only the ones in use are copied
+// into SRAM frames. A switch to a bank that is already in a frame only
+// moves bank_window, and otherwise the frame used longest ago is written
+// back to flash if it has changed and the new bank is read into it.
+//
+// Flash has to be erased a 2K page at a time and wears out after ten
+// thousand or so erases, so banks are never written in place. The store is
+// a log, the same as the virtual tape, see bank.h.
+
+#include <stddef.h>
+#include "main.h"
+#include "fake6502.h"
+#include "storage.h"
+#include "lz4.h"
+#include "bank.h"
+
+#ifdef BANKED_RAM
+
+#define BANK_HALF (BANK_FLASH_SIZE / 2)
+
+#if BANK_FLASH_SIZE > 0x10000
+#error The record offsets are only 16 bits
+#endif
+#if BANK_FLASH_SIZE % (2 * STORAGE_PAGE_SIZE)
+#error Each half of the bank store has to be whole pages of flash
+#endif
+
+static uint8_t frames[BANK_FRAMES][BANK_SIZE];
+static int16_t frame_bank[BANK_FRAMES];     // the bank in each frame, or -1
+static uint8_t frame_changed[BANK_FRAMES];
+static uint32_t frame_used[BANK_FRAMES];    // when each was last switched to
+static uint32_t use_count;
+
+uint8_t *bank_window = frames[0];
+uint8_t *bank_changed = &frame_changed[0];
+
+static uint8_t registers[BANK_REGISTERS];
+
+// Where the newest record of each bank is, from BANK_FLASH, or 0 if it has
+// never been written. The store is the half in store_half, or -1 if there
+// isn't one yet, and the next record goes at store_tail.
+static uint16_t records[BANK_COUNT];
+static int store_half = -1;
+static uint32_t store_tail;
+
+static uint32_t half_start(int half) {
+    return BANK_FLASH + half * BANK_HALF;
+}
+
+static int half_valid(int half) {
+    const BANK_HEADER *header = (const BANK_HEADER *) half_start(half);
+    return (header->magic == BANK_MAGIC) && (header->version == BANK_VERSION);
+}
+
+static uint32_t half_generation(int half) {
+    return ((const BANK_HEADER *) half_start(half))->generation;
+}
+
+static uint32_t record_size(uint16_t packed) {
+    return sizeof(BANK_RECORD) + ((packed + 1) & ~1);
+}
+
+// Returns the record at address, or NULL if the store ends there. A record
+// cut short by losing power still takes up its space, but isn't done.
+static const BANK_RECORD *record_at(uint32_t address, uint32_t end) {
+    const BANK_RECORD *record = (const BANK_RECORD *) address;
+
+    if ((address + sizeof(BANK_RECORD) > end) || (record->packed == 0xffff) ||
+            (record_size(record->packed) > end - address)) {
+        return NULL;
+    }
+    return record;
+}
+
+static uint32_t get32(int offset) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | registers[offset + i];
+    }
+    return value;
+}
+
+static void put32(int offset, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        registers[offset + i] = value >> (i * 8);
+    }
+}
+
+static void count(int offset, uint32_t n) {
+    put32(offset, get32(offset) + n);
+}
+
+static void put(void *context, uint8_t b) {
+    storage_put(context, b);
+}
+
+// The bytes of data a bank's record will have, compressed unless that
+// comes out longer
+static uint16_t packed_size(const uint8_t *data) {
+    uint32_t packed = lz4_compress(data, BANK_SIZE, NULL, NULL);
+    return packed < BANK_SIZE ? packed : BANK_SIZE;
+}
+
+// Writes a bank's record and data, leaving done to be programmed once it is
+// all there
+static void write_record(STORAGE_WRITER *writer, uint8_t bank, const uint8_t *data, uint16_t packed) {
+    BANK_RECORD record;
+
+    record.packed = packed;
+    record.bank = bank;
+    record.encoding = packed < BANK_SIZE ? BANK_LZ4 : BANK_RAW;
+    record.reserved = 0;
+    storage_write(writer, &record, offsetof(BANK_RECORD, done));
+    storage_skip(writer, sizeof(BANK_RECORD) - offsetof(BANK_RECORD, done));
+    if (record.encoding == BANK_LZ4) {
+        lz4_compress(data, BANK_SIZE, put, writer);
+    } else {
+        storage_write(writer, data, BANK_SIZE);
+    }
+    if (writer->address & 1) {
+        storage_put(writer, 0xff);
+    }
+}
+
+static int finish_record(uint32_t address) {
+    uint16_t done = 0;
+    return storage_program(address + offsetof(BANK_RECORD, done), &done, sizeof(done));
+}
+
+// Starts the store again in the other half, with the newest record of
+// every bank but the one being written, then that one. The header goes
+// in last, so losing power part way leaves the old store.
+static int new_store(uint8_t bank, const uint8_t *data, uint16_t packed) {
+    int other = store_half < 0 ? 0 : store_half ^ 1;
+    uint32_t start = half_start(other);
+    uint32_t end = start + BANK_HALF;
+    uint16_t moved[BANK_COUNT];
+    BANK_HEADER header;
+    STORAGE_WRITER writer;
+
+    // Give up before erasing anything if it won't fit, or every switch
+    // would wear out another half's worth of flash for nothing
+    uint32_t size = sizeof(header) + record_size(packed);
+    for (int b = 0; b < BANK_COUNT; b++) {
+        if ((b != bank) && records[b]) {
+            size += record_size(((const BANK_RECORD *) (BANK_FLASH + records[b]))->packed);
+        }
+    }
+    if (size > BANK_HALF) return 1;
+
+    header.magic = BANK_MAGIC;
+    header.version = BANK_VERSION;
+    header.reserved = 0;
+    header.generation = store_half < 0 ? 1 : half_generation(store_half) + 1;
+
+    storage_open(&writer, start, end);
+    storage_skip(&writer, sizeof(header));
+    for (int b = 0; b < BANK_COUNT; b++) {
+        moved[b] = 0;
+        if ((b == bank) || !records[b]) continue;
+        const BANK_RECORD *old = (const BANK_RECORD *) (BANK_FLASH + records[b]);
+        moved[b] = writer.address - BANK_FLASH;
+        storage_write(&writer, old, record_size(old->packed));
+    }
+    uint32_t address = writer.address;
+    write_record(&writer, bank, data, packed);
+    uint32_t tail = writer.address;
+    // Erase the rest, so there is nothing but erased flash after the last record
+    storage_skip(&writer, end - writer.address);
+    if (storage_close(&writer) || finish_record(address) ||
+            storage_program(start, &header, sizeof(header))) {
+        return 1;
+    }
+
+    moved[bank] = address - BANK_FLASH;
+    for (int b = 0; b < BANK_COUNT; b++) {
+        records[b] = moved[b];
+    }
+    store_half = other;
+    store_tail = tail;
+    return 0;
+}
+
+// Writes a frame's bank to flash. Returns nonzero if it didn't fit, even in
+// a fresh half, or the flash couldn't be written.
+static int write_back(int frame) {
+    STORAGE_WRITER writer;
+    uint8_t bank = frame_bank[frame];
+    uint16_t packed = packed_size(frames[frame]);
+    uint32_t address = store_tail;
+    uint32_t erases = storage_erases;
+    int error;
+
+    if ((store_half < 0) || (address + record_size(packed) > half_start(store_half) + BANK_HALF)) {
+        error = new_store(bank, frames[frame], packed);
+    } else {
+        // new_store erased the whole half, so nothing after the tail needs it again
+        uint32_t end = half_start(store_half) + BANK_HALF;
+        storage_append(&writer, address, end, end);
+        write_record(&writer, bank, frames[frame], packed);
+        store_tail = writer.address;
+        error = storage_close(&writer) || finish_record(address);
+        if (!error) records[bank] = address - BANK_FLASH;
+    }
+    // Counted where they happen, so a failed write's erases show up too
+    count(BANK_ERASES, storage_erases - erases);
+    if (error) return 1;
+    count(BANK_WRITES, 1);
+    frame_changed[frame] = 0;
+    return 0;
+}
+
+static int read_bank(int frame, uint8_t bank) {
+    if (!records[bank]) {
+        memset(frames[frame], 0, BANK_SIZE);
+        return 0;
+    }
+    const BANK_RECORD *record = (const BANK_RECORD *) (BANK_FLASH + records[bank]);
+    if (record->encoding == BANK_LZ4) {
+        return lz4_decompress((const uint8_t *) (record + 1), record->packed, frames[frame], BANK_SIZE);
+    }
+    memcpy(frames[frame], record + 1, BANK_SIZE);
+    return 0;
+}
+
+// The frame with bank in it, or the one to put it in
+static int find_frame(uint8_t bank, int *hit) {
+    int oldest = 0;
+
+    // A frame that has never been used has frame_used 0, so it goes first
+    for (int f = 0; f < BANK_FRAMES; f++) {
+        if (frame_bank[f] == bank) {
+            *hit = 1;
+            return f;
+        }
+        if (frame_used[f] < frame_used[oldest]) {
+            oldest = f;
+        }
+    }
+    *hit = 0;
+    return oldest;
+}
+
+static void show(int frame) {
+    frame_used[frame] = ++use_count;
+    bank_window = frames[frame];
+    bank_changed = &frame_changed[frame];
+#ifdef BLOCK_CACHE
+    // Anything decoded from the window came from the old bank
+    for (uint32_t page = BANK_WINDOW; page < BANK_WINDOW + BANK_SIZE; page += 0x100) {
+        CACHE_WRITE(page);
+    }
+#endif
+}
+
+static uint8_t select_bank(uint8_t bank) {
+    int hit;
+
+    if (bank >= BANK_COUNT) return BANK_BAD;
+    uint32_t start = DWT->CYCCNT;
+    int frame = find_frame(bank, &hit);
+    count(BANK_SWITCHES, 1);
+    if (hit) {
+        count(BANK_HITS, 1);
+    } else {
+        if ((frame_bank[frame] >= 0) && frame_changed[frame] && write_back(frame)) {
+            return BANK_FULL;
+        }
+        // If it won't decompress there's nothing to be done but carry on
+        // with what did
+        read_bank(frame, bank);
+        frame_bank[frame] = bank;
+        frame_changed[frame] = 0;
+    }
+    show(frame);
+
+    uint32_t us = (DWT->CYCCNT - start) / (SystemCoreClock / 1000000);
+    put32(BANK_LATENCY, us);
+    if (us > get32(BANK_WORST)) put32(BANK_WORST, us);
+    return 0;
+}
+
+static uint8_t run(uint8_t command) {
+    uint8_t status = 0;
+
+    switch (command) {
+    case BANK_FLUSH:
+        for (int f = 0; f < BANK_FRAMES; f++) {
+            if ((frame_bank[f] >= 0) && frame_changed[f] && write_back(f)) {
+                status = BANK_FULL;
+            }
+        }
+        return status;
+    case BANK_CLEAR_COUNTERS:
+        memset(&registers[BANK_SWITCHES], 0, BANK_REGISTERS - BANK_SWITCHES);
+        return 0;
+    default:
+        return BANK_BAD;
+    }
+}
+
+void bank_init() {
+    // The cycle counter times the switches
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    if (half_valid(0) && half_valid(1)) {
+        store_half = half_generation(1) > half_generation(0);
+    } else if (half_valid(0)) {
+        store_half = 0;
+    } else if (half_valid(1)) {
+        store_half = 1;
+    }
+
+    if (store_half >= 0) {
+        uint32_t end = half_start(store_half) + BANK_HALF;
+        store_tail = half_start(store_half) + sizeof(BANK_HEADER);
+        for (const BANK_RECORD *record = record_at(store_tail, end); record;
+                record = record_at(store_tail, end)) {
+            if (!record->done && (record->bank < BANK_COUNT)) {
+                records[record->bank] = (uintptr_t) record - BANK_FLASH;
+            }
+            store_tail += record_size(record->packed);
+        }
+    }
+
+    for (int f = 0; f < BANK_FRAMES; f++) {
+        frame_bank[f] = -1;
+    }
+    read_bank(0, 0);
+    frame_bank[0] = 0;
+    show(0);
+}
+
+uint8_t bank_read(uint16_t address) {
+    uint8_t offset = address & 0xff;
+    return offset < BANK_REGISTERS ? registers[offset] : 0;
+}
+
+void bank_write(uint16_t address, uint8_t value) {
+    uint8_t offset = address & 0xff;
+    if (offset == BANK_SELECT) {
+        registers[BANK_SELECT] = value;
+        registers[BANK_STATUS] = select_bank(value);
+    } else if (offset == BANK_COMMAND) {
+        registers[BANK_COMMAND] = value;
+        registers[BANK_STATUS] = run(value);
+    }
+}
+#endif
@@ -0,0 +1,51 @@
+// Emulation speed measurement, compiled in with BENCHMARK. The time the
+// emulator spends blocked in GETCH waiting for a key is left out, so you can
+// type control-B, run a program that returns to the monitor, and type
+// control-B again to see how fast it ran.
+
+#include "main.h"
+#include "benchmark.h"
+#include "idle.h"
+
+#ifdef BENCHMARK
+
+extern UART_HandleTypeDef huart1;
+
+uint32_t bench_instructions;
+static uint32_t bench_start;
+static uint32_t bench_idle;
+static uint32_t bench_wait;
+
+void benchmark_reset() {
+    bench_instructions = 0;
+    bench_idle = 0;
+    bench_start = HAL_GetTick();
+    bench_wait = bench_start;
+}
+
+void benchmark_wait_start() {
+    bench_wait = HAL_GetTick();
+}
+
+void benchmark_wait_end() {
+    bench_idle += HAL_GetTick() - bench_wait;
+}
+
+void benchmark_report() {
+    char line[96];
+    uint32_t ms = bench_wait - bench_start - bench_idle;
+    uint32_t ips = ms ? (uint32_t) ((uint64_t) bench_instructions * 1000 / ms) : 0;
+
+    int len = snprintf(line, sizeof(line), "\r\n%lu instructions in %lu ms, %lu per second at %lu MHz\r\n",
+            bench_instructions, ms, ips, SystemCoreClock / 1000000);
+    HAL_UART_Transmit(&huart1, (uint8_t *) line, len, 1000);
+#ifdef IDLE_SKIP
+    len = snprintf(line, sizeof(line), "%lu cycles skipped in %lu idle loops, %lu sleeps\r\n",
+            idle_skipped_cycles, idle_skips, idle_sleeps);
+    HAL_UART_Transmit(&huart1, (uint8_t *) line, len, 1000);
+#endif
+
+    benchmark_reset();
+}
+
+#endif
@@ -0,0 +1,107 @@
+// The block move and fill device, compiled in with BLOCK_MOVE. A 6502 copy
+// loop takes 10 or more cycles a byte, so clearing the screen or shuffling
+// a table is much quicker handed to memmove() and memset(). When both ends
+// are in one of main.c's RAM arrays they are used directly, and otherwise
+// the move goes a byte at a time through read6502 and write6502, which
+// also covers I/O and wrapping around the top of memory.
+//
+// The DMA controller could do the copy too, but the 6502 can't run again
+// until it is finished, so it wouldn't be any quicker than memmove().
+
+#include <string.h>
+#include "main.h"
+#include "fake6502.h"
+#include "dirty.h"
+#include "irq.h"
+#include "blockmove.h"
+
+#ifdef BLOCK_MOVE
+
+static uint8_t registers[MOVE_REGISTERS];
+
+static uint16_t get16(int offset) {
+    return registers[offset] | (registers[offset + 1] << 8);
+}
+
+// Memory changed behind write6502's back
+static void written(uint16_t address, uint16_t length) {
+#ifdef BLOCK_CACHE
+    for (uint32_t page = address >> 8; page <= (address + length - 1) >> 8; page++) {
+        CACHE_WRITE(page << 8);
+    }
+#endif
+#ifdef DIRTY_PAGES
+    dirty_range(address, length);
+#endif
+}
+
+static void copy(uint16_t source, uint16_t dest, uint16_t length) {
+    uint8_t *from = span6502(source, length);
+    uint8_t *to = span6502(dest, length);
+
+    if (from && to) {
+        memmove(to, from, length);
+        written(dest, length);
+    } else if ((uint16_t) (dest - source) < length) {
+        // dest is inside the source, so go backwards
+        for (uint16_t i = length; i-- > 0; ) {
+            write6502(dest + i, read6502(source + i));
+        }
+    } else {
+        for (uint16_t i = 0; i < length; i++) {
+            write6502(dest + i, read6502(source + i));
+        }
+    }
+}
+
+static void set(uint16_t dest, uint16_t length, uint8_t value) {
+    uint8_t *to = span6502(dest, length);
+
+    if (to) {
+        memset(to, value, length);
+        written(dest, length);
+    } else {
+        for (uint16_t i = 0; i < length; i++) {
+            write6502(dest + i, value);
+        }
+    }
+}
+
+static int run(uint8_t command) {
+    uint16_t length = get16(MOVE_LENGTH);
+
+    switch (command) {
+    case MOVE_COPY:
+        if (length) copy(get16(MOVE_SOURCE), get16(MOVE_DEST), length);
+        clockticks6502 += (uint32_t) length * MOVE_COPY_CYCLES;
+        return 0;
+    case MOVE_SET:
+        if (length) set(get16(MOVE_DEST), length, registers[MOVE_FILL]);
+        clockticks6502 += (uint32_t) length * MOVE_SET_CYCLES;
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+uint8_t move_read(uint16_t address) {
+    uint8_t offset = address & 0xff;
+    if (offset == MOVE_STATUS) {
+        irq_lower(IRQ_BLOCK_MOVE);
+    }
+    return offset < MOVE_REGISTERS ? registers[offset] : 0;
+}
+
+void move_write(uint16_t address, uint8_t value) {
+    uint8_t offset = address & 0xff;
+    if ((offset >= MOVE_REGISTERS) || (offset == MOVE_STATUS)) return;
+    registers[offset] = value;
+    if (offset == MOVE_COMMAND) {
+        registers[MOVE_STATUS] = 0;
+        registers[MOVE_STATUS] = MOVE_DONE | (run(value) ? MOVE_ERROR : 0);
+        if (registers[MOVE_CONTROL] & MOVE_IRQ_ENABLE) {
+            irq_raise(IRQ_BLOCK_MOVE);
+        }
+    }
+}
+#endif
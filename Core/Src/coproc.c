@@ -0,0 +1,149 @@
+// The math coprocessor, compiled in with COPROCESSOR. A 6502 multiply or
+// divide loop takes hundreds of cycles, where the Cortex-M4 has a single
+// cycle multiply and a hardware divide, so 6502 programs can hand those to
+// it through the registers in page 14. See coproc.h for the commands and
+// asm/coproc.s for 6502 routines that use them.
+
+#include "main.h"
+#include "fake6502.h"
+#include "coproc.h"
+
+#ifdef COPROCESSOR
+
+static uint8_t registers[COPROC_REGISTERS];
+
+static uint32_t get(int offset, int bytes) {
+    uint32_t value = 0;
+    while (bytes--) {
+        value = (value << 8) | registers[offset + bytes];
+    }
+    return value;
+}
+
+static void put(int offset, int bytes, uint32_t value) {
+    for (int i = 0; i < bytes; i++) {
+        registers[offset + i] = value;
+        value >>= 8;
+    }
+}
+
+static void put64(uint64_t value) {
+    put(COPROC_R, 4, value);
+    put(COPROC_R + 4, 4, value >> 32);
+}
+
+// The integer square root, working down n two bits at a time. The build
+// uses soft float, so sqrtf() would be slower.
+static uint32_t isqrt(uint32_t n) {
+    uint32_t root = 0;
+    for (uint32_t bit = 1UL << 30; bit; bit >>= 2) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+static int bcd2bin(uint32_t bcd, uint32_t *binary) {
+    uint32_t value = 0;
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        uint32_t digit = (bcd >> shift) & 15;
+        if (digit > 9) return 1;
+        value = value * 10 + digit;
+    }
+    *binary = value;
+    return 0;
+}
+
+static uint16_t crc16(uint16_t crc, uint16_t address, uint16_t length) {
+    while (length--) {
+        crc ^= read6502(address++) << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Like zlib's crc32(), so it starts from 0 and can be carried on
+static uint32_t crc32(uint32_t crc, uint16_t address, uint16_t length) {
+    crc = ~crc;
+    while (length--) {
+        crc ^= read6502(address++);
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xedb88320UL & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static int run(uint8_t command) {
+    uint32_t a = get(COPROC_A, 4);
+    uint32_t b = get(COPROC_B, 4);
+    uint32_t value;
+
+    switch (command) {
+    case COPROC_MUL16:
+        put64((uint32_t) (a & 0xffff) * (b & 0xffff));
+        return 0;
+    case COPROC_MUL32:
+        put64((uint64_t) a * b);
+        return 0;
+    case COPROC_DIV16:
+        a &= 0xffff;
+        b &= 0xffff;
+        if (!b) return 1;
+        put64(((uint64_t) (a % b) << 32) | (a / b));
+        return 0;
+    case COPROC_DIV32:
+        if (!b) return 1;
+        put64(((uint64_t) (a % b) << 32) | (a / b));
+        return 0;
+    case COPROC_SQRT:
+        value = isqrt(a);
+        put64(((uint64_t) (a - value * value) << 32) | value);
+        return 0;
+    case COPROC_BIN2BCD: {
+        uint64_t bcd = 0;
+        for (int shift = 0; a; shift += 4) {
+            bcd |= (uint64_t) (a % 10) << shift;
+            a /= 10;
+        }
+        put64(bcd);
+        return 0;
+    }
+    case COPROC_BCD2BIN:
+        if (bcd2bin(a, &value)) return 1;
+        put64(value);
+        return 0;
+    case COPROC_CRC16:
+        put(COPROC_R, 2, crc16(get(COPROC_R, 2), a, b));
+        clockticks6502 += (b & 0xffff) * COPROC_CRC_CYCLES;
+        return 0;
+    case COPROC_CRC32:
+        put(COPROC_R, 4, crc32(get(COPROC_R, 4), a, b));
+        clockticks6502 += (b & 0xffff) * COPROC_CRC_CYCLES;
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+uint8_t coproc_read(uint16_t address) {
+    uint8_t offset = address & 0xff;
+    return offset < COPROC_REGISTERS ? registers[offset] : 0;
+}
+
+void coproc_write(uint16_t address, uint8_t value) {
+    uint8_t offset = address & 0xff;
+    if (offset >= COPROC_REGISTERS) return;
+    registers[offset] = value;
+    if (offset == COPROC_COMMAND) {
+        registers[COPROC_STATUS] = run(value) ? COPROC_ERROR : 0;
+        clockticks6502 += COPROC_CYCLES;
+    }
+}
+#endif
@@ -0,0 +1,41 @@
+// Keeping track of which pages of 6502 memory have changed, compiled in with
+// DIRTY_PAGES, so a save only has to look at what changed
+
+#include "main.h"
+#include "dirty.h"
+
+#ifdef DIRTY_PAGES
+
+uint32_t dirty_pages[8];
+
+void dirty_clear() {
+    for (int i = 0; i < 8; i++) {
+        dirty_pages[i] = 0;
+    }
+}
+
+void dirty_range(uint16_t address, uint32_t length) {
+    if (!length) return;
+    uint32_t last = (address + length - 1) >> 8;
+    for (uint32_t page = address >> 8; page <= last && page < 256; page++) {
+        dirty_pages[page >> 5] |= 1UL << (page & 31);
+    }
+}
+
+int dirty_next(int page) {
+    while (page < 256) {
+        uint32_t bits = dirty_pages[page >> 5] >> (page & 31);
+        if (bits) return page + __builtin_ctz(bits);
+        page = (page | 31) + 1;
+    }
+    return -1;
+}
+
+int dirty_count() {
+    int count = 0;
+    for (int i = 0; i < 8; i++) {
+        count += __builtin_popcount(dirty_pages[i]);
+    }
+    return count;
+}
+#endif
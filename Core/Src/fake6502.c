@@ -104,6 +104,15 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include "ccmram.h"
+#include "fake6502.h"
+#include "profile.h"
+#include "trace.h"
+#include "jit.h"
+#include "irq.h"
+#include "dirty.h"
+#include "memmap.h"
+#include "bus.h"
 
 //6502 defines
 #define UNDOCUMENTED //when this is defined, undocumented opcodes are handled.
@@ -125,6 +134,13 @@
 
 #define BASE_STACK     0x100
 
+//the zero page and the stack are plain RAM in every memory map, see
+//memmap.h, so what can only reach them skips read6502 and write6502
+#define ZPREAD(addr) LOW_RAM[addr]
+#define ZPWRITE(addr, val) { CACHE_WRITE(addr); DIRTY_WRITE(addr); LOW_RAM[addr] = (val); }
+#define GETZP (uint16_t)ZPREAD(ea)
+#define PUTZP(x) ZPWRITE(ea, (x) & 0xff)
+
 #define SAVEACCUM(x) a = (uint8_t)((x) & 0x00FF)
 
 
@@ -166,44 +182,51 @@
 
 
 //6502 CPU registers
-#ifdef GLOBAL_REGISTERS
-register uint16_t pc asm ("r6");
-register uint8_t a asm ("r7");
-register uint8_t x asm ("r8");
-register uint8_t y asm ("r9");
-register uint8_t status asm ("r10");
-uint8_t sp;
-
-#else
+#ifndef GLOBAL_REGISTERS
+uint32_t clockticks6502;
 uint16_t pc;
 uint8_t sp, a, x, y, status;
+#elif !defined(SP_REGISTER)
+uint8_t sp;
+#endif
+
+#if defined(SUPERINSTRUCTIONS) && !defined(BLOCK_CACHE)
+#error SUPERINSTRUCTIONS needs BLOCK_CACHE
+#endif
+#if defined(ROM_TRANSLATE) && !defined(BLOCK_CACHE)
+#error ROM_TRANSLATE needs BLOCK_CACHE
+#endif
+#if defined(JIT) && !defined(BLOCK_CACHE)
+#error JIT needs BLOCK_CACHE
 #endif
 
+#ifdef BLOCK_CACHE
+//operand bytes of the instruction being run, fetched when it was decoded
+static uint16_t operand;
+#endif
 
-//externally supplied functions
-extern uint8_t read6502(uint16_t address);
-extern void write6502(uint16_t address, uint8_t value);
 
 //a few general functions used by various other functions
-void push16(uint16_t pushval) {
-    write6502(BASE_STACK + sp, (pushval >> 8) & 0xFF);
-    write6502(BASE_STACK + ((sp - 1) & 0xFF), pushval & 0xFF);
+HOTPATH void push16(uint16_t pushval) {
+    ZPWRITE(BASE_STACK + sp, (pushval >> 8) & 0xFF);
+    ZPWRITE(BASE_STACK + ((sp - 1) & 0xFF), pushval & 0xFF);
     sp -= 2;
 }
 
-void push8(uint8_t pushval) {
-    write6502(BASE_STACK + sp--, pushval);
+HOTPATH void push8(uint8_t pushval) {
+    ZPWRITE(BASE_STACK + sp, pushval);
+    sp--;
 }
 
-uint16_t pull16() {
+HOTPATH uint16_t pull16() {
     uint16_t temp16;
-    temp16 = read6502(BASE_STACK + ((sp + 1) & 0xFF)) | ((uint16_t)read6502(BASE_STACK + ((sp + 2) & 0xFF)) << 8);
+    temp16 = ZPREAD(BASE_STACK + ((sp + 1) & 0xFF)) | ((uint16_t)ZPREAD(BASE_STACK + ((sp + 2) & 0xFF)) << 8);
     sp += 2;
     return(temp16);
 }
 
-uint8_t pull8() {
-    return (read6502(BASE_STACK + ++sp));
+HOTPATH uint8_t pull8() {
+    return ZPREAD(BASE_STACK + ++sp);
 }
 
 void reset6502() {
@@ -217,26 +240,82 @@ void reset6502() {
 
 static void (*optable[256])();
 
+//base clock cycles for each opcode. taken branches add their own extra
+//cycles, page crossing penalties on indexed reads are not counted.
+const uint8_t ticktable[256] = {
+/*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |     */
+/* 0 */      7,    6,    2,    8,    3,    3,    5,    5,    3,    2,    2,    2,    4,    4,    6,    6,  /* 0 */
+/* 1 */      2,    5,    2,    8,    4,    4,    6,    6,    2,    4,    2,    7,    4,    4,    7,    7,  /* 1 */
+/* 2 */      6,    6,    2,    8,    3,    3,    5,    5,    4,    2,    2,    2,    4,    4,    6,    6,  /* 2 */
+/* 3 */      2,    5,    2,    8,    4,    4,    6,    6,    2,    4,    2,    7,    4,    4,    7,    7,  /* 3 */
+/* 4 */      6,    6,    2,    8,    3,    3,    5,    5,    3,    2,    2,    2,    3,    4,    6,    6,  /* 4 */
+/* 5 */      2,    5,    2,    8,    4,    4,    6,    6,    2,    4,    2,    7,    4,    4,    7,    7,  /* 5 */
+/* 6 */      6,    6,    2,    8,    3,    3,    5,    5,    4,    2,    2,    2,    5,    4,    6,    6,  /* 6 */
+/* 7 */      2,    5,    2,    8,    4,    4,    6,    6,    2,    4,    2,    7,    4,    4,    7,    7,  /* 7 */
+/* 8 */      2,    6,    2,    6,    3,    3,    3,    3,    2,    2,    2,    2,    4,    4,    4,    4,  /* 8 */
+/* 9 */      2,    6,    2,    6,    4,    4,    4,    4,    2,    5,    2,    5,    5,    5,    5,    5,  /* 9 */
+/* A */      2,    6,    2,    6,    3,    3,    3,    3,    2,    2,    2,    2,    4,    4,    4,    4,  /* A */
+/* B */      2,    5,    2,    5,    4,    4,    4,    4,    2,    4,    2,    4,    4,    4,    4,    4,  /* B */
+/* C */      2,    6,    2,    8,    3,    3,    5,    5,    2,    2,    2,    2,    4,    4,    6,    6,  /* C */
+/* D */      2,    5,    2,    8,    4,    4,    6,    6,    2,    4,    2,    7,    4,    4,    7,    7,  /* D */
+/* E */      2,    6,    2,    8,    3,    3,    5,    5,    2,    2,    2,    2,    4,    4,    6,    6,  /* E */
+/* F */      2,    5,    2,    8,    4,    4,    6,    6,    2,    4,    2,    7,    4,    4,    7,    7   /* F */
+};
+
+//length in bytes of each instruction, including the opcode
+const uint8_t oplength[256] = {
+    1, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, /* 0 */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3, /* 1 */
+    3, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, /* 2 */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3, /* 3 */
+    1, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, /* 4 */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3, /* 5 */
+    1, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, /* 6 */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3, /* 7 */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, /* 8 */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3, /* 9 */
+    2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, /* A */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3, /* B */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, /* C */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3, /* D */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, /* E */
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3, /* F */
+};
+
 //addressing mode functions, calculates effective addresses
 
+#ifdef BLOCK_CACHE
+//the block cache has already fetched the operand bytes into operand
+#define OPERAND8 (uint16_t)(operand & 0xFF)
+#define OPERAND16 operand
+#define IMM pc++
+#define IMMVALUE OPERAND8
+#else
+#define OPERAND8 (uint16_t)bus_read(pc)
+#define OPERAND16 ((uint16_t)bus_read(pc) | ((uint16_t)bus_read(pc+1) << 8))
 #define IMM uint16_t ea = pc++
-#define ZP uint16_t ea = (uint16_t)read6502((uint16_t)pc++)
-#define ZPX uint16_t ea = ((uint16_t)read6502((uint16_t)pc++) + (uint16_t)x) & 0xFF
-#define ZPY uint16_t ea = ((uint16_t)read6502((uint16_t)pc++) + (uint16_t)y) & 0xFF
-#define REL uint16_t reladdr = (uint16_t)read6502(pc++); if (reladdr & 0x80) reladdr |= 0xFF00
-#define ABSO uint16_t ea = (uint16_t)read6502(pc) | ((uint16_t)read6502(pc+1) << 8); pc += 2
-#define ABSX  uint16_t ea = ((uint16_t)read6502(pc) | ((uint16_t)read6502(pc+1) << 8)); ea += (uint16_t)x; pc += 2
-#define ABSXNP uint16_t ea = ((uint16_t)read6502(pc) | ((uint16_t)read6502(pc+1) << 8)); ea += (uint16_t)x; pc += 2
-#define ABSY uint16_t ea = ((uint16_t)read6502(pc) | ((uint16_t)read6502(pc+1) << 8)); ea += (uint16_t)y; pc += 2
-#define ABSYNP uint16_t ea = ((uint16_t)read6502(pc) | ((uint16_t)read6502(pc+1) << 8)); ea += (uint16_t)y; pc += 2
-#define IND uint16_t eahelp, eahelp2; eahelp = (uint16_t)read6502(pc) | (uint16_t)((uint16_t)read6502(pc+1) << 8); eahelp2 = (eahelp & 0xFF00) | ((eahelp + 1) & 0x00FF); uint16_t ea = (uint16_t)read6502(eahelp) | ((uint16_t)read6502(eahelp2) << 8); pc += 2
-#define INDX uint16_t eahelp; eahelp = (uint16_t)(((uint16_t)read6502(pc++) + (uint16_t)x) & 0xFF); uint16_t ea = (uint16_t)read6502(eahelp & 0x00FF) | ((uint16_t)read6502((eahelp+1) & 0x00FF) << 8)
-#define INDY uint16_t eahelp, eahelp2; eahelp = (uint16_t)read6502(pc++); eahelp2 = (eahelp & 0xFF00) | ((eahelp + 1) & 0x00FF); uint16_t ea = (uint16_t)read6502(eahelp) | ((uint16_t)read6502(eahelp2) << 8); ea += (uint16_t)y
-#define INDYNP uint16_t eahelp, eahelp2; eahelp = (uint16_t)read6502(pc++); eahelp2 = (eahelp & 0xFF00) | ((eahelp + 1) & 0x00FF); uint16_t ea = (uint16_t)read6502(eahelp) | ((uint16_t)read6502(eahelp2) << 8); ea += (uint16_t)y
-
-#define GETVALUE (uint16_t)read6502(ea)
-#define GETVALUE16 (uint16_t)read6502(ea) (uint16_t)read6502(ea) | ((uint16_t)read6502(ea+1) << 8)
-#define PUTVALUE(x) write6502(ea, (x & 0xff))
+#define IMMVALUE GETVALUE
+#endif
+#define ZP uint16_t ea = OPERAND8; pc++
+#define ZPX uint16_t ea = (OPERAND8 + (uint16_t)x) & 0xFF; pc++
+#define ZPY uint16_t ea = (OPERAND8 + (uint16_t)y) & 0xFF; pc++
+#define REL uint16_t reladdr = OPERAND8; pc++; if (reladdr & 0x80) reladdr |= 0xFF00
+#define ABSO uint16_t ea = OPERAND16; pc += 2
+#define ABSX  uint16_t ea = OPERAND16; ea += (uint16_t)x; pc += 2
+#define ABSXNP uint16_t ea = OPERAND16; ea += (uint16_t)x; pc += 2
+#define ABSY uint16_t ea = OPERAND16; ea += (uint16_t)y; pc += 2
+#define ABSYNP uint16_t ea = OPERAND16; ea += (uint16_t)y; pc += 2
+#define IND uint16_t eahelp, eahelp2; eahelp = OPERAND16; eahelp2 = (eahelp & 0xFF00) | ((eahelp + 1) & 0x00FF); uint16_t ea = (uint16_t)bus_read(eahelp) | ((uint16_t)bus_read(eahelp2) << 8); pc += 2
+#define INDX uint16_t eahelp; eahelp = (OPERAND8 + (uint16_t)x) & 0xFF; pc++; uint16_t ea = (uint16_t)ZPREAD(eahelp & 0x00FF) | ((uint16_t)ZPREAD((eahelp+1) & 0x00FF) << 8)
+#define INDY uint16_t eahelp, eahelp2; eahelp = OPERAND8; pc++; eahelp2 = (eahelp + 1) & 0x00FF; uint16_t ea = (uint16_t)ZPREAD(eahelp) | ((uint16_t)ZPREAD(eahelp2) << 8); ea += (uint16_t)y
+#define INDYNP uint16_t eahelp, eahelp2; eahelp = OPERAND8; pc++; eahelp2 = (eahelp + 1) & 0x00FF; uint16_t ea = (uint16_t)ZPREAD(eahelp) | ((uint16_t)ZPREAD(eahelp2) << 8); ea += (uint16_t)y
+
+//a taken branch costs one more cycle, or two if it lands on another page
+#define BRANCH { uint16_t oldpc = pc; pc += reladdr; clockticks6502 += ((oldpc ^ pc) & 0xFF00) ? 2 : 1; }
+
+#define GETVALUE (uint16_t)bus_read(ea)
+#define GETVALUE16 (uint16_t)bus_read(ea) (uint16_t)bus_read(ea) | ((uint16_t)bus_read(ea+1) << 8)
+#define PUTVALUE(x) bus_write(ea, (x & 0xff))
 
 //instruction handler functions
 
@@ -321,9 +400,9 @@ static void adc_absy() {  // 0x79
     SAVEACCUM(result);
 }
 
-static void adc_imm() {  // 0x69
+static HOTPATH void adc_imm() {  // 0x69
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     uint16_t result = (uint16_t)a + value + (uint16_t)(status & FLAG_CARRY);
 
     carrycalc(result);
@@ -402,9 +481,9 @@ static void adc_indy() {  // 0x71
     SAVEACCUM(result);
 }
 
-static void adc_zp() {  // 0x65
+static HOTPATH void adc_zp() {  // 0x65
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a + value + (uint16_t)(status & FLAG_CARRY);
 
     carrycalc(result);
@@ -431,7 +510,7 @@ static void adc_zp() {  // 0x65
 
 static void adc_zpx() {  // 0x75
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a + value + (uint16_t)(status & FLAG_CARRY);
 
     carrycalc(result);
@@ -489,9 +568,9 @@ static void and_absy() {  // 0x39
     SAVEACCUM(result);
 }
 
-static void and_imm() {  // 0x29
+static HOTPATH void and_imm() {  // 0x29
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     uint16_t result = (uint16_t)a & value;
    
     zerocalc(result);
@@ -524,7 +603,7 @@ static void and_indy() {  // 0x31
 
 static void and_zp() {  // 0x25
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a & value;
    
     zerocalc(result);
@@ -535,7 +614,7 @@ static void and_zp() {  // 0x25
 
 static void and_zpx() {  // 0x35
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a & value;
    
     zerocalc(result);
@@ -544,7 +623,7 @@ static void and_zpx() {  // 0x35
     SAVEACCUM(result);
 }
 
-static void asl_acc() {  // 0x0a
+static HOTPATH void asl_acc() {  // 0x0a
     uint8_t value = a;
     uint16_t result = value << 1;
 
@@ -581,50 +660,50 @@ static void asl_absx() {  // 0x1e
 
 static void asl_zp() {  // 0x06
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = value << 1;
 
     carrycalc(result);
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
 static void asl_zpx() {  // 0x16
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = value << 1;
 
     carrycalc(result);
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
-static void bcc_rel() {
+static HOTPATH void bcc_rel() {
     REL;
     if ((status & FLAG_CARRY) == 0) {
-        pc += reladdr;
+        BRANCH;
     }
 }
 
-static void bcs_rel() {  // 0x90
+static HOTPATH void bcs_rel() {  // 0x90
     REL;
     if ((status & FLAG_CARRY) == FLAG_CARRY) {
-        pc += reladdr;
+        BRANCH;
     }
 }
 
-static void beq_rel() {  // 0xf0
+static HOTPATH void beq_rel() {  // 0xf0
     REL;
     if ((status & FLAG_ZERO) == FLAG_ZERO) {
-        pc += reladdr;
+        BRANCH;
     }
 }
 
-static void bit_abso() {  // 0x2c
+static HOTPATH void bit_abso() {  // 0x2c
     ABSO;
     uint8_t value = GETVALUE;
     uint16_t result = (uint16_t)a & value;
@@ -633,33 +712,33 @@ static void bit_abso() {  // 0x2c
     status = (status & 0x3F) | (uint8_t)(value & 0xC0);
 }
 
-static void bit_zp() {  // 0x24
+static HOTPATH void bit_zp() {  // 0x24
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a & value;
    
     zerocalc(result);
     status = (status & 0x3F) | (uint8_t)(value & 0xC0);
 }
 
-static void bmi_rel() {  // 0x30
+static HOTPATH void bmi_rel() {  // 0x30
     REL;
     if ((status & FLAG_SIGN) == FLAG_SIGN) {
-        pc += reladdr;
+        BRANCH;
     }
 }
 
-static void bne_rel() {  // 0xd0
+static HOTPATH void bne_rel() {  // 0xd0
     REL;
     if ((status & FLAG_ZERO) == 0) {
-        pc += reladdr;
+        BRANCH;
     }
 }
 
-static void bpl_rel() {  // 0x10
+static HOTPATH void bpl_rel() {  // 0x10
     REL;
     if ((status & FLAG_SIGN) == 0) {
-        pc += reladdr;
+        BRANCH;
     }
 }
 
@@ -674,18 +753,18 @@ static void brk() {  // 0x00
 static void bvc_rel() {  // 0x50
     REL;
     if ((status & FLAG_OVERFLOW) == 0) {
-        pc += reladdr;
+        BRANCH;
     }
 }
 
 static void bvs_rel() {  // 0x70
     REL;
     if ((status & FLAG_OVERFLOW) == FLAG_OVERFLOW) {
-        pc += reladdr;
+        BRANCH;
     }
 }
 
-static void clc() {  // 0x18
+static HOTPATH void clc() {  // 0x18
     clearcarry();
 }
 
@@ -695,6 +774,7 @@ static void cld() {  // 0xd8
 
 static void cli() {  // 0x58
     clearinterrupt();
+    irq_check = irq_pending;
 }
 
 static void clv() {  // 0xb8
@@ -737,9 +817,9 @@ static void cmp_absy() {  // 0xd9
     signcalc(result);
 }
 
-static void cmp_imm() {  // 0xc9
+static HOTPATH void cmp_imm() {  // 0xc9
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     uint16_t result = (uint16_t)a - value;
    
     if (a >= (uint8_t)(value & 0x00FF)) setcarry();
@@ -773,9 +853,9 @@ static void cmp_indy() {  // 0xd1
     signcalc(result);
 }
 
-static void cmp_zp() {  // 0xc5
+static HOTPATH void cmp_zp() {  // 0xc5
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a - value;
    
     if (a >= (uint8_t)(value & 0x00FF)) setcarry();
@@ -787,7 +867,7 @@ static void cmp_zp() {  // 0xc5
 
 static void cmp_zpx() {  // 0xd5
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a - value;
    
     if (a >= (uint8_t)(value & 0x00FF)) setcarry();
@@ -809,9 +889,9 @@ static void cpx_abso() {  // 0xec
     signcalc(result);
 }
 
-static void cpx_imm() {  // 0xe0
+static HOTPATH void cpx_imm() {  // 0xe0
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     uint16_t result = (uint16_t)x - value;
    
     if (x >= (uint8_t)(value & 0x00FF)) setcarry();
@@ -823,7 +903,7 @@ static void cpx_imm() {  // 0xe0
 
 static void cpx_zp() {  // 0xe4
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)x - value;
    
     if (x >= (uint8_t)(value & 0x00FF)) setcarry();
@@ -845,9 +925,9 @@ static void cpy_abso() {  // 0xcc
     signcalc(result);
 }
 
-static void cpy_imm() {  // 0xc0
+static HOTPATH void cpy_imm() {  // 0xc0
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     uint16_t result = (uint16_t)y - value;
    
     if (y >= (uint8_t)(value & 0x00FF)) setcarry();
@@ -859,7 +939,7 @@ static void cpy_imm() {  // 0xc0
 
 static void cpy_zp() {  // 0xc4
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)y - value;
    
     if (y >= (uint8_t)(value & 0x00FF)) setcarry();
@@ -891,36 +971,36 @@ static void dec_absx() {  // 0xde
     PUTVALUE(result);
 }
 
-static void dec_zp() {  // 0xc6
+static HOTPATH void dec_zp() {  // 0xc6
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = value - 1;
    
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
 static void dec_zpx() {  // 0xd6
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = value - 1;
    
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
-static void dex() {  // 0xca
+static HOTPATH void dex() {  // 0xca
     x--;
    
     zerocalc(x);
     signcalc(x);
 }
 
-static void dey() {  // 0x88
+static HOTPATH void dey() {  // 0x88
     y--;
    
     zerocalc(y);
@@ -960,9 +1040,9 @@ static void eor_absy() {  // 0x59
     SAVEACCUM(result);
 }
 
-static void eor_imm() {  // 0x49
+static HOTPATH void eor_imm() {  // 0x49
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     uint16_t result = (uint16_t)a ^ value;
    
     zerocalc(result);
@@ -995,7 +1075,7 @@ static void eor_indy() {  // 0x51
 
 static void eor_zp() {  // 0x45
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a ^ value;
    
     zerocalc(result);
@@ -1006,7 +1086,7 @@ static void eor_zp() {  // 0x45
 
 static void eor_zpx() {  // 0x55
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a ^ value;
    
     zerocalc(result);
@@ -1037,43 +1117,43 @@ static void inc_absx() {  // 0xfe
     PUTVALUE(result);
 }
 
-static void inc_zp() {  // 0xe6
+static HOTPATH void inc_zp() {  // 0xe6
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = value + 1;
    
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
 static void inc_zpx() {  // 0xf6
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = value + 1;
    
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
-static void inx() {  // 0xe8
+static HOTPATH void inx() {  // 0xe8
     x++;
    
     zerocalc(x);
     signcalc(x);
 }
 
-static void iny() {  // 0xc8
+static HOTPATH void iny() {  // 0xc8
     y++;
    
     zerocalc(y);
     signcalc(y);
 }
 
-static void jmp_abso() {  // 0xc4
+static HOTPATH void jmp_abso() {  // 0xc4
     ABSO;
     pc = ea;
 }
@@ -1083,13 +1163,13 @@ static void jmp_ind() {  // 0xc6
     pc = ea;
 }
 
-static void jsr_abso() {  // 0x20
+static HOTPATH void jsr_abso() {  // 0x20
     ABSO;
     push16(pc - 1);
     pc = ea;
 }
 
-static void lda_abso() {  // 0xad
+static HOTPATH void lda_abso() {  // 0xad
     ABSO;
     uint8_t value = GETVALUE;
     a = (uint8_t)(value & 0x00FF);
@@ -1098,7 +1178,7 @@ static void lda_abso() {  // 0xad
     signcalc(a);
 }
 
-static void lda_absx() {  // 0xbd
+static HOTPATH void lda_absx() {  // 0xbd
     ABSX;
     uint8_t value = GETVALUE;
     a = (uint8_t)(value & 0x00FF);
@@ -1107,7 +1187,7 @@ static void lda_absx() {  // 0xbd
     signcalc(a);
 }
 
-static void lda_absy() {  // 0xb9
+static HOTPATH void lda_absy() {  // 0xb9
     ABSY;
     uint8_t value = GETVALUE;
     a = (uint8_t)(value & 0x00FF);
@@ -1116,9 +1196,9 @@ static void lda_absy() {  // 0xb9
     signcalc(a);
 }
 
-static void lda_imm() {  // 0xa9
+static HOTPATH void lda_imm() {  // 0xa9
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     a = (uint8_t)(value & 0x00FF);
    
     zerocalc(a);
@@ -1134,7 +1214,7 @@ static void lda_indx() {  // 0xa1
     signcalc(a);
 }
 
-static void lda_indy() {  // 0xb1
+static HOTPATH void lda_indy() {  // 0xb1
     INDY;
     uint8_t value = GETVALUE;
     a = (uint8_t)(value & 0x00FF);
@@ -1143,18 +1223,18 @@ static void lda_indy() {  // 0xb1
     signcalc(a);
 }
 
-static void lda_zp() {  // 0xa5
+static HOTPATH void lda_zp() {  // 0xa5
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     a = (uint8_t)(value & 0x00FF);
    
     zerocalc(a);
     signcalc(a);
 }
 
-static void lda_zpx() {  // 0xb5
+static HOTPATH void lda_zpx() {  // 0xb5
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     a = (uint8_t)(value & 0x00FF);
    
     zerocalc(a);
@@ -1179,18 +1259,18 @@ static void ldx_absy() {  // 0xbe
     signcalc(x);
 }
 
-static void ldx_imm() {  // 0xa2
+static HOTPATH void ldx_imm() {  // 0xa2
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     x = (uint8_t)(value & 0x00FF);
    
     zerocalc(x);
     signcalc(x);
 }
 
-static void ldx_zp() {  // 0xa6
+static HOTPATH void ldx_zp() {  // 0xa6
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     x = (uint8_t)(value & 0x00FF);
    
     zerocalc(x);
@@ -1199,7 +1279,7 @@ static void ldx_zp() {  // 0xa6
 
 static void ldx_zpx() {  // 0xb6
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     x = (uint8_t)(value & 0x00FF);
    
     zerocalc(x);
@@ -1224,18 +1304,18 @@ static void ldy_absx() {  // 0xbc
     signcalc(y);
 }
 
-static void ldy_imm() {  // 0xa0
+static HOTPATH void ldy_imm() {  // 0xa0
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     y = (uint8_t)(value & 0x00FF);
    
     zerocalc(y);
     signcalc(y);
 }
 
-static void ldy_zp() {  // 0xa4
+static HOTPATH void ldy_zp() {  // 0xa4
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     y = (uint8_t)(value & 0x00FF);
    
     zerocalc(y);
@@ -1244,7 +1324,7 @@ static void ldy_zp() {  // 0xa4
 
 static void ldy_zpx() {  // 0xb4
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     y = (uint8_t)(value & 0x00FF);
    
     zerocalc(y);
@@ -1277,7 +1357,7 @@ static void lsr_absx() {  // 0x5e
     PUTVALUE(result);
 }
 
-static void lsr_acc() {  // 0x4a
+static HOTPATH void lsr_acc() {  // 0x4a
     uint16_t result = a >> 1;
    
     if (a & 1) setcarry();
@@ -1290,7 +1370,7 @@ static void lsr_acc() {  // 0x4a
 
 static void lsr_zp() {  // 0x46
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = value >> 1;
    
     if (value & 1) setcarry();
@@ -1298,12 +1378,12 @@ static void lsr_zp() {  // 0x46
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
 static void lsr_zpx() {  // 0x56
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = value >> 1;
    
     if (value & 1) setcarry();
@@ -1311,7 +1391,7 @@ static void lsr_zpx() {  // 0x56
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
 static void nop() {
@@ -1382,9 +1462,9 @@ static void ora_absy() {  // 0x19
     SAVEACCUM(result);
 }
 
-static void ora_imm() {  // 0x09
+static HOTPATH void ora_imm() {  // 0x09
     IMM;
-    uint8_t value = GETVALUE;
+    uint8_t value = IMMVALUE;
     uint16_t result = (uint16_t)a | value;
    
     zerocalc(result);
@@ -1417,7 +1497,7 @@ static void ora_indy() {  // 0x02
 
 static void ora_zp() {  // 0x05
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a | value;
    
     zerocalc(result);
@@ -1428,7 +1508,7 @@ static void ora_zp() {  // 0x05
 
 static void ora_zpx() {  // 0x15
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (uint16_t)a | value;
    
     zerocalc(result);
@@ -1437,7 +1517,7 @@ static void ora_zpx() {  // 0x15
     SAVEACCUM(result);
 }
 
-static void pha() {  // 0x48
+static HOTPATH void pha() {  // 0x48
     push8(a);
 }
 
@@ -1445,7 +1525,7 @@ static void php() {  // 0x08
     push8(status | FLAG_BREAK);
 }
 
-static void pla() {  // 0x68
+static HOTPATH void pla() {  // 0x68
     a = pull8();
    
     zerocalc(a);
@@ -1454,9 +1534,10 @@ static void pla() {  // 0x68
 
 static void plp() {  // 0x28
     status = pull8();
+    if (!(status & FLAG_INTERRUPT)) irq_check = irq_pending;
 }
 
-static void rol_acc() {  // 0x2a
+static HOTPATH void rol_acc() {  // 0x2a
     uint16_t result = (a << 1) | (status & FLAG_CARRY);
    
     carrycalc(result);
@@ -1490,31 +1571,31 @@ static void rol_absx() {  // 0x3e
     PUTVALUE(result);
 }
 
-static void rol_zp() {  // 0x26
+static HOTPATH void rol_zp() {  // 0x26
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (value << 1) | (status & FLAG_CARRY);
    
     carrycalc(result);
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
 static void rol_zpx() {  // 0x36
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (value << 1) | (status & FLAG_CARRY);
    
     carrycalc(result);
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
-static void ror_acc() {  // 0x6a
+static HOTPATH void ror_acc() {  // 0x6a
     uint16_t result = (a >> 1) | ((status & FLAG_CARRY) << 7);
    
     if (a & 1) setcarry();
@@ -1553,7 +1634,7 @@ static void ror_absx() {  // 0x7e
 
 static void ror_zp() {  // 0x66
     ZP;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (value >> 1) | ((status & FLAG_CARRY) << 7);
    
     if (value & 1) setcarry();
@@ -1561,12 +1642,12 @@ static void ror_zp() {  // 0x66
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
 static void ror_zpx() {  // 0x76
     ZPX;
-    uint8_t value = GETVALUE;
+    uint8_t value = GETZP;
     uint16_t result = (value >> 1) | ((status & FLAG_CARRY) << 7);
    
     if (value & 1) setcarry();
@@ -1574,15 +1655,16 @@ static void ror_zpx() {  // 0x76
     zerocalc(result);
     signcalc(result);
    
-    PUTVALUE(result);
+    PUTZP(result);
 }
 
 static void rti() {  // 0x40
     status = pull8();
     pc = pull16();
+    if (!(status & FLAG_INTERRUPT)) irq_check = irq_pending;
 }
 
-static void rts() {  // 0x60
+static HOTPATH void rts() {  // 0x60
     pc = pull16() + 1;
 }
 
@@ -1670,9 +1752,9 @@ static void sbc_absy() {  // 0xf9
     SAVEACCUM(result);
 }
 
-static void sbc_imm() {  // 0xe9
+static HOTPATH void sbc_imm() {  // 0xe9
     IMM;
-    uint8_t value = 0x00ff ^ GETVALUE;
+    uint8_t value = 0x00ff ^ IMMVALUE;
     uint16_t result = (uint16_t)a + value + (uint16_t)(status & FLAG_CARRY);
    
     carrycalc(result);
@@ -1756,7 +1838,7 @@ static void sbc_indy() {  // 0xf1
 
 static void sbc_zp() {  // 0xe5
     ZP;
-    uint8_t value = 0x00ff ^ GETVALUE;
+    uint8_t value = 0x00ff ^ GETZP;
     uint16_t result = (uint16_t)a + value + (uint16_t)(status & FLAG_CARRY);
    
     carrycalc(result);
@@ -1784,7 +1866,7 @@ static void sbc_zp() {  // 0xe5
 
 static void sbc_zpx() {  // 0xf5
     ZPX;
-    uint8_t value = 0x00ff ^ GETVALUE;
+    uint8_t value = 0x00ff ^ GETZP;
     uint16_t result = (uint16_t)a + value + (uint16_t)(status & FLAG_CARRY);
    
     carrycalc(result);
@@ -1810,7 +1892,7 @@ static void sbc_zpx() {  // 0xf5
     SAVEACCUM(result);
 }
 
-static void sec() {  // 0x38
+static HOTPATH void sec() {  // 0x38
     setcarry();
 }
 
@@ -1822,17 +1904,17 @@ static void sei() {  // 0x78
     setinterrupt();
 }
 
-static void sta_abso() {  // 0x8d
+static HOTPATH void sta_abso() {  // 0x8d
     ABSO;
     PUTVALUE(a);
 }
 
-static void sta_absx() {  // 0x9d
+static HOTPATH void sta_absx() {  // 0x9d
     ABSXNP;
     PUTVALUE(a);
 }
 
-static void sta_absy() {  // 0x99
+static HOTPATH void sta_absy() {  // 0x99
     ABSYNP;
     PUTVALUE(a);
 }
@@ -1842,19 +1924,19 @@ static void sta_indx() {  // 0x81
     PUTVALUE(a);
 }
 
-static void sta_indy() {  // 0x91
+static HOTPATH void sta_indy() {  // 0x91
     INDYNP;
     PUTVALUE(a);
 }
 
-static void sta_zp() {  // 0x85
+static HOTPATH void sta_zp() {  // 0x85
     ZP;
-    PUTVALUE(a);
+    PUTZP(a);
 }
 
-static void sta_zpx() {  // 0x95
+static HOTPATH void sta_zpx() {  // 0x95
     ZPX;
-    PUTVALUE(a);
+    PUTZP(a);
 }
 
 static void stx_abso() {  // 0x8e
@@ -1862,14 +1944,14 @@ static void stx_abso() {  // 0x8e
     PUTVALUE(x);
 }
 
-static void stx_zp() {  // 0x86
+static HOTPATH void stx_zp() {  // 0x86
     ZP;
-    PUTVALUE(x);
+    PUTZP(x);
 }
 
 static void stx_zpx() {  // 0x96
     ZPX;
-    PUTVALUE(x);
+    PUTZP(x);
 }
 
 static void sty_abso() { // 0x8c
@@ -1877,24 +1959,24 @@ static void sty_abso() { // 0x8c
     PUTVALUE(y);
 }
 
-static void sty_zp() { // 0x84
+static HOTPATH void sty_zp() { // 0x84
     ZP;
-    PUTVALUE(y);
+    PUTZP(y);
 }
 
 static void sty_zpx() { // 0x94
     ZPX;
-    PUTVALUE(y);
+    PUTZP(y);
 }
 
-static void tax() {  // 0xaa
+static HOTPATH void tax() {  // 0xaa
     x = a;
    
     zerocalc(x);
     signcalc(x);
 }
 
-static void tay() {  // 0xa8
+static HOTPATH void tay() {  // 0xa8
     y = a;
    
     zerocalc(y);
@@ -1908,7 +1990,7 @@ static void tsx() {  // 0xba
     signcalc(x);
 }
 
-static void txa() {  // 0x8a
+static HOTPATH void txa() {  // 0x8a
     a = x;
    
     zerocalc(a);
@@ -1919,7 +2001,7 @@ static void txs() {  // 0x9a
     sp = x;
 }
 
-static void tya() {  // 0x98
+static HOTPATH void tya() {  // 0x98
     a = y;
    
     zerocalc(a);
@@ -1980,7 +2062,7 @@ static void tya() {  // 0x98
 
     static void lax_zp() { //  0xa7
         ZP;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         a = (uint8_t)(value & 0x00FF);
         x = (uint8_t)(value & 0x00FF);
    
@@ -1990,7 +2072,7 @@ static void tya() {  // 0x98
 
     static void lax_zpx() { //  0xb7
         ZPX;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         a = (uint8_t)(value & 0x00FF);
         x = (uint8_t)(value & 0x00FF);
    
@@ -2010,12 +2092,12 @@ static void tya() {  // 0x98
 
     static void sax_zp() {  // 0x87
         ZP;
-        PUTVALUE(a & x);
+        PUTZP(a & x);
     }
 
     static void sax_zpx() {  // 0x97
         ZPX;
-        PUTVALUE(a & x);
+        PUTZP(a & x);
     }
 
     static void dcp_abso() {  // 0xcf
@@ -2090,9 +2172,9 @@ static void tya() {  // 0x98
 
     static void dcp_zp() {  // 0xc7
         ZP;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = value - 1;
-        PUTVALUE(result);
+        PUTZP(result);
         result = (uint16_t)a - value;
    
         if (a >= (uint8_t)(value & 0x00FF)) setcarry();
@@ -2104,9 +2186,9 @@ static void tya() {  // 0x98
 
     static void dcp_zpx() {  // 0xd7
         ZPX;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = value - 1;
-        PUTVALUE(result);
+        PUTZP(result);
         result = (uint16_t)a - value;
    
         if (a >= (uint8_t)(value & 0x00FF)) setcarry();
@@ -2273,7 +2355,7 @@ static void tya() {  // 0x98
 
     static void isb_zp() {  // 0xe7
         ZP;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = value + 1;
    
         value = 0x00ff ^ value;
@@ -2304,7 +2386,7 @@ static void tya() {  // 0x98
 
     static void isb_zpx() {  // 0xf7
         ZPX;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = value + 1;
    
         value = 0x00ff ^ value;
@@ -2395,7 +2477,7 @@ static void tya() {  // 0x98
 
     static void slo_zp() {  // 0x07
         ZP;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = a | (value << 1);
 
         carrycalc(result);
@@ -2407,7 +2489,7 @@ static void tya() {  // 0x98
 
     static void slo_zpx() {  // 0x17
         ZPX;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = a | (value << 1);
 
         carrycalc(result);
@@ -2479,7 +2561,7 @@ static void tya() {  // 0x98
 
     static void rla_zp() {  // 0x27
         ZP;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = a & ((value << 1) | (status & FLAG_CARRY));
    
         carrycalc(result);
@@ -2491,7 +2573,7 @@ static void tya() {  // 0x98
 
     static void rla_zpx() {  // 0x37
         ZPX;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = a & ((value << 1) | (status & FLAG_CARRY));
    
         carrycalc(result);
@@ -2568,7 +2650,7 @@ static void tya() {  // 0x98
 
     static void sre_zp() {  // 0x47
         ZP;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = a ^ (value >> 1);
    
         if (value & 1) setcarry();
@@ -2581,7 +2663,7 @@ static void tya() {  // 0x98
 
     static void sre_zpx() {  // 0x57
         ZPX;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = a ^ (value >> 1);
    
         if (value & 1) setcarry();
@@ -2669,7 +2751,7 @@ static void tya() {  // 0x98
 
     static void rra_zp() {  // 0x67
         ZP;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = (value >> 1) | ((status & FLAG_CARRY) << 7);
    
         if (value & 1) setcarry();
@@ -2684,7 +2766,7 @@ static void tya() {  // 0x98
 
     static void rra_zpx() {  // 0x77
         ZPX;
-        uint8_t value = GETVALUE;
+        uint8_t value = GETZP;
         uint16_t result = (value >> 1) | ((status & FLAG_CARRY) << 7);
    
         if (value & 1) setcarry();
@@ -2740,26 +2822,707 @@ void nmi6502() {
 
 void irq6502() {
     push16(pc);
-    push8(status);
+    push8(status & ~FLAG_BREAK);
     status |= FLAG_INTERRUPT;
     pc = (uint16_t)read6502(0xFFFE) | ((uint16_t)read6502(0xFFFF) << 8);
+    clockticks6502 += 7;
 }
 
-uint8_t callexternal = 0;
-void (*loopexternal)();
+uint8_t irq_pending;
+uint8_t irq_check;
+
+void irq_service() {
+    irq_check = 0;
+    if (irq_pending && !(status & FLAG_INTERRUPT)) {
+        irq6502();
+    }
+}
+
+#ifdef INSTRUCTION_TRACE
+// Tracing swaps in a table where every opcode goes through traced_op, so
+// there is nothing to check per instruction when it is off
+static void traced_op();
+static void (*tracetable[256])();
+static void (**opcodes)() = optable;
 
-void exec6502(uint32_t instrs) {
-    while (instrs-- > 0) {
-        uint8_t opcode = read6502(pc++);
+static void traced_op() {
+    uint8_t opcode = read6502(pc - 1);
+    trace_record(opcode);
+    (*optable[opcode])();
+}
 
-        (*optable[opcode])();
+void trace6502(int enable) {
+    if (enable) {
+        for (int i = 0; i < 256; i++) {
+            tracetable[i] = traced_op;
+        }
+        opcodes = tracetable;
+    } else {
+        opcodes = optable;
     }
+#ifdef BLOCK_CACHE
+    // The decoded blocks hold handler pointers from the old table
+    cache_flush();
+#endif
+}
+#else
+#define opcodes optable
+#endif
 
+#ifdef BLOCK_CACHE
+// Predecoded block cache. The first time execution reaches an address, the
+// straight run of instructions from there to the next branch, jump, call or
+// return is decoded into the arena, with each instruction's handler, operand
+// bytes and length, and the block goes into a small direct-mapped table.
+// After that, running the block is just a walk down the array.
+//
+// Blocks never cross a page boundary. Each page has a generation number
+// that CACHE_WRITE bumps when something writes to a page holding decoded
+// code, and a block decoded in an older generation is decoded again. When
+// the arena is full everything is thrown away and decoding starts over.
+
+#define DECODE_LAST 0x80    // in length, marks the last instruction of a block
+#define DECODE_LENGTH 0x0F  // in length, the bytes of code the entry covers
+#define DECODE_EXTRA 4      // in length, the shift for the number of instructions
+                            // a superinstruction covers after the first one
+#define BLOCK_MAX 16
+#define BLOCK_SLOTS 128
+#define NO_PC 0x10000
+
+typedef struct DECODED {
+    void (*handler)();
+    uint16_t operand;
+    uint8_t opcode;
+    uint8_t length;
+} DECODED;
+
+typedef struct BLOCK {
+    uint16_t start;
+    uint16_t generation;
+    DECODED *code;
+#ifdef JIT
+    int (*native)();    // the translated block, or NULL
+    uint32_t hits;      // how many times the block has been entered
+#endif
+} BLOCK;
+
+uint32_t code_pages[8] CCMBSS;
+static uint16_t page_generation[256] CCMBSS;
+static BLOCK block_table[BLOCK_SLOTS] CCMBSS;
+static DECODED decode_arena[BLOCK_CACHE_ENTRIES] CCMBSS;
+static uint32_t decode_used;
+
+// The next instruction in the current block, and the pc it is at
+static const DECODED *next_decoded;
+static uint32_t next_pc = NO_PC;
+
+// Code in the RIOT I/O pages and the RIOT RAM mirror at 9C00 is never
+// cached, it is decoded one instruction at a time into here
+static DECODED uncached;
+static BLOCK uncached_block = { .code = &uncached };
+
+#ifdef SUPERINSTRUCTIONS
+// Superinstructions. A few pairs and triples of instructions that show up
+// in the KIM-1 ROM's loops and shifts, and in the kind of loops people type
+// in, are run by a single handler. The handler goes in the decoded entry of
+// the first instruction, the entries for the rest are left in place so a
+// branch into the middle of the group still works. The dispatcher has run
+// the first opcode's pc++ and ticktable cycles, the handler does the rest
+// and moves next_decoded past the entries it covered.
+
+static uint8_t fusion = 1;
+
+static HOTPATH void dex_bne() {  // 0xca 0xd0
+    uint16_t reladdr = next_decoded->operand & 0xFF;
+    if (reladdr & 0x80) reladdr |= 0xFF00;
+
+    x--;
+    zerocalc(x);
+    signcalc(x);
+    pc += 2;
+    clockticks6502 += ticktable[0xD0];
+    next_decoded++;
+    if ((status & FLAG_ZERO) == 0) {
+        BRANCH;
+    }
 }
 
-void step6502() {
-    uint8_t opcode = read6502(pc++);
-    (*optable[opcode])();
+static HOTPATH void dey_bne() {  // 0x88 0xd0
+    uint16_t reladdr = next_decoded->operand & 0xFF;
+    if (reladdr & 0x80) reladdr |= 0xFF00;
+
+    y--;
+    zerocalc(y);
+    signcalc(y);
+    pc += 2;
+    clockticks6502 += ticktable[0xD0];
+    next_decoded++;
+    if ((status & FLAG_ZERO) == 0) {
+        BRANCH;
+    }
+}
+
+static HOTPATH void inx_cpx_bne() {  // 0xe8 0xe0 0xd0
+    uint8_t value = next_decoded[0].operand;
+    uint16_t reladdr = next_decoded[1].operand & 0xFF;
+    if (reladdr & 0x80) reladdr |= 0xFF00;
+
+    x++;
+    if (x >= value) setcarry();
+        else clearcarry();
+    if (x == value) setzero();
+        else clearzero();
+    signcalc((uint16_t)x - value);
+    pc += 4;
+    clockticks6502 += ticktable[0xE0] + ticktable[0xD0];
+    next_decoded += 2;
+    if ((status & FLAG_ZERO) == 0) {
+        BRANCH;
+    }
+}
+
+static HOTPATH void iny_cpy_bne() {  // 0xc8 0xc0 0xd0
+    uint8_t value = next_decoded[0].operand;
+    uint16_t reladdr = next_decoded[1].operand & 0xFF;
+    if (reladdr & 0x80) reladdr |= 0xFF00;
+
+    y++;
+    if (y >= value) setcarry();
+        else clearcarry();
+    if (y == value) setzero();
+        else clearzero();
+    signcalc((uint16_t)y - value);
+    pc += 4;
+    clockticks6502 += ticktable[0xC0] + ticktable[0xD0];
+    next_decoded += 2;
+    if ((status & FLAG_ZERO) == 0) {
+        BRANCH;
+    }
+}
+
+static HOTPATH void lda_zp_sta_abso() {  // 0xa5 0x8d
+    uint16_t ea = next_decoded->operand;
+
+    a = ZPREAD(operand & 0xFF);
+    zerocalc(a);
+    signcalc(a);
+    pc += 4;
+    next_decoded++;
+    // The store has to see the cycle count a device would see without the
+    // fusion, after the LDA's cycles and before its own. execute adds the
+    // LDA's once this returns.
+    clockticks6502 += ticktable[0xA5];
+    bus_write(ea, a);
+    clockticks6502 += ticktable[0x8D] - ticktable[0xA5];
+}
+
+static HOTPATH void lda_zp_sta_zp() {  // 0xa5 0x85
+    uint16_t ea = next_decoded->operand & 0xFF;
+
+    a = ZPREAD(operand & 0xFF);
+    zerocalc(a);
+    signcalc(a);
+    pc += 3;
+    clockticks6502 += ticktable[0x85];
+    next_decoded++;
+    ZPWRITE(ea, a);
+}
+
+static HOTPATH void asl_acc_asl_acc() {  // 0x0a 0x0a
+    uint16_t result = (uint16_t)a << 2;
+
+    if (a & 0x40) setcarry();
+        else clearcarry();
+    zerocalc(result);
+    signcalc(result);
+    SAVEACCUM(result);
+    pc++;
+    clockticks6502 += ticktable[0x0A];
+    next_decoded++;
+}
+
+static HOTPATH void rol_zp_rol_zp() {  // 0x26 0x26
+    uint16_t ea = operand & 0xFF;
+    uint16_t ea2 = next_decoded->operand & 0xFF;
+    uint16_t result = (ZPREAD(ea) << 1) | (status & FLAG_CARRY);
+
+    ZPWRITE(ea, result & 0xFF);
+    result = (ZPREAD(ea2) << 1) | (result >> 8);
+    carrycalc(result);
+    zerocalc(result);
+    signcalc(result);
+    ZPWRITE(ea2, result & 0xFF);
+    pc += 3;
+    clockticks6502 += ticktable[0x26];
+    next_decoded++;
+}
+
+typedef struct FUSION {
+    uint8_t count;
+    uint8_t opcode[3];
+    void (*handler)();
+} FUSION;
+
+static const FUSION fusions[] = {
+    { 2, { 0xCA, 0xD0 }, dex_bne },
+    { 2, { 0x88, 0xD0 }, dey_bne },
+    { 3, { 0xE8, 0xE0, 0xD0 }, inx_cpx_bne },
+    { 3, { 0xC8, 0xC0, 0xD0 }, iny_cpy_bne },
+    { 2, { 0xA5, 0x8D }, lda_zp_sta_abso },
+    { 2, { 0xA5, 0x85 }, lda_zp_sta_zp },
+    { 2, { 0x0A, 0x0A }, asl_acc_asl_acc },
+    { 2, { 0x26, 0x26 }, rol_zp_rol_zp },
+};
+
+// Replaces the groups in a freshly decoded block that match one of the
+// fusions with a superinstruction. A group isn't fused if main.c watches
+// the address of anything but its first instruction, since the pc would
+// never be seen there.
+static void fuse(DECODED *code, int count, uint16_t addr) {
+#ifdef INSTRUCTION_TRACE
+    if (opcodes != optable) return;
+#endif
+#ifndef OPCODE_PROFILE  // the profile counts every instruction on its own
+    if (!fusion) return;
+
+    for (int i = 0; i < count; ) {
+        DECODED *d = &code[i];
+        int len = d->length & DECODE_LENGTH;
+        const FUSION *f = NULL;
+
+        for (unsigned j = 0; j < sizeof(fusions) / sizeof(fusions[0]); j++) {
+            int k;
+            if (i + fusions[j].count > count) continue;
+            for (k = 0; k < fusions[j].count; k++) {
+                if (d[k].opcode != fusions[j].opcode[k]) break;
+            }
+            if (k == fusions[j].count) {
+                f = &fusions[j];
+                break;
+            }
+        }
+
+        if (f) {
+            uint16_t next = addr + len;
+            for (int k = 1; k < f->count; k++) {
+                if (watch6502(next)) {
+                    f = NULL;
+                    break;
+                }
+                len += d[k].length & DECODE_LENGTH;
+                next = addr + len;
+            }
+        }
+
+        if (f) {
+            d->handler = f->handler;
+            d->length = len | ((f->count - 1) << DECODE_EXTRA) | (d[f->count - 1].length & DECODE_LAST);
+            i += f->count;
+        } else {
+            i++;
+        }
+        addr += len;
+    }
+#endif
+}
+
+void fuse6502(int enable) {
+    if (fusion != enable) {
+        fusion = enable;
+        cache_flush();
+    }
+}
+
+#endif
+
+void cache_flush() {
+    for (int i = 0; i < 8; i++) {
+        code_pages[i] = 0;
+    }
+    for (int i = 0; i < BLOCK_SLOTS; i++) {
+        block_table[i].code = NULL;
+    }
+    decode_used = 0;
+    next_pc = NO_PC;
+#ifdef JIT
+    jit_reset();
+#endif
+}
+
+void cache_invalidate(uint8_t page) {
+    code_pages[page >> 5] &= ~(1UL << (page & 31));
+    page_generation[page]++;
+    next_pc = NO_PC;
+}
+
+static void decode(DECODED *d, uint16_t addr) {
+    uint8_t opcode = bus_read(addr);
+
+    d->handler = opcodes[opcode];
+    d->opcode = opcode;
+    d->length = oplength[opcode];
+    d->operand = 0;
+    if (d->length > 1) d->operand = bus_read(addr + 1);
+    if (d->length > 2) d->operand |= (uint16_t)bus_read(addr + 2) << 8;
+}
+
+static int ends_block(uint8_t opcode) {
+    return ((opcode & 0x1F) == 0x10) ||                    // branches
+        (opcode == 0x00) || (opcode == 0x20) || (opcode == 0x40) ||  // BRK, JSR, RTI
+        (opcode == 0x4C) || (opcode == 0x60) || (opcode == 0x6C);    // JMP, RTS, JMP ()
+}
+
+static BLOCK *decode_uncached(uint16_t addr) {
+    decode(&uncached, addr);
+    uncached.length |= DECODE_LAST;
+    return &uncached_block;
+}
+
+static HOTPATH BLOCK *block_lookup() {
+    uint16_t start = pc;
+    uint8_t page = start >> 8;
+    BLOCK *b = &block_table[(start ^ (start >> 7)) & (BLOCK_SLOTS - 1)];
+
+    if (b->code && (b->start == start) && (b->generation == page_generation[page])) {
+        return b;
+    }
+    if (((start >= 0x1700) && (start < 0x1780)) || ((start >= 0x9C00) && (start < 0xA000))) {
+        return decode_uncached(start);
+    }
+
+    if (decode_used + BLOCK_MAX > BLOCK_CACHE_ENTRIES) {
+        cache_flush();
+    }
+    DECODED *code = &decode_arena[decode_used];
+    DECODED *d = code;
+    uint16_t addr = start;
+    for (;;) {
+        decode(d, addr);
+        if ((addr & 0xFF) + d->length > 0x100) {
+            // The operand spills onto the next page, where a write wouldn't
+            // invalidate this block, so leave the instruction out
+            if (d == code) return decode_uncached(start);
+            d--;
+            break;
+        }
+        addr += d->length;
+        if (ends_block(d->opcode) || ((addr & 0xFF) == 0) || (d - code == BLOCK_MAX - 1)) break;
+        d++;
+    }
+    d->length |= DECODE_LAST;
+    decode_used += d - code + 1;
+#ifdef SUPERINSTRUCTIONS
+    fuse(code, d - code + 1, start);
+#endif
+
+    code_pages[page >> 5] |= 1UL << (page & 31);
+    b->start = start;
+    b->generation = page_generation[page];
+    b->code = code;
+#ifdef JIT
+    b->native = NULL;
+    b->hits = 0;
+#endif
+    return b;
+}
+#endif
+
+#ifdef ROM_TRANSLATE
+// The KIM-1 ROM, translated ahead of time by tools/romxlat into one function
+// per basic block. rom_blocks is indexed by address from 0x1800, and has
+// NULL where no block starts.
+#include "romblocks.inc"
+
+static uint8_t translation = 1;
+
+#if defined(OPCODE_PROFILE)
+#define TRANSLATING 0   // the profile wants to see every instruction
+#elif defined(INSTRUCTION_TRACE)
+#define TRANSLATING (translation && (opcodes == optable))
+#else
+#define TRANSLATING translation
+#endif
+
+void translate6502(int enable) {
+    translation = enable;
+}
+
+// Whether a translated block starts at address, for tools/hosttest's
+// rom_test, which checks each one against the interpreter
+int rom_translated(uint16_t address) {
+    return (address >= 0x1800) && (address < 0x2000) && (rom_blocks[address - 0x1800] != NULL);
+}
+#endif
+
+#ifdef JIT
+// Blocks of RAM code that are entered JIT_THRESHOLD times are translated
+// into Thumb-2 by jit.c, and from then on execute calls the translation
+// instead of walking the decoded block. The translation hangs off the
+// block, so the page generation check that throws away a block whose code
+// has been written to throws away its translation too.
+#define JIT_THRESHOLD 32
+
+static uint8_t jitting = 1;
+
+#if defined(OPCODE_PROFILE)
+#define JITTING 0   // the profile wants to see every instruction
+#elif defined(INSTRUCTION_TRACE)
+#define JITTING (jitting && (opcodes == optable))
+#else
+#define JITTING jitting
+#endif
+
+static JIT_BLOCK jit_block;
+
+static void jit_translate(BLOCK *b) {
+    if ((b == &uncached_block) || !jit_decode(&jit_block, b->start)) return;
+
+    b->native = jit_emit(&jit_block);
+    if (!b->native) {
+        // The code buffer is full, drop every translation and start over
+        for (int i = 0; i < BLOCK_SLOTS; i++) {
+            block_table[i].native = NULL;
+        }
+        jit_reset();
+        b->native = jit_emit(&jit_block);
+    }
+}
+
+void jit6502(int enable) {
+    jitting = enable;
+}
+#endif
+
+static inline int execute();
+
+#if defined(SUPERINSTRUCTIONS) || defined(JIT)
+// Power-on self checks. Each test program is run twice, with and without
+// the feature being checked, and the registers, cycle count, instruction
+// count and memory afterwards are compared. They are meant to be run before
+// there is anything in RAM worth keeping. Each program runs until pc gets
+// to the end of its code.
+typedef struct TEST_PROGRAM {
+    uint16_t origin;
+    uint8_t length;
+    uint8_t code[52];
+} TEST_PROGRAM;
+
+typedef struct TEST_STATE {
+    uint16_t pc;
+    uint8_t a, x, y, status, sp;
+    uint32_t cycles;
+    uint32_t instructions;
+    uint32_t checksum;
+} TEST_STATE;
+
+static void test_run(const TEST_PROGRAM *t, TEST_STATE *state) {
+    uint32_t start_cycles = clockticks6502;
+    uint16_t end = t->origin + t->length;
+
+    for (uint16_t addr = 0; addr < 0x400; addr++) {
+        write6502(addr, 0);
+    }
+    for (int i = 0; i < t->length; i++) {
+        write6502(t->origin + i, t->code[i]);
+    }
+    cache_flush();
+
+    pc = t->origin;
+    a = x = y = 0;
+    status = FLAG_CONSTANT;
+    sp = 0xFF;
+    state->instructions = 0;
+    while ((pc != end) && (state->instructions < 20000)) {
+        state->instructions += execute();
+    }
+
+    state->pc = pc;
+    state->a = a;
+    state->x = x;
+    state->y = y;
+    state->status = status;
+    state->sp = sp;
+    state->cycles = clockticks6502 - start_cycles;
+    state->checksum = 0;
+    for (uint16_t addr = 0; addr < 0x400; addr++) {
+        state->checksum = state->checksum * 31 + read6502(addr);
+        write6502(addr, 0);
+    }
+}
+
+static int test_differs(const TEST_STATE *s1, const TEST_STATE *s2) {
+    return (s1->pc != s2->pc) || (s1->a != s2->a) || (s1->x != s2->x) ||
+        (s1->y != s2->y) || (s1->status != s2->status) || (s1->sp != s2->sp) ||
+        (s1->cycles != s2->cycles) || (s1->instructions != s2->instructions) ||
+        (s1->checksum != s2->checksum);
+}
+#endif
+
+#ifdef SUPERINSTRUCTIONS
+// Short programs that use every superinstruction, including a branch
+// across a page and a fused store that changes the code right after it
+static const TEST_PROGRAM fuse_tests[] = {
+    { 0x0200, 10, { 0xA2, 0x05, 0xCA, 0xD0, 0xFD,               // LDX #5, DEX, BNE
+                    0xA0, 0x03, 0x88, 0xD0, 0xFD } },           // LDY #3, DEY, BNE
+    { 0x0200, 14, { 0xA0, 0x00, 0xC8, 0xC0, 0x10, 0xD0, 0xFB,   // LDY #0, INY, CPY #$10, BNE
+                    0xA2, 0xF0, 0xE8, 0xE0, 0xF8, 0xD0, 0xFB } }, // LDX #$F0, INX, CPX #$F8, BNE
+    { 0x0200, 24, { 0xA9, 0x5A, 0x85, 0x10,                     // LDA #$5A, STA $10
+                    0xA5, 0x10, 0x8D, 0x00, 0x03,               // LDA $10, STA $0300
+                    0xA5, 0x10, 0x85, 0x11,                     // LDA $10, STA $11
+                    0xA9, 0x33, 0x85, 0x12,                     // LDA #$33, STA $12
+                    0xA5, 0x12, 0x8D, 0x17, 0x02,               // LDA $12, STA $0217
+                    0xA9, 0x77 } },                             // LDA #$77, changed to #$33
+    { 0x0200, 19, { 0xA9, 0xC0, 0x85, 0x10,                     // LDA #$C0, STA $10
+                    0xA9, 0x81, 0x0A, 0x0A, 0x0A, 0x0A,         // LDA #$81, ASL x 4
+                    0x38, 0x26, 0x10, 0x26, 0x11,               // SEC, ROL $10, ROL $11
+                    0xA9, 0xA0, 0x0A, 0x0A } },                 // LDA #$A0, ASL x 2
+    { 0x02FB, 5, { 0xA2, 0x03, 0xCA, 0xD0, 0xFD } },           // DEX, BNE back across a page
+};
+
+// Runs each test with and without superinstructions. Returns 0 if
+// everything matched, or the number of the first test that didn't.
+// Superinstructions are left turned on.
+int fuse_check() {
+#ifdef JIT
+    uint8_t jitted = jitting;
+    jitting = 0;
+#endif
+    int failed = 0;
+
+    for (unsigned i = 0; i < sizeof(fuse_tests) / sizeof(fuse_tests[0]); i++) {
+        TEST_STATE plain, fused;
+
+        fuse6502(0);
+        test_run(&fuse_tests[i], &plain);
+        fuse6502(1);
+        test_run(&fuse_tests[i], &fused);
+        if (test_differs(&plain, &fused)) {
+            failed = i + 1;
+            break;
+        }
+    }
+    fuse6502(1);
+#ifdef JIT
+    jitting = jitted;
+#endif
+    return failed;
+}
+#endif
+
+#ifdef JIT
+// Loops that run long enough to be translated. The first uses every kind
+// of operation, the second branches both ways across a page, and in the
+// third a translated block is changed by a store from another page and
+// has to be thrown away.
+static const TEST_PROGRAM jit_tests[] = {
+    { 0x0200, 52, { 0xA2, 0x00,                                 // LDX #0
+                    0x8A, 0x18, 0x65, 0x10, 0x85, 0x10,         // TXA, CLC, ADC $10, STA $10
+                    0x49, 0xA5, 0x38, 0xE5, 0x11, 0x95, 0x20,   // EOR #$A5, SEC, SBC $11, STA $20,X
+                    0x2A, 0x85, 0x11, 0x6A, 0x4A, 0x0A,         // ROL, STA $11, ROR, LSR, ASL
+                    0x25, 0x10, 0x05, 0x12, 0x85, 0x12,         // AND $10, ORA $12, STA $12
+                    0xE6, 0x13, 0xD6, 0x20, 0xA4, 0x13,         // INC $13, DEC $20,X, LDY $13
+                    0xC0, 0x80, 0x98, 0xA8, 0xB5, 0x20,         // CPY #$80, TYA, TAY, LDA $20,X
+                    0xC5, 0x10, 0x8D, 0x00, 0x03,               // CMP $10, STA $0300
+                    0xAD, 0x00, 0x03, 0xE4, 0x12,               // LDA $0300, CPX $12
+                    0xCA, 0xD0, 0xCE } },                       // DEX, BNE
+    { 0x02F8, 12, { 0xA0, 0x00,                                 // LDY #0
+                    0xC8, 0x98, 0x29, 0x03, 0xD0, 0xFA,         // INY, TYA, AND #3, BNE
+                    0xC0, 0xF0, 0x90, 0xF6 } },                 // CPY #$F0, BCC
+    { 0x02E8, 36, { 0xA2, 0x40,                                 // LDX #$40
+                    0xE0, 0x10, 0xD0, 0x05,                     // CPX #$10, BNE
+                    0xA9, 0x07, 0x8D, 0x01, 0x03,               // LDA #7, STA $0301
+                    0x4C, 0x00, 0x03,                           // JMP $0300
+                    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                    0xA9, 0x01, 0x65, 0x10, 0x85, 0x10,         // $0300: LDA #1, ADC $10, STA $10
+                    0xCA, 0xF0, 0x03, 0x4C, 0xEA, 0x02 } },     // DEX, BEQ, JMP $02EA
+};
+
+// Runs each test with and without translation. Returns 0 if everything
+// matched, or the number of the first test that didn't. Translation is
+// left turned on.
+int jit_check() {
+    int failed = 0;
+
+    for (unsigned i = 0; i < sizeof(jit_tests) / sizeof(jit_tests[0]); i++) {
+        TEST_STATE plain, translated;
+
+        jitting = 0;
+        test_run(&jit_tests[i], &plain);
+        jitting = 1;
+        test_run(&jit_tests[i], &translated);
+        if (test_differs(&plain, &translated)) {
+            failed = i + 1;
+            break;
+        }
+    }
+    jitting = 1;
+    return failed;
+}
+#endif
+
+// Runs the instruction at pc and returns how many instructions that was,
+// which is more than one for a superinstruction or a translated ROM block
+static inline int execute() {
+#ifdef ROM_TRANSLATE
+    if (TRANSLATING && (pc >= 0x1800) && (pc < 0x2000)) {
+        int (*block)() = rom_blocks[pc - 0x1800];
+        if (block) return (*block)();
+    }
+#endif
+#ifdef BLOCK_CACHE
+    const DECODED *d;
+
+    if (pc == next_pc) {
+        d = next_decoded;
+    } else {
+        BLOCK *b = block_lookup();
+#ifdef JIT
+        if (JITTING) {
+            if (b->native) {
+                next_pc = NO_PC;
+                return (*b->native)();
+            }
+            if (++b->hits == JIT_THRESHOLD) jit_translate(b);
+        }
+#endif
+        d = b->code;
+    }
+
+    // Set up the next instruction before running this one, so that a write
+    // into the block from this instruction can cancel it
+    next_decoded = d + 1;
+    next_pc = (d->length & DECODE_LAST) ? NO_PC : pc + (d->length & DECODE_LENGTH);
+    operand = d->operand;
+    pc++;
+
+    PROFILE_START();
+    (*d->handler)();
+    PROFILE_END(d->opcode);
+    clockticks6502 += ticktable[d->opcode];
+    return 1 + ((d->length >> DECODE_EXTRA) & 3);
+#else
+    uint8_t opcode = bus_read(pc++);
+
+    PROFILE_START();
+    (*opcodes[opcode])();
+    PROFILE_END(opcode);
+    clockticks6502 += ticktable[opcode];
+    return 1;
+#endif
+}
+
+uint8_t callexternal = 0;
+void (*loopexternal)();
+
+HOTPATH void exec6502(uint32_t instrs) {
+    while (instrs > 0) {
+        uint32_t n = execute();
+        instrs = (n < instrs) ? instrs - n : 0;
+    }
+}
+
+HOTPATH int step6502() {
+    return execute();
 }
 
 void hookexternal(void *funcptr) {
@@ -0,0 +1,308 @@
+// The floating point unit, compiled in with FLOAT_ACCEL. Microsoft BASIC
+// spends most of its time in its floating point routines, shifting 4 byte
+// mantissas a bit at a time, where the Cortex-M4 can multiply them in one
+// go. The M4's FPU only has single precision, which is 8 bits short of
+// BASIC's mantissas, and the build uses soft float anyway, so this works
+// on the mantissas as integers and rounds the result itself.
+
+#include "main.h"
+#include "fake6502.h"
+#include "floataccel.h"
+
+#ifdef FLOAT_ACCEL
+
+// Where each part of a number is, from the start of the FAC or ARG
+#define FAC_ARG 8
+#define FAC_SIGN 5
+#define FAC_SGNCPR 14
+#define FAC_EXT 15
+
+// A number as mantissa / 2^64 * 2^(exponent - 128), the same as BASIC's
+// but with more bits of mantissa. A mantissa of 0 is 0.
+typedef struct NUMBER {
+    uint8_t sign;
+    int exponent;
+    uint64_t mantissa;
+} NUMBER;
+
+static uint8_t registers[FLOAT_REGISTERS];
+
+static uint16_t get16(int offset) {
+    return registers[offset] | (registers[offset + 1] << 8);
+}
+
+static uint16_t fac() {
+    return get16(FLOAT_FAC);
+}
+
+static uint32_t read32(uint16_t address) {
+    return ((uint32_t) read6502(address) << 24) | (read6502(address + 1) << 16) |
+            (read6502(address + 2) << 8) | read6502(address + 3);
+}
+
+static void write32(uint16_t address, uint32_t value) {
+    for (int i = 3; i >= 0; i--) {
+        write6502(address + i, value);
+        value >>= 8;
+    }
+}
+
+// Reads the FAC, or the ARG at FAC+8, which doesn't have a FACEXT
+static NUMBER get_number(uint16_t address, int ext) {
+    NUMBER n;
+    n.sign = read6502(address + FAC_SIGN) & 0x80;
+    n.exponent = read6502(address);
+    n.mantissa = n.exponent ? (uint64_t) read32(address + 1) << 32 : 0;
+    if (n.exponent && ext) {
+        n.mantissa |= (uint64_t) read6502(address + FAC_EXT) << 24;
+    }
+    return n;
+}
+
+static NUMBER get_packed(uint16_t address) {
+    NUMBER n;
+    uint32_t mantissa = read32(address + 1);
+    n.sign = mantissa >> 24 & 0x80;
+    n.exponent = read6502(address);
+    n.mantissa = n.exponent ? (uint64_t) (mantissa | 0x80000000UL) << 32 : 0;
+    return n;
+}
+
+static void put_fac(uint32_t mantissa, int exponent, uint8_t sign) {
+    write6502(fac(), exponent);
+    write32(fac() + 1, mantissa);
+    write6502(fac() + FAC_SIGN, sign ? 0xff : 0);
+    write6502(fac() + FAC_EXT, 0);
+}
+
+// Rounds n to the nearest 4 byte mantissa, ties to even, and puts it in the
+// FAC. Anything too small to hold is 0, the same as BASIC does.
+static int round_fac(NUMBER n) {
+    if (!n.mantissa) {
+        put_fac(0, 0, 0);
+        return 0;
+    }
+    int shift = __builtin_clzll(n.mantissa);
+    uint64_t m = n.mantissa << shift;
+    uint32_t mantissa = m >> 32;
+    uint32_t rest = m;
+    int exponent = n.exponent - shift;
+
+    if ((rest > 0x80000000UL) || ((rest == 0x80000000UL) && (mantissa & 1))) {
+        if (!++mantissa) {
+            mantissa = 0x80000000UL;
+            exponent++;
+        }
+    }
+    if (exponent > 255) return FLOAT_OVERFLOW;
+    if (exponent < 1) {
+        put_fac(0, 0, 0);
+    } else {
+        put_fac(mantissa, exponent, n.sign);
+    }
+    return 0;
+}
+
+// Shifts right, keeping a 1 at the bottom if anything was lost so that
+// rounding can still tell
+static uint64_t shift_sticky(uint64_t m, int shift) {
+    if (shift >= 64) return m != 0;
+    if (!shift) return m;
+    return (m >> shift) | ((m & ((1ULL << shift) - 1)) != 0);
+}
+
+static int add(NUMBER a, NUMBER b) {
+    if (!a.mantissa) return round_fac(b);
+    if (!b.mantissa) return round_fac(a);
+    if (b.exponent > a.exponent) {
+        NUMBER t = a;
+        a = b;
+        b = t;
+    }
+
+    // Halved so the sum can't overflow. Neither has anything in bit 0.
+    uint64_t ma = a.mantissa >> 1;
+    uint64_t mb = shift_sticky(b.mantissa >> 1, a.exponent - b.exponent);
+    NUMBER sum = { a.sign, a.exponent + 1, 0 };
+    if (a.sign == b.sign) {
+        sum.mantissa = ma + mb;
+    } else if (ma >= mb) {
+        sum.mantissa = ma - mb;
+    } else {
+        sum.mantissa = mb - ma;
+        sum.sign = b.sign;
+    }
+    return round_fac(sum);
+}
+
+// ARG has 4 bytes of mantissa and the FAC 5, so the product has 9, which
+// is done as two multiplies
+static int multiply(NUMBER a, NUMBER b) {
+    NUMBER product = { a.sign ^ b.sign, a.exponent + b.exponent - 128, 0 };
+    if (!a.mantissa || !b.mantissa) return round_fac(product);
+
+    uint32_t ma = a.mantissa >> 32;
+    uint64_t mb = b.mantissa >> 24;
+    uint64_t high = (uint64_t) ma * (uint32_t) (mb >> 8);
+    uint64_t low = (uint64_t) ma * (mb & 0xff);
+    product.mantissa = (high + (low >> 8)) | ((low & 0xff) != 0);
+    return round_fac(product);
+}
+
+// Long division, a bit at a time, enough bits to round with
+static int divide(NUMBER a, NUMBER b) {
+    NUMBER quotient = { a.sign ^ b.sign, a.exponent - b.exponent + 129, 0 };
+    if (!b.mantissa) return FLOAT_DIVZERO;
+    if (!a.mantissa) return round_fac(quotient);
+
+    uint64_t divisor = b.mantissa >> 24;
+    uint64_t remainder = (a.mantissa >> 32) << 8;
+    uint64_t q = 0;
+    for (int i = 0; i < 34; i++) {
+        q <<= 1;
+        if (remainder >= divisor) {
+            remainder -= divisor;
+            q |= 1;
+        }
+        remainder <<= 1;
+    }
+    quotient.mantissa = (q << 30) | (remainder != 0);
+    return round_fac(quotient);
+}
+
+// The FAC rounded with FACEXT the way BASIC does before storing it, by
+// adding half of the last bit
+static int fac_rounded(NUMBER *n) {
+    *n = get_number(fac(), 1);
+    uint32_t mantissa = n->mantissa >> 32;
+
+    if (n->exponent && (n->mantissa & 0x80000000UL) && !++mantissa) {
+        if (n->exponent == 255) return FLOAT_OVERFLOW;
+        mantissa = 0x80000000UL;
+        n->exponent++;
+    }
+    n->mantissa = (uint64_t) mantissa << 32;
+    return 0;
+}
+
+static uint8_t compare(NUMBER a, NUMBER b) {
+    if (!a.mantissa && !b.mantissa) return 0;
+    if (!a.mantissa) return b.sign ? 0x01 : 0xff;
+    if (!b.mantissa || (a.sign != b.sign)) return a.sign ? 0xff : 0x01;
+    if ((a.exponent == b.exponent) && (a.mantissa == b.mantissa)) return 0;
+    int bigger = (a.exponent > b.exponent) ||
+            ((a.exponent == b.exponent) && (a.mantissa > b.mantissa));
+    return bigger != !!a.sign ? 0x01 : 0xff;
+}
+
+static int to_int() {
+    NUMBER n = get_number(fac(), 1);
+    int32_t value = 0;
+
+    if (n.exponent > 128 + 31) {
+        if ((n.exponent != 128 + 32) || !n.sign || ((n.mantissa >> 32) != 0x80000000UL)) {
+            return FLOAT_OVERFLOW;
+        }
+        value = INT32_MIN;
+    } else if (n.exponent > 128) {
+        value = n.mantissa >> (64 - (n.exponent - 128));
+        if (n.sign) value = -value;
+    }
+    for (int i = 0; i < 4; i++) {
+        registers[FLOAT_INT + i] = (uint32_t) value >> (i * 8);
+    }
+    return 0;
+}
+
+static int from_int() {
+    int32_t value = registers[FLOAT_INT] | (registers[FLOAT_INT + 1] << 8) |
+            (registers[FLOAT_INT + 2] << 16) | ((uint32_t) registers[FLOAT_INT + 3] << 24);
+    NUMBER n = { value < 0 ? 0x80 : 0, 128 + 32, 0 };
+    n.mantissa = (uint64_t) (value < 0 ? -(uint32_t) value : (uint32_t) value) << 32;
+    return round_fac(n);
+}
+
+static int run(uint8_t command) {
+    uint16_t address = get16(FLOAT_ADDRESS);
+    NUMBER arg = get_number(fac() + FAC_ARG, 0);
+    NUMBER n;
+
+    switch (command) {
+    case FLOAT_ADD:
+        return add(arg, get_number(fac(), 1));
+    case FLOAT_SUB:
+        n = get_number(fac(), 1);
+        n.sign ^= 0x80;
+        return add(arg, n);
+    case FLOAT_MUL:
+        return multiply(arg, get_number(fac(), 1));
+    case FLOAT_DIV:
+        return divide(arg, get_number(fac(), 1));
+    case FLOAT_CMP:
+        if (fac_rounded(&n)) return FLOAT_OVERFLOW;
+        registers[FLOAT_COMPARE] = compare(n, get_packed(address));
+        return 0;
+    case FLOAT_LOAD_ARG:
+        // BASIC keeps ARG's sign, and SGNCPR, as the whole byte
+        n = get_packed(address);
+        write6502(fac() + FAC_ARG, n.exponent);
+        write32(fac() + FAC_ARG + 1, n.mantissa >> 32);
+        write6502(fac() + FAC_ARG + FAC_SIGN, read6502(address + 1));
+        write6502(fac() + FAC_SGNCPR, read6502(address + 1) ^ read6502(fac() + FAC_SIGN));
+        return 0;
+    case FLOAT_LOAD_FAC:
+        n = get_packed(address);
+        put_fac(n.mantissa >> 32, n.exponent, n.sign);
+        return 0;
+    case FLOAT_STORE:
+        if (fac_rounded(&n)) return FLOAT_OVERFLOW;
+        put_fac(n.mantissa >> 32, n.exponent, n.sign);
+        write6502(address, n.exponent);
+        write32(address + 1, (n.mantissa >> 32 & 0x7fffffffUL) | ((uint32_t) n.sign << 24));
+        return 0;
+    case FLOAT_FROM_INT:
+        return from_int();
+    case FLOAT_TO_INT:
+        return to_int();
+    default:
+        return FLOAT_BAD_COMMAND;
+    }
+}
+
+uint8_t float_read(uint16_t address) {
+    uint8_t offset = address & 0xff;
+    return offset < FLOAT_REGISTERS ? registers[offset] : 0;
+}
+
+void float_write(uint16_t address, uint8_t value) {
+    uint8_t offset = address & 0xff;
+    if (offset >= FLOAT_REGISTERS) return;
+    registers[offset] = value;
+    if (offset == FLOAT_COMMAND) {
+        registers[FLOAT_STATUS] = run(value);
+    }
+}
+
+void float_trap() {
+    uint8_t command = pc - FLOAT_TRAPS;
+    uint16_t error = get16(FLOAT_ERROR);
+
+    registers[FLOAT_ADDRESS] = a;
+    registers[FLOAT_ADDRESS + 1] = y;
+    float_write(FLOAT_COMMAND, command);
+    uint8_t result = registers[FLOAT_STATUS];
+
+    if ((result & (FLOAT_OVERFLOW | FLOAT_DIVZERO)) && error) {
+        x = registers[result & FLOAT_OVERFLOW ? FLOAT_OVERFLOW_CODE : FLOAT_DIVZERO_CODE];
+        pc = error;
+        return;
+    }
+
+    // Return the way BASIC's routines do, with the FAC's exponent in A, or
+    // for a compare the result
+    a = command == FLOAT_CMP ? registers[FLOAT_COMPARE] : read6502(fac());
+    status = (status & 0x7d) | (a & 0x80) | (a ? 0 : 0x02);
+    sp += 2;
+    pc = (read6502(0x100 + sp) << 8 | read6502(0x100 + ((sp - 1) & 0xff))) + 1;
+}
+#endif
@@ -0,0 +1,44 @@
+// The host services page, compiled in with HOST_SERVICES. Without it a
+// 6502 program can only time itself by counting RIOT timer underflows,
+// where the emulator already knows how many cycles and instructions it
+// has run. Reading the page doesn't change anything, so a program can
+// be timed in place without running any differently.
+
+#include "main.h"
+#include "fake6502.h"
+#include "host.h"
+
+#ifdef HOST_SERVICES
+
+uint32_t host_instructions;
+static uint32_t latched[3];
+
+static uint32_t counter(int n) {
+    switch (n) {
+    case 0:
+        return clockticks6502;
+    case 1:
+        return HAL_GetTick();
+    default:
+        return host_instructions;
+    }
+}
+
+uint8_t host_read(uint16_t address) {
+    uint8_t offset = address & 0xff;
+    if (offset < HOST_LATCH) {
+        return counter(offset >> 2) >> ((offset & 3) * 8);
+    } else if ((offset >= HOST_LATCHED) && (offset < HOST_REGISTERS)) {
+        return latched[(offset - HOST_LATCHED) >> 2] >> ((offset & 3) * 8);
+    }
+    return 0;
+}
+
+void host_write(uint16_t address, uint8_t value) {
+    if ((address & 0xff) == HOST_LATCH) {
+        for (int i = 0; i < 3; i++) {
+            latched[i] = counter(i);
+        }
+    }
+}
+#endif
@@ -0,0 +1,165 @@
+// Runs of 6502 memory as snapshots and the program library keep them in
+// flash. Records are copied straight into the arrays main.c keeps RAM in,
+// rather than a byte at a time through write6502.
+
+#include "main.h"
+#include "image.h"
+#include "dirty.h"
+#include "memmap.h"
+
+#if defined(SNAPSHOT) || defined(LIBRARY)
+
+// Supplied by main.c
+extern uint8_t RIOT002_RAM[64];
+extern uint8_t RIOT003_RAM[64];
+
+// Where each part of the 6502 address space that holds RAM lives. The zero
+// page and stack are always a separate area, so an image can be loaded
+// whether or not CCMRAM_ZEROPAGE is on.
+typedef struct AREA {
+    uint16_t address;
+    uint8_t *memory;
+    uint16_t size;
+} AREA;
+
+static const AREA areas[] = {
+#ifdef CCMRAM_ZEROPAGE
+    { 0x0000, ZP_RAM, 0x200 },
+#else
+    { 0x0000, RAM, 0x200 },
+#endif
+    { 0x0200, RAM + 0x200, 0xe00 },
+    { 0x1780, RIOT003_RAM, 64 },
+    { 0x17c0, RIOT002_RAM, 64 },
+    { EXPANSION_START, RAM + 0x1000, EXPANSION_SRAM_PAGES * 256 },
+#if EXPANSION_CCM_PAGES
+    { EXPANSION_SPLIT, CCM_RAM, EXPANSION_CCM_PAGES * 256 },
+#endif
+};
+
+#define AREAS (sizeof(areas) / sizeof(areas[0]))
+
+// Returns the area a record goes in, or NULL if it doesn't fit in one
+static const AREA *record_area(const IMAGE_RECORD *record) {
+    for (int i = 0; i < AREAS; i++) {
+        const AREA *area = &areas[i];
+        if ((record->address >= area->address) &&
+                (record->address + record->length <= area->address + area->size)) {
+            return area;
+        }
+    }
+    return NULL;
+}
+
+int image_check(const uint8_t *records, uint32_t length) {
+    const uint8_t *end = records + length;
+    IMAGE_RECORD record;
+
+    for (const uint8_t *p = records; p < end; ) {
+        if (end - p < sizeof(record)) return 1;
+        memcpy(&record, p, sizeof(record));
+        p += sizeof(record);
+        if ((record.packed > end - p) || !record_area(&record)) return 1;
+        if (record.encoding > IMAGE_LZ4) return 1;
+        if ((record.encoding == IMAGE_RAW) && (record.packed != record.length)) return 1;
+        p += (record.packed + 1) & ~1;
+    }
+    return 0;
+}
+
+int image_load(const uint8_t *records, uint32_t length) {
+    const uint8_t *end = records + length;
+    IMAGE_RECORD record;
+
+    for (const uint8_t *p = records; p < end; ) {
+        memcpy(&record, p, sizeof(record));
+        p += sizeof(record);
+        const AREA *area = record_area(&record);
+        uint8_t *memory = area->memory + (record.address - area->address);
+        if (record.encoding == IMAGE_LZ4) {
+            if (lz4_decompress(p, record.packed, memory, record.length)) return 1;
+        } else {
+            memcpy(memory, p, record.length);
+        }
+#ifdef DIRTY_PAGES
+        dirty_range(record.address, record.length);
+#endif
+        p += (record.packed + 1) & ~1;
+    }
+    return 0;
+}
+
+#ifdef SNAPSHOT
+static void put_bytes(LZ4_OUTPUT output, void *context, const void *data, uint32_t len) {
+    const uint8_t *p = data;
+    while (len--) {
+        (*output)(context, *p++);
+    }
+}
+
+static void save_run(LZ4_OUTPUT output, void *context, uint16_t address,
+        const uint8_t *memory, uint16_t length) {
+    IMAGE_RECORD record;
+
+    record.address = address;
+    record.length = length;
+    record.packed = lz4_compress(memory, length, NULL, NULL);
+    record.encoding = IMAGE_LZ4;
+    record.reserved = 0;
+    if (record.packed >= length) {
+        record.packed = length;
+        record.encoding = IMAGE_RAW;
+    }
+    put_bytes(output, context, &record, sizeof(record));
+    if (record.encoding == IMAGE_LZ4) {
+        lz4_compress(memory, length, output, context);
+    } else {
+        put_bytes(output, context, memory, length);
+    }
+    if (record.packed & 1) {
+        (*output)(context, 0);
+    }
+}
+
+static int all_zero(const uint8_t *p, uint32_t len) {
+    while (len--) {
+        if (*p++) return 0;
+    }
+    return 1;
+}
+
+// Whether a page, or all of a RIOT RAM, goes in the image
+static int wanted(const AREA *area, uint16_t offset, uint16_t page, int changed) {
+#ifdef DIRTY_PAGES
+    if (changed) return dirty_page((area->address + offset) >> 8) != 0;
+#endif
+    return !all_zero(area->memory + offset, page);
+}
+
+void image_save(LZ4_OUTPUT output, void *context, int changed) {
+    for (int i = 0; i < AREAS; i++) {
+        const AREA *area = &areas[i];
+        uint16_t page = area->size < 256 ? area->size : 256;
+        uint16_t offset = 0;
+        while (offset < area->size) {
+            if (!wanted(area, offset, page, changed)) {
+                offset += page;
+                continue;
+            }
+            uint16_t run = offset;
+            while (run < area->size && wanted(area, run, page, changed)) {
+                run += page;
+            }
+            save_run(output, context, area->address + offset, area->memory + offset, run - offset);
+            offset = run;
+        }
+    }
+}
+
+void image_clear() {
+    for (int i = 0; i < AREAS; i++) {
+        memset(areas[i].memory, 0, areas[i].size);
+    }
+}
+#endif
+#endif
@@ -0,0 +1,646 @@
+// Translation of hot 6502 code in RAM into Thumb-2, compiled in with JIT.
+// fake6502.c counts how often each cached block is entered and hands the
+// hot ones to jit_decode and jit_emit, then calls the result in place of
+// the interpreter until a write to the page throws the block away.
+//
+// The translated code keeps the 6502 registers where GLOBAL_REGISTERS puts
+// them, so it needs no glue on the way in or out. Only the flags some later
+// instruction or the code after the block could look at are worked out,
+// which is most of the saving over the handlers.
+
+#include "main.h"
+#include "fake6502.h"
+#include "jit.h"
+#include "memmap.h"
+
+#ifdef JIT
+
+#define FLAG_CARRY     0x01
+#define FLAG_ZERO      0x02
+#define FLAG_OVERFLOW  0x40
+#define FLAG_SIGN      0x80
+#define FLAGS_NZ       (FLAG_SIGN | FLAG_ZERO)
+#define FLAGS_ALL      (FLAG_SIGN | FLAG_OVERFLOW | FLAG_ZERO | FLAG_CARRY)
+
+typedef struct JIT_OPCODE {
+    uint8_t kind;
+    uint8_t reg;
+    uint8_t mode;
+    uint8_t src;    // the source register for JIT_MOVE
+} JIT_OPCODE;
+
+// The instructions that can be translated. 0xb6 and 0x96 are indexed by x
+// rather than y because that is what fake6502.c does with them.
+static const JIT_OPCODE jit_opcodes[256] = {
+    [0xA9] = { JIT_LOAD, JIT_A, JIT_IMMEDIATE }, [0xA5] = { JIT_LOAD, JIT_A, JIT_ZP },
+    [0xB5] = { JIT_LOAD, JIT_A, JIT_ZPX },       [0xAD] = { JIT_LOAD, JIT_A, JIT_ABSOLUTE },
+    [0xA2] = { JIT_LOAD, JIT_X, JIT_IMMEDIATE }, [0xA6] = { JIT_LOAD, JIT_X, JIT_ZP },
+    [0xB6] = { JIT_LOAD, JIT_X, JIT_ZPX },       [0xAE] = { JIT_LOAD, JIT_X, JIT_ABSOLUTE },
+    [0xA0] = { JIT_LOAD, JIT_Y, JIT_IMMEDIATE }, [0xA4] = { JIT_LOAD, JIT_Y, JIT_ZP },
+    [0xB4] = { JIT_LOAD, JIT_Y, JIT_ZPX },       [0xAC] = { JIT_LOAD, JIT_Y, JIT_ABSOLUTE },
+
+    [0x85] = { JIT_STORE, JIT_A, JIT_ZP }, [0x95] = { JIT_STORE, JIT_A, JIT_ZPX }, [0x8D] = { JIT_STORE, JIT_A, JIT_ABSOLUTE },
+    [0x86] = { JIT_STORE, JIT_X, JIT_ZP }, [0x96] = { JIT_STORE, JIT_X, JIT_ZPX }, [0x8E] = { JIT_STORE, JIT_X, JIT_ABSOLUTE },
+    [0x84] = { JIT_STORE, JIT_Y, JIT_ZP }, [0x94] = { JIT_STORE, JIT_Y, JIT_ZPX }, [0x8C] = { JIT_STORE, JIT_Y, JIT_ABSOLUTE },
+
+    [0xAA] = { JIT_MOVE, JIT_X, JIT_REGISTER, JIT_A }, [0xA8] = { JIT_MOVE, JIT_Y, JIT_REGISTER, JIT_A },
+    [0x8A] = { JIT_MOVE, JIT_A, JIT_REGISTER, JIT_X }, [0x98] = { JIT_MOVE, JIT_A, JIT_REGISTER, JIT_Y },
+
+    [0xE8] = { JIT_INC, JIT_X, JIT_REGISTER }, [0xC8] = { JIT_INC, JIT_Y, JIT_REGISTER },
+    [0xCA] = { JIT_DEC, JIT_X, JIT_REGISTER }, [0x88] = { JIT_DEC, JIT_Y, JIT_REGISTER },
+    [0xE6] = { JIT_INC, 0, JIT_ZP }, [0xF6] = { JIT_INC, 0, JIT_ZPX }, [0xEE] = { JIT_INC, 0, JIT_ABSOLUTE },
+    [0xC6] = { JIT_DEC, 0, JIT_ZP }, [0xD6] = { JIT_DEC, 0, JIT_ZPX }, [0xCE] = { JIT_DEC, 0, JIT_ABSOLUTE },
+
+    [0x0A] = { JIT_ASL, JIT_A, JIT_REGISTER }, [0x06] = { JIT_ASL, 0, JIT_ZP }, [0x16] = { JIT_ASL, 0, JIT_ZPX },
+    [0x4A] = { JIT_LSR, JIT_A, JIT_REGISTER }, [0x46] = { JIT_LSR, 0, JIT_ZP }, [0x56] = { JIT_LSR, 0, JIT_ZPX },
+    [0x2A] = { JIT_ROL, JIT_A, JIT_REGISTER }, [0x26] = { JIT_ROL, 0, JIT_ZP }, [0x36] = { JIT_ROL, 0, JIT_ZPX },
+    [0x6A] = { JIT_ROR, JIT_A, JIT_REGISTER }, [0x66] = { JIT_ROR, 0, JIT_ZP }, [0x76] = { JIT_ROR, 0, JIT_ZPX },
+
+    [0x29] = { JIT_AND, JIT_A, JIT_IMMEDIATE }, [0x25] = { JIT_AND, JIT_A, JIT_ZP },
+    [0x35] = { JIT_AND, JIT_A, JIT_ZPX },       [0x2D] = { JIT_AND, JIT_A, JIT_ABSOLUTE },
+    [0x09] = { JIT_ORA, JIT_A, JIT_IMMEDIATE }, [0x05] = { JIT_ORA, JIT_A, JIT_ZP },
+    [0x15] = { JIT_ORA, JIT_A, JIT_ZPX },       [0x0D] = { JIT_ORA, JIT_A, JIT_ABSOLUTE },
+    [0x49] = { JIT_EOR, JIT_A, JIT_IMMEDIATE }, [0x45] = { JIT_EOR, JIT_A, JIT_ZP },
+    [0x55] = { JIT_EOR, JIT_A, JIT_ZPX },       [0x4D] = { JIT_EOR, JIT_A, JIT_ABSOLUTE },
+    [0x69] = { JIT_ADC, JIT_A, JIT_IMMEDIATE }, [0x65] = { JIT_ADC, JIT_A, JIT_ZP },
+    [0x75] = { JIT_ADC, JIT_A, JIT_ZPX },       [0x6D] = { JIT_ADC, JIT_A, JIT_ABSOLUTE },
+    [0xE9] = { JIT_SBC, JIT_A, JIT_IMMEDIATE }, [0xE5] = { JIT_SBC, JIT_A, JIT_ZP },
+    [0xF5] = { JIT_SBC, JIT_A, JIT_ZPX },       [0xED] = { JIT_SBC, JIT_A, JIT_ABSOLUTE },
+    [0xC9] = { JIT_CMP, JIT_A, JIT_IMMEDIATE }, [0xC5] = { JIT_CMP, JIT_A, JIT_ZP },
+    [0xD5] = { JIT_CMP, JIT_A, JIT_ZPX },       [0xCD] = { JIT_CMP, JIT_A, JIT_ABSOLUTE },
+    [0xE0] = { JIT_CMP, JIT_X, JIT_IMMEDIATE }, [0xE4] = { JIT_CMP, JIT_X, JIT_ZP },
+    [0xEC] = { JIT_CMP, JIT_X, JIT_ABSOLUTE },
+    [0xC0] = { JIT_CMP, JIT_Y, JIT_IMMEDIATE }, [0xC4] = { JIT_CMP, JIT_Y, JIT_ZP },
+    [0xCC] = { JIT_CMP, JIT_Y, JIT_ABSOLUTE },
+
+    [0x18] = { JIT_CLC }, [0x38] = { JIT_SEC }, [0xEA] = { JIT_NOP },
+
+    [0x10] = { JIT_BRANCH }, [0x30] = { JIT_BRANCH }, [0x50] = { JIT_BRANCH }, [0x70] = { JIT_BRANCH },
+    [0x90] = { JIT_BRANCH }, [0xB0] = { JIT_BRANCH }, [0xD0] = { JIT_BRANCH }, [0xF0] = { JIT_BRANCH },
+    [0x4C] = { JIT_JUMP },
+};
+
+// The flags each kind of operation sets and reads
+static const uint8_t kind_sets[] = {
+    [JIT_LOAD] = FLAGS_NZ, [JIT_MOVE] = FLAGS_NZ,
+    [JIT_INC] = FLAGS_NZ, [JIT_DEC] = FLAGS_NZ,
+    [JIT_ASL] = FLAGS_NZ | FLAG_CARRY, [JIT_LSR] = FLAGS_NZ | FLAG_CARRY,
+    [JIT_ROL] = FLAGS_NZ | FLAG_CARRY, [JIT_ROR] = FLAGS_NZ | FLAG_CARRY,
+    [JIT_AND] = FLAGS_NZ, [JIT_ORA] = FLAGS_NZ, [JIT_EOR] = FLAGS_NZ,
+    [JIT_ADC] = FLAGS_ALL, [JIT_SBC] = FLAGS_ALL,
+    [JIT_CMP] = FLAGS_NZ | FLAG_CARRY,
+    [JIT_CLC] = FLAG_CARRY, [JIT_SEC] = FLAG_CARRY,
+    [JIT_JUMP] = 0,
+};
+
+static const uint8_t kind_reads[] = {
+    [JIT_ROL] = FLAG_CARRY, [JIT_ROR] = FLAG_CARRY,
+    [JIT_ADC] = FLAG_CARRY, [JIT_SBC] = FLAG_CARRY,
+    [JIT_JUMP] = 0,
+};
+
+// The flag each pair of branches tests, by the top two bits of the opcode
+static const uint8_t branch_flags[4] = { FLAG_SIGN, FLAG_OVERFLOW, FLAG_CARRY, FLAG_ZERO };
+
+// Only plain RAM is translated. Code in the zero page or the stack could
+// be changed by the zero page and stack writes a block makes without going
+// past the page check below.
+static int translatable(uint16_t addr) {
+    return (addr >= 0x0200) && page_table[addr >> 8];
+}
+
+// What a translated block can read and write: the RAM, the RIOT RAM and
+// the ROM, which don't care when they are looked at. Everything else, the
+// RIOT and VIA registers and the other devices at 1000-16FF, looks at
+// clockticks6502, which the translated code only brings up to date at the
+// end of the block.
+static int plain_memory(uint16_t addr) {
+    return read_table[addr >> 8] || ((addr >= 0x1780) && (addr < 0x1800));
+}
+
+static int writes_memory(uint8_t kind) {
+    return (kind == JIT_STORE) || ((kind >= JIT_INC) && (kind <= JIT_ROR));
+}
+
+// Works backwards through the block to find which flags each operation's
+// result can be seen in. Anything can look at the flags after the block.
+static void liveness(JIT_BLOCK *block) {
+    uint8_t live = FLAGS_ALL;
+
+    for (int i = block->count - 1; i >= 0; i--) {
+        JIT_OP *op = &block->op[i];
+
+        op->flags = kind_sets[op->kind] & live;
+        live = (live & ~kind_sets[op->kind]) | kind_reads[op->kind];
+    }
+}
+
+int jit_decode(JIT_BLOCK *block, uint16_t start) {
+    uint16_t addr = start;
+
+    block->start = start;
+    block->exit = JIT_NONE;
+    block->cycles = 0;
+    block->taken_cycles = 0;
+    block->instructions = 0;
+    block->count = 0;
+    if (!translatable(start)) return 0;
+
+    while (block->instructions < JIT_BLOCK_MAX) {
+        uint8_t opcode = read6502(addr);
+        const JIT_OPCODE *o = &jit_opcodes[opcode];
+        uint8_t length = oplength[opcode];
+        uint16_t arg = 0;
+
+        if (o->kind == JIT_NONE) break;
+        // The block has to stay on its page, which is the one a write
+        // invalidates it through
+        if (((addr >> 8) != (start >> 8)) || ((addr & 0xFF) + length > 0x100)) break;
+        if ((addr != start) && watch6502(addr)) break;
+        if (length > 1) arg = read6502(addr + 1);
+        if (length > 2) arg |= (uint16_t)read6502(addr + 2) << 8;
+        if (o->mode == JIT_ABSOLUTE) {
+            // A device has to see the cycle count as it is at the
+            // instruction, and a write to the block's own page would
+            // change code that is already running
+            if (!plain_memory(arg)) break;
+            if (writes_memory(o->kind) && ((arg >> 8) == (start >> 8))) break;
+        }
+
+        addr += length;
+        block->instructions++;
+        block->cycles += ticktable[opcode];
+        if (o->kind == JIT_BRANCH) {
+            block->exit = JIT_BRANCH;
+            block->branch_flag = branch_flags[opcode >> 6];
+            block->branch_set = opcode & 0x20;
+            block->target = addr + (int8_t)arg;
+            block->taken_cycles = ((addr ^ block->target) & 0xFF00) ? 2 : 1;
+            break;
+        }
+        if (o->kind == JIT_JUMP) {
+            block->exit = JIT_JUMP;
+            block->target = arg;
+            break;
+        }
+        if (o->kind == JIT_NOP) continue;
+
+        JIT_OP *op = &block->op[block->count++];
+        op->kind = o->kind;
+        op->reg = o->reg;
+        op->mode = o->mode;
+        op->arg = (o->kind == JIT_MOVE) ? o->src : arg;
+    }
+
+    block->next = addr;
+    liveness(block);
+    return block->instructions;
+}
+
+static uint8_t get_register(uint8_t reg) {
+    return (reg == JIT_A) ? a : (reg == JIT_X) ? x : y;
+}
+
+static void set_register(uint8_t reg, uint8_t value) {
+    if (reg == JIT_A) a = value;
+        else if (reg == JIT_X) x = value;
+        else y = value;
+}
+
+static void set_flags(uint8_t mask, uint8_t value) {
+    status = (status & ~mask) | (value & mask);
+}
+
+static void set_nz(uint8_t mask, uint8_t value) {
+    set_flags(mask & FLAGS_NZ, (value & FLAG_SIGN) | (value ? 0 : FLAG_ZERO));
+}
+
+int jit_interpret(const JIT_BLOCK *block) {
+    for (int i = 0; i < block->count; i++) {
+        const JIT_OP *op = &block->op[i];
+        uint16_t ea = op->arg;
+        uint16_t value = 0;
+        uint16_t result;
+
+        switch (op->mode) {
+        case JIT_REGISTER:
+            value = get_register(op->reg);
+            break;
+        case JIT_IMMEDIATE:
+            value = op->arg;
+            break;
+        case JIT_ZPX:
+            ea = (op->arg + x) & 0xFF;
+            // fall through
+        default:
+            if (op->kind != JIT_STORE) value = read6502(ea);
+            break;
+        }
+
+        switch (op->kind) {
+        case JIT_LOAD:
+            set_register(op->reg, value);
+            set_nz(op->flags, value);
+            break;
+        case JIT_STORE:
+            write6502(ea, get_register(op->reg));
+            break;
+        case JIT_MOVE:
+            value = get_register(op->arg);
+            set_register(op->reg, value);
+            set_nz(op->flags, value);
+            break;
+        case JIT_INC:
+        case JIT_DEC:
+        case JIT_ASL:
+        case JIT_LSR:
+        case JIT_ROL:
+        case JIT_ROR:
+            if (op->kind == JIT_INC) result = value + 1;
+                else if (op->kind == JIT_DEC) result = value - 1;
+                else if (op->kind == JIT_ASL) result = value << 1;
+                else if (op->kind == JIT_ROL) result = (value << 1) | (status & FLAG_CARRY);
+                else if (op->kind == JIT_LSR) result = (value >> 1) | ((value & 1) << 8);
+                else result = (value >> 1) | ((status & FLAG_CARRY) << 7) | ((value & 1) << 8);
+            if (op->kind >= JIT_ASL) set_flags(op->flags & FLAG_CARRY, result >> 8);
+            result &= 0xFF;
+            if (op->mode == JIT_REGISTER) set_register(op->reg, result);
+                else write6502(ea, result);
+            set_nz(op->flags, result);
+            break;
+        case JIT_AND:
+            a &= value;
+            set_nz(op->flags, a);
+            break;
+        case JIT_ORA:
+            a |= value;
+            set_nz(op->flags, a);
+            break;
+        case JIT_EOR:
+            a ^= value;
+            set_nz(op->flags, a);
+            break;
+        case JIT_ADC:
+        case JIT_SBC:
+            if (op->kind == JIT_SBC) value ^= 0xFF;
+            result = a + value + (status & FLAG_CARRY);
+            set_flags(op->flags & FLAG_CARRY, result >> 8);
+            set_flags(op->flags & FLAG_OVERFLOW, ((result ^ a) & (result ^ value)) >> 1);
+            a = result;
+            set_nz(op->flags, a);
+            break;
+        case JIT_CMP:
+            result = get_register(op->reg) - value;
+            set_flags(op->flags & FLAG_CARRY, (get_register(op->reg) >= value) ? FLAG_CARRY : 0);
+            set_nz(op->flags, result);
+            break;
+        case JIT_CLC:
+            set_flags(op->flags, 0);
+            break;
+        case JIT_SEC:
+            set_flags(op->flags, FLAG_CARRY);
+            break;
+        }
+    }
+
+    clockticks6502 += block->cycles;
+    pc = (block->exit == JIT_JUMP) ? block->target : block->next;
+    if ((block->exit == JIT_BRANCH) && (((status & block->branch_flag) != 0) == (block->branch_set != 0))) {
+        pc = block->target;
+        clockticks6502 += block->taken_cycles;
+    }
+    return block->instructions;
+}
+
+// Thumb-2 code emission. Everything is done in r0-r4, r0-r3 being free
+// across the calls to read6502 and write6502 and r4 saved on entry.
+
+uint16_t jit_buffer[JIT_BUFFER_SIZE / 2] __attribute__((aligned(4)));
+uint32_t jit_used;  // in halfwords
+
+static uint16_t *out;
+
+// The most halfwords any one operation takes, and the entry and exit code
+#define OP_SPACE 48
+#define FRAME_SPACE 40
+
+// Data processing opcodes, the same in the immediate and register forms
+#define DP_AND 0x0
+#define DP_BIC 0x1
+#define DP_ORR 0x2
+#define DP_EOR 0x4
+#define DP_ADD 0x8
+#define DP_SUB 0xD
+
+#define SHIFT_LSL 0
+#define SHIFT_LSR 1
+
+#define COND_EQ 0x0
+#define COND_NE 0x1
+
+#define REG_PC 15
+#define REGISTER(reg) (7 + (reg))
+
+static void emit16(uint16_t half) {
+    *out++ = half;
+}
+
+static void emit32(uint16_t first, uint16_t second) {
+    out[0] = first;
+    out[1] = second;
+    out += 2;
+}
+
+// MOV rd, rm, for any registers
+static void emit_mov(int rd, int rm) {
+    emit16(0x4600 | ((rd & 8) << 4) | (rm << 3) | (rd & 7));
+}
+
+// MOVS rd, #imm8, for r0-r7
+static void emit_movs(int rd, uint8_t imm) {
+    emit16(0x2000 | (rd << 8) | imm);
+}
+
+static void emit_imm16(uint16_t first, int rd, uint16_t imm) {
+    emit32(first | ((imm >> 1) & 0x0400) | (imm >> 12), ((imm << 4) & 0x7000) | (rd << 8) | (imm & 0xFF));
+}
+
+// MOVW rd, #imm16 and MOVT rd, #imm16
+static void emit_movw(int rd, uint16_t imm) {
+    emit_imm16(0xF240, rd, imm);
+}
+
+static void emit_movt(int rd, uint16_t imm) {
+    emit_imm16(0xF2C0, rd, imm);
+}
+
+// ADDW rd, rn, #imm12
+static void emit_addw(int rd, int rn, uint16_t imm) {
+    emit32(0xF200 | ((imm >> 1) & 0x0400) | rn, ((imm << 4) & 0x7000) | (rd << 8) | (imm & 0xFF));
+}
+
+// op.W rd, rn, #imm8, with an immediate that fits in the low byte
+static void emit_dp_imm(int op, int rd, int rn, uint8_t imm) {
+    emit32(0xF000 | (op << 5) | rn, (rd << 8) | imm);
+}
+
+// op.W rd, rn, rm, shift #amount. With rn as the pc, ORR is MOV.
+static void emit_dp_reg(int op, int rd, int rn, int rm, int shift, int amount) {
+    emit32(0xEA00 | (op << 5) | rn, ((amount & 0x1C) << 10) | (rd << 8) | ((amount & 3) << 6) | (shift << 4) | rm);
+}
+
+// TST.W rn, #imm8
+static void emit_tst(int rn, uint8_t imm) {
+    emit32(0xF010 | rn, 0x0F00 | imm);
+}
+
+static void emit_clz(int rd, int rm) {
+    emit32(0xFAB0 | rm, 0xF080 | (rd << 8) | rm);
+}
+
+static void emit_uxtb(int rd, int rm) {
+    emit32(0xFA5F, 0xF080 | (rd << 8) | rm);
+}
+
+static void emit_call(void *function) {
+    uint32_t address = (uint32_t)(uintptr_t)function;
+
+    emit_movw(3, address & 0xFFFF);
+    emit_movt(3, address >> 16);
+    emit16(0x4798);     // BLX r3
+}
+
+// Forward branches are emitted empty and patched once the target is known
+static uint16_t *emit_forward() {
+    return out++;
+}
+
+static void patch_branch(uint16_t *branch, int cond) {
+    *branch = 0xD000 | (cond << 8) | ((out - branch - 2) & 0xFF);
+}
+
+static void patch_jump(uint16_t *branch) {
+    *branch = 0xE000 | ((out - branch - 2) & 0x7FF);
+}
+
+// Sets N and Z in r10 from the byte in rs, if they are wanted
+static void emit_nz(uint8_t flags, int rs) {
+    flags &= FLAGS_NZ;
+    if (!flags) return;
+
+    emit_dp_imm(DP_BIC, 10, 10, flags);
+    if (flags & FLAG_SIGN) {
+        emit_dp_imm(DP_AND, 2, rs, FLAG_SIGN);
+        emit_dp_reg(DP_ORR, 10, 10, 2, SHIFT_LSL, 0);
+    }
+    if (flags & FLAG_ZERO) {
+        // CLZ gives 32 only for zero
+        emit_clz(2, rs);
+        emit_dp_reg(DP_ORR, 2, REG_PC, 2, SHIFT_LSR, 5);
+        emit_dp_reg(DP_ORR, 10, 10, 2, SHIFT_LSL, 1);
+    }
+}
+
+// Sets C in r10 from bit 8 of rs
+static void emit_carry_out(uint8_t flags, int rs) {
+    if (!(flags & FLAG_CARRY)) return;
+    emit_dp_imm(DP_BIC, 10, 10, FLAG_CARRY);
+    emit_dp_reg(DP_ORR, 10, 10, rs, SHIFT_LSR, 8);
+}
+
+// Sets C in r10 from bit 0 of rs, using r2
+static void emit_carry_bit0(uint8_t flags, int rs) {
+    if (!(flags & FLAG_CARRY)) return;
+    emit_dp_imm(DP_BIC, 10, 10, FLAG_CARRY);
+    emit_dp_imm(DP_AND, 2, rs, 1);
+    emit_dp_reg(DP_ORR, 10, 10, 2, SHIFT_LSL, 0);
+}
+
+// Puts the operand's address in r0
+static void emit_address(const JIT_OP *op) {
+    if (op->mode == JIT_ZP) {
+        emit_movs(0, op->arg);
+    } else if (op->mode == JIT_ZPX) {
+        emit_dp_imm(DP_ADD, 0, REGISTER(JIT_X), op->arg);
+        emit_dp_imm(DP_AND, 0, 0, 0xFF);
+    } else {
+        emit_movw(0, op->arg);
+    }
+}
+
+// Puts the operand's value in r0
+static void emit_value(const JIT_OP *op) {
+    if (op->mode == JIT_IMMEDIATE) {
+        emit_movs(0, op->arg);
+    } else {
+        emit_address(op);
+        emit_call(read6502);
+    }
+}
+
+static void emit_op(const JIT_OP *op) {
+    int reg = REGISTER(op->reg);
+
+    switch (op->kind) {
+    case JIT_LOAD:
+        emit_value(op);
+        emit_mov(reg, 0);
+        emit_nz(op->flags, reg);
+        break;
+    case JIT_STORE:
+        emit_address(op);
+        emit_mov(1, reg);
+        emit_call(write6502);
+        break;
+    case JIT_MOVE:
+        emit_mov(reg, REGISTER(op->arg));
+        emit_nz(op->flags, reg);
+        break;
+    case JIT_INC:
+    case JIT_DEC:
+    case JIT_ASL:
+    case JIT_LSR:
+    case JIT_ROL:
+    case JIT_ROR:
+        // The old value goes in r0 and the new one in r1
+        if (op->mode == JIT_REGISTER) {
+            emit_mov(0, reg);
+        } else {
+            emit_address(op);
+            emit_mov(4, 0);
+            emit_call(read6502);
+        }
+        switch (op->kind) {
+        case JIT_INC:
+            emit_dp_imm(DP_ADD, 1, 0, 1);
+            break;
+        case JIT_DEC:
+            emit_dp_imm(DP_SUB, 1, 0, 1);
+            break;
+        case JIT_ASL:
+            emit_dp_reg(DP_ORR, 1, REG_PC, 0, SHIFT_LSL, 1);
+            emit_carry_out(op->flags, 1);
+            break;
+        case JIT_ROL:
+            emit_dp_imm(DP_AND, 1, 10, FLAG_CARRY);
+            emit_dp_reg(DP_ORR, 1, 1, 0, SHIFT_LSL, 1);
+            emit_carry_out(op->flags, 1);
+            break;
+        case JIT_LSR:
+            emit_carry_bit0(op->flags, 0);
+            emit_dp_reg(DP_ORR, 1, REG_PC, 0, SHIFT_LSR, 1);
+            break;
+        case JIT_ROR:
+            emit_dp_imm(DP_AND, 1, 10, FLAG_CARRY);
+            emit_dp_reg(DP_ORR, 1, REG_PC, 1, SHIFT_LSL, 7);
+            emit_dp_reg(DP_ORR, 1, 1, 0, SHIFT_LSR, 1);
+            emit_carry_bit0(op->flags, 0);
+            break;
+        }
+        emit_dp_imm(DP_AND, 1, 1, 0xFF);
+        if (op->mode == JIT_REGISTER) {
+            emit_mov(reg, 1);
+            emit_nz(op->flags, reg);
+        } else {
+            emit_mov(0, 4);
+            emit_mov(4, 1);
+            emit_call(write6502);
+            emit_nz(op->flags, 4);
+        }
+        break;
+    case JIT_AND:
+    case JIT_ORA:
+    case JIT_EOR:
+        emit_value(op);
+        emit_dp_reg((op->kind == JIT_AND) ? DP_AND : (op->kind == JIT_ORA) ? DP_ORR : DP_EOR,
+                7, 7, 0, SHIFT_LSL, 0);
+        emit_nz(op->flags, 7);
+        break;
+    case JIT_ADC:
+    case JIT_SBC:
+        emit_value(op);
+        if (op->kind == JIT_SBC) emit_dp_imm(DP_EOR, 0, 0, 0xFF);
+        emit_dp_imm(DP_AND, 1, 10, FLAG_CARRY);
+        emit_dp_reg(DP_ADD, 1, 1, 7, SHIFT_LSL, 0);
+        emit_dp_reg(DP_ADD, 1, 1, 0, SHIFT_LSL, 0);
+        if (op->flags & FLAG_OVERFLOW) {
+            // V is bit 7 of (result ^ a) & (result ^ value)
+            emit_dp_reg(DP_EOR, 2, 1, 7, SHIFT_LSL, 0);
+            emit_dp_reg(DP_EOR, 3, 1, 0, SHIFT_LSL, 0);
+            emit_dp_reg(DP_AND, 2, 2, 3, SHIFT_LSL, 0);
+            emit_dp_imm(DP_AND, 2, 2, 0x80);
+            emit_dp_imm(DP_BIC, 10, 10, FLAG_OVERFLOW);
+            emit_dp_reg(DP_ORR, 10, 10, 2, SHIFT_LSR, 1);
+        }
+        emit_carry_out(op->flags, 1);
+        emit_dp_imm(DP_AND, 7, 1, 0xFF);
+        emit_nz(op->flags, 7);
+        break;
+    case JIT_CMP:
+        emit_value(op);
+        emit_dp_reg(DP_SUB, 1, reg, 0, SHIFT_LSL, 0);
+        if (op->flags & FLAG_CARRY) {
+            // Carry is set when nothing was borrowed, when bit 31 is clear
+            emit_dp_imm(DP_BIC, 10, 10, FLAG_CARRY);
+            emit_dp_reg(DP_ORR, 2, REG_PC, 1, SHIFT_LSR, 31);
+            emit_dp_imm(DP_EOR, 2, 2, 1);
+            emit_dp_reg(DP_ORR, 10, 10, 2, SHIFT_LSL, 0);
+        }
+        if (op->flags & FLAGS_NZ) {
+            emit_dp_imm(DP_AND, 1, 1, 0xFF);
+            emit_nz(op->flags, 1);
+        }
+        break;
+    case JIT_CLC:
+        if (op->flags) emit_dp_imm(DP_BIC, 10, 10, FLAG_CARRY);
+        break;
+    case JIT_SEC:
+        if (op->flags) emit_dp_imm(DP_ORR, 10, 10, FLAG_CARRY);
+        break;
+    }
+}
+
+int (*jit_emit(const JIT_BLOCK *block))() {
+    uint16_t *start = &jit_buffer[jit_used];
+    uint16_t *end = &jit_buffer[JIT_BUFFER_SIZE / 2];
+
+    if (start + FRAME_SPACE > end) return NULL;
+    out = start;
+    emit16(0xB510);     // PUSH {r4, lr}
+    // The compiler only keeps the low byte of the 6502 registers right
+    for (int reg = REGISTER(JIT_A); reg <= 10; reg++) {
+        emit_uxtb(reg, reg);
+    }
+
+    for (int i = 0; i < block->count; i++) {
+        if (out + OP_SPACE + FRAME_SPACE > end) return NULL;
+        emit_op(&block->op[i]);
+    }
+
+    if (block->cycles) emit_addw(5, 5, block->cycles);
+    if (block->exit == JIT_BRANCH) {
+        emit_tst(10, block->branch_flag);
+        uint16_t *taken = emit_forward();
+        emit_movw(6, block->next);
+        uint16_t *done = emit_forward();
+        patch_branch(taken, block->branch_set ? COND_NE : COND_EQ);
+        emit_movw(6, block->target);
+        emit_addw(5, 5, block->taken_cycles);
+        patch_jump(done);
+    } else {
+        emit_movw(6, (block->exit == JIT_JUMP) ? block->target : block->next);
+    }
+    emit_movs(0, block->instructions);
+    emit16(0xBD10);     // POP {r4, pc}
+
+    jit_used = out - jit_buffer;
+    __DSB();
+    __ISB();
+    return (int (*)())((uintptr_t)start | 1);
+}
+
+void jit_reset() {
+    jit_used = 0;
+}
+
+#endif
@@ -0,0 +1,39 @@
+// A library of programs kept in flash, compiled in with LIBRARY, so the
+// ones you use all the time can be loaded in a millisecond or two instead
+// of sending the paper tape again. tools/kimlib packs paper tapes and
+// binaries into a library image for stm32flash to write.
+
+#include "main.h"
+#include "fake6502.h"
+#include "image.h"
+#include "library.h"
+#include "storage.h"
+
+#ifdef LIBRARY
+
+const LIBRARY_PROGRAM *library_load(uint8_t number) {
+    const LIBRARY_HEADER *header = (const LIBRARY_HEADER *) LIBRARY_FLASH;
+    const LIBRARY_PROGRAM *program = (const LIBRARY_PROGRAM *) (header + 1);
+    uint32_t size = LIBRARY_FLASH_END - LIBRARY_FLASH;
+
+    if ((header->magic != LIBRARY_MAGIC) || (header->version != LIBRARY_VERSION) ||
+            (number >= header->count) ||
+            (sizeof(LIBRARY_HEADER) + header->count * sizeof(LIBRARY_PROGRAM) > size)) {
+        return NULL;
+    }
+    program += number;
+    if ((program->offset > size) || (program->length > size - program->offset)) {
+        return NULL;
+    }
+
+    const uint8_t *records = (const uint8_t *) LIBRARY_FLASH + program->offset;
+    if (image_check(records, program->length) || image_load(records, program->length)) {
+        return NULL;
+    }
+#ifdef BLOCK_CACHE
+    // The program may be going where some other code was decoded
+    cache_flush();
+#endif
+    return program;
+}
+#endif
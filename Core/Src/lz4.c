@@ -0,0 +1,138 @@
+// A small LZ4 block compressor and decompressor. Each sequence is a token
+// with the literal count in the high nibble and the match length minus 4 in
+// the low nibble, either of which is continued in extra bytes when it is 15,
+// then the literals, then the two byte little-endian offset of the match. The
+// last sequence is only literals. As the format requires, the last five
+// bytes are always literals and no match starts in the last twelve, so any
+// LZ4 decoder can read the output.
+
+#include "main.h"
+#include "lz4.h"
+
+#if defined(SNAPSHOT) || defined(LIBRARY) || defined(BANKED_RAM)
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+
+static uint16_t lz4_table[1 << LZ4_HASH_BITS];
+
+typedef struct LZ4_STREAM {
+    LZ4_OUTPUT output;
+    void *context;
+    uint32_t length;
+} LZ4_STREAM;
+
+static void put(LZ4_STREAM *stream, uint8_t b) {
+    if (stream->output) (*stream->output)(stream->context, b);
+    stream->length++;
+}
+
+// The bytes after a nibble of 15
+static void put_length(LZ4_STREAM *stream, uint32_t n) {
+    while (n >= 255) {
+        put(stream, 255);
+        n -= 255;
+    }
+    put(stream, n);
+}
+
+static void put_sequence(LZ4_STREAM *stream, const uint8_t *literals, uint32_t count,
+        uint32_t offset, uint32_t match) {
+    uint32_t extra = match ? match - MIN_MATCH : 0;
+
+    put(stream, ((count < 15 ? count : 15) << 4) | (extra < 15 ? extra : 15));
+    if (count >= 15) put_length(stream, count - 15);
+    for (uint32_t i = 0; i < count; i++) {
+        put(stream, literals[i]);
+    }
+    if (match) {
+        put(stream, offset);
+        put(stream, offset >> 8);
+        if (extra >= 15) put_length(stream, extra - 15);
+    }
+}
+
+static uint32_t hash(const uint8_t *p) {
+    uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+    return (uint32_t) (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+uint32_t lz4_compress(const uint8_t *src, uint32_t len, LZ4_OUTPUT output, void *context) {
+    LZ4_STREAM stream = { output, context, 0 };
+    uint32_t anchor = 0;
+    uint32_t i = 0;
+
+    memset(lz4_table, 0, sizeof(lz4_table));
+    if (len > MATCH_LIMIT) {
+        while (i < len - MATCH_LIMIT) {
+            uint32_t h = hash(src + i);
+            uint32_t candidate = lz4_table[h];
+            lz4_table[h] = i;
+
+            // The table only holds earlier positions, but a stale entry from
+            // a different sequence with the same hash still has to be checked
+            if (candidate < i && !memcmp(src + candidate, src + i, MIN_MATCH)) {
+                uint32_t match = MIN_MATCH;
+                uint32_t longest = len - LAST_LITERALS - i;
+                while (match < longest && src[candidate + match] == src[i + match]) {
+                    match++;
+                }
+                put_sequence(&stream, src + anchor, i - anchor, i - candidate, match);
+                i += match;
+                anchor = i;
+            } else {
+                i++;
+            }
+        }
+    }
+    put_sequence(&stream, src + anchor, len - anchor, 0, 0);
+    return stream.length;
+}
+
+int lz4_decompress(const uint8_t *src, uint32_t packed, uint8_t *dst, uint32_t len) {
+    const uint8_t *end = src + packed;
+    uint32_t out = 0;
+
+    while (src < end) {
+        uint8_t token = *src++;
+        uint32_t count = token >> 4;
+        if (count == 15) {
+            uint8_t b;
+            do {
+                if (src >= end) return 1;
+                b = *src++;
+                count += b;
+            } while (b == 255);
+        }
+        if (count > (uint32_t) (end - src) || count > len - out) return 1;
+        memcpy(dst + out, src, count);
+        src += count;
+        out += count;
+
+        // The last sequence stops after its literals
+        if (src == end) break;
+
+        if (end - src < 2) return 1;
+        uint32_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        uint32_t match = token & 15;
+        if (match == 15) {
+            uint8_t b;
+            do {
+                if (src >= end) return 1;
+                b = *src++;
+                match += b;
+            } while (b == 255);
+        }
+        match += MIN_MATCH;
+        if (offset == 0 || offset > out || match > len - out) return 1;
+
+        // Byte by byte, since a match can overlap what it is copying
+        for (uint32_t i = 0; i < match; i++, out++) {
+            dst[out] = dst[out - offset];
+        }
+    }
+    return out != len;
+}
+#endif
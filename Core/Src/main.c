@@ -22,6 +22,24 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "fake6502.h"
+#include "profile.h"
+#include "pcprofile.h"
+#include "trace.h"
+#include "benchmark.h"
+#include "idle.h"
+#include "dirty.h"
+#include "snapshot.h"
+#include "library.h"
+#include "tape.h"
+#include "coproc.h"
+#include "blockmove.h"
+#include "floataccel.h"
+#include "host.h"
+#include "irq.h"
+#include "via.h"
+#include "bank.h"
+#include "memmap.h"
 
 /* USER CODE END Includes */
 
@@ -41,6 +59,9 @@
 
 /* Private variables ---------------------------------------------------------*/
 UART_HandleTypeDef huart1;
+#ifdef PC_PROFILE
+TIM_HandleTypeDef htim2;
+#endif
 
 #define SPECIAL_CHECK_TIME 7500
 
@@ -52,6 +73,9 @@ UART_HandleTypeDef huart1;
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
 static void MX_USART1_UART_Init(void);
+#ifdef PC_PROFILE
+static void MX_TIM2_Init(void);
+#endif
 /* USER CODE BEGIN PFP */
 
 void keyMode();
@@ -99,24 +123,14 @@ uint16_t ledSelect_pin[7] = {
 		GPIO_PIN_5, GPIO_PIN_6, GPIO_PIN_14
 };
 
-uint8_t RAM[0x8000];
+uint8_t RAM[RAM_SIZE];
+#ifdef CCMRAM_ZEROPAGE
+// The zero page and stack live in CCM RAM instead of at the start of RAM
+uint8_t ZP_RAM[0x200] CCMBSS;
+#endif
 uint8_t RIOT002_RAM[64];
 uint8_t RIOT003_RAM[64];
 
-typedef struct TIMER {
-    uint32_t mult;
-    uint32_t tick_accum;
-    uint32_t start_value;
-    int32_t count;
-    uint32_t timeout;
-} TIMER;
-
-typedef struct RIOT {
-    uint8_t padd, sad;
-    uint8_t pbdd, sbd;
-    TIMER timer;
-} RIOT;
-
 struct RIOT riot003;
 struct RIOT riot002;
 
@@ -124,34 +138,21 @@ void riot002write(uint16_t, uint8_t);
 void riot003write(uint16_t, uint8_t);
 
 void reset_timer(TIMER *, int, uint8_t);
+void write_timer(TIMER *, uint16_t, uint8_t, uint32_t);
+void read_timer(TIMER *, uint16_t, uint32_t);
 void update_timer(TIMER *, uint32_t);
+#ifdef IDLE_SKIP
+int idle_loop(uint16_t);
+void idle_skip(TIMER *, int);
+void idle_wait(int);
+#endif
 
 int check_special();
+int check_escape(uint8_t);
 
 uint8_t sst_mode;
 uint8_t key_mode;
 
-extern const uint8_t RIOT002_ROM[1024];
-extern const uint8_t RIOT003_ROM[1024];
-
-#ifdef GLOBAL_REGISTERS
-register uint16_t pc asm ("r6");
-register uint8_t a asm ("r7");
-register uint8_t x asm ("r8");
-register uint8_t y asm ("r9");
-register uint8_t status asm ("r10");
-extern uint8_t sp;
-
-#else
-extern uint16_t pc;
-extern uint8_t sp, a, x, y, status;
-#endif
-
-extern void reset6502();
-extern void exec6502(uint32_t);
-extern void step6502();
-extern void nmi6502();
-
 uint8_t riot002read(uint16_t);
 uint8_t riot003read(uint16_t);
 
@@ -161,14 +162,13 @@ uint8_t serial_mode;
 int paper_tape_line_len;
 uint8_t paper_tape_line[1024];
 
-uint8_t read6502(uint16_t addr) {
-  if ((addr >= 0x1c00) && (addr < 0x2000)) {
-    return RIOT002_ROM[addr-0x1c00];
-  } else if (addr < 0x1000) {
-    return RAM[addr];
-  } else if ((addr >= 0x1800) && (addr < 0x1c00)) {
-    return RIOT003_ROM[addr-0x1800];
-  } else if ((addr >= 0x1780) && (addr < 0x17c0)) {
+HOTPATH uint8_t read6502(uint16_t addr) {
+  // All of the RAM but the RIOTs', and the ROM, is one look in the table,
+  // and everything left over is a device
+  if (RAM_DIRECT(addr)) return RAM[addr];
+  const uint8_t *page = read_table[addr >> 8];
+  if (page) return page[addr & 0xff];
+  if ((addr >= 0x1780) && (addr < 0x17c0)) {
     return RIOT003_RAM[addr-0x1780];
   } else if ((addr >= 0x17c0) && (addr < 0x1800)) {
     return RIOT002_RAM[addr-0x17c0];
@@ -177,20 +177,52 @@ uint8_t read6502(uint16_t addr) {
   } else if ((addr >= 0x1740) && (addr < 0x1780)) {
       return riot002read(addr);
   } else if ((addr >= 0x9c00) && (addr < 0xa000)) {
-      return RIOT002_RAM[addr - 0x9c00];
-  } else if (addr >= 0xff00) {
-      return RIOT002_ROM[addr - 0xfc00];
-  } else if ((addr >= 0x2000) && (addr <= 9000)) {
-      return RAM[addr-0x1000];
+      // Only 64 bytes, which repeat all the way through the mirror
+      return RIOT002_RAM[addr & 0x3f];
+#ifdef COPROCESSOR
+  } else if ((addr >> 8) == COPROC_PAGE) {
+      return coproc_read(addr);
+#endif
+#ifdef BLOCK_MOVE
+  } else if ((addr >> 8) == MOVE_PAGE) {
+      return move_read(addr);
+#endif
+#ifdef FLOAT_ACCEL
+  } else if ((addr >> 8) == FLOAT_PAGE) {
+      return float_read(addr);
+#endif
+#ifdef HOST_SERVICES
+  } else if ((addr >> 8) == HOST_PAGE) {
+      return host_read(addr);
+#endif
+#ifdef VIA
+  } else if ((addr & 0xfff0) == VIA_ADDRESS) {
+      return via_read(addr);
+#endif
+#ifdef BANKED_RAM
+  } else if ((addr & 0xf000) == BANK_WINDOW) {
+      return bank_window[addr - BANK_WINDOW];
+  } else if ((addr >> 8) == BANK_PAGE) {
+      return bank_read(addr);
+#endif
   } else {
       return 0;
   }
 }
 
-void write6502(uint16_t addr, uint8_t val) {
-  if (addr < 0x1000) {
+HOTPATH void write6502(uint16_t addr, uint8_t val) {
+  CACHE_WRITE(addr);
+  DIRTY_WRITE(addr);
+  if (RAM_DIRECT(addr)) {
     RAM[addr] = val;
-  } else if ((addr >= 0x1780) && (addr < 0x17c0)) {
+    return;
+  }
+  uint8_t *page = page_table[addr >> 8];
+  if (page) {
+    page[addr & 0xff] = val;
+    return;
+  }
+  if ((addr >= 0x1780) && (addr < 0x17c0)) {
     RIOT003_RAM[addr-0x1780] = val;
   } else if ((addr >= 0x17c0) && (addr < 0x1800)) {
     RIOT002_RAM[addr-0x17c0] = val;
@@ -198,9 +230,52 @@ void write6502(uint16_t addr, uint8_t val) {
       riot003write(addr, val);
   } else if ((addr >= 0x1740) && (addr < 0x1780)) {
       riot002write(addr, val);
-  } else if ((addr >= 0x2000) && (addr <= 9000)) {
-      RAM[addr - 0x1000] = val;
+#ifdef COPROCESSOR
+  } else if ((addr >> 8) == COPROC_PAGE) {
+      coproc_write(addr, val);
+#endif
+#ifdef BLOCK_MOVE
+  } else if ((addr >> 8) == MOVE_PAGE) {
+      move_write(addr, val);
+#endif
+#ifdef FLOAT_ACCEL
+  } else if ((addr >> 8) == FLOAT_PAGE) {
+      float_write(addr, val);
+#endif
+#ifdef HOST_SERVICES
+  } else if ((addr >> 8) == HOST_PAGE) {
+      host_write(addr, val);
+#endif
+#ifdef VIA
+  } else if ((addr & 0xfff0) == VIA_ADDRESS) {
+      via_write(addr, val);
+#endif
+#ifdef BANKED_RAM
+  } else if ((addr & 0xf000) == BANK_WINDOW) {
+      BANK_WRITE(addr, val);
+  } else if ((addr >> 8) == BANK_PAGE) {
+      bank_write(addr, val);
+#endif
+  }
+}
+
+uint8_t *span6502(uint16_t address, uint32_t length) {
+  uint32_t end = address + length;
+  // The pages in between are in the same array if the two ends are
+  if (length && (end <= 0x10000)) {
+    uint8_t *first = page_table[address >> 8];
+    uint8_t *last = page_table[(end - 1) >> 8];
+    if (first && last && ((uintptr_t) last - (uintptr_t) first ==
+            (((end - 1) >> 8) - (address >> 8)) << 8)) {
+      return first + (address & 0xff);
+    }
   }
+  if ((address >= 0x1780) && (end <= 0x17c0)) {
+    return RIOT003_RAM + (address - 0x1780);
+  } else if ((address >= 0x17c0) && (end <= 0x1800)) {
+    return RIOT002_RAM + (address - 0x17c0);
+  }
+  return NULL;
 }
 
 uint8_t riot003read(uint16_t address) {
@@ -213,6 +288,7 @@ uint8_t riot003read(uint16_t address) {
     } else if (address == 0x1703) {
         return riot003.pbdd;
     } else if ((address == 0x1706) || (address == 0x170e)) {
+        read_timer(&riot003.timer, address, IRQ_RIOT003);
         if (riot003.timer.timeout) {
             reset_timer(&riot003.timer, riot003.timer.mult, riot003.timer.start_value);
             riot003.timer.timeout = 0;
@@ -222,6 +298,12 @@ uint8_t riot003read(uint16_t address) {
             return riot003.timer.count;
         }
     } else if (address == 0x1707) {
+#ifdef IDLE_SKIP
+        if (!riot003.timer.timeout && riot003.timer.mult) {
+            int loop_instructions = idle_loop(address);
+            if (loop_instructions) idle_skip(&riot003.timer, loop_instructions);
+        }
+#endif
         if (riot003.timer.timeout) {
             return 0x80;
         } else {
@@ -236,6 +318,10 @@ uint8_t riot002read(uint16_t address) {
     uint8_t sv;
     int bits;
     if (address == 0x1740) {
+#ifdef IDLE_SKIP
+        int loop_instructions = idle_loop(address);
+        if (loop_instructions) idle_wait(loop_instructions);
+#endif
         sv = (riot002.sbd >> 1) & 0xf;
         // Return the correct key_bits if the current key depressed
         // belongs to the right scan row, otherwise 0xff, meaning
@@ -291,6 +377,7 @@ uint8_t riot002read(uint16_t address) {
     } else if (address == 0x1743) {
         return riot002.pbdd;
     } else if ((address == 0x1746) || (address == 0x174e)) {
+        read_timer(&riot002.timer, address, IRQ_RIOT002);
         if (riot002.timer.timeout) {
             reset_timer(&riot002.timer, riot002.timer.mult, riot002.timer.start_value);
             return 0;
@@ -298,6 +385,12 @@ uint8_t riot002read(uint16_t address) {
             return riot002.timer.count;
         }
     } else if (address == 0x1747) {
+#ifdef IDLE_SKIP
+        if (!riot002.timer.timeout && riot002.timer.mult) {
+            int loop_instructions = idle_loop(address);
+            if (loop_instructions) idle_skip(&riot002.timer, loop_instructions);
+        }
+#endif
         if (riot002.timer.timeout) {
             return 0x80;
         } else {
@@ -342,20 +435,9 @@ void riot002write(uint16_t address, uint8_t value) {
             riot002.pbdd = value;
             break;
 
-        case 0x1744:
-            reset_timer(&riot002.timer, 1, value);
-            break;
-
-        case 0x1745:
-            reset_timer(&riot002.timer, 8, value);
-            break;
-
-        case 0x1746:
-            reset_timer(&riot002.timer, 64, value);
-            break;
-
-        case 0x1747:
-            reset_timer(&riot002.timer, 1024, value);
+        case 0x1744: case 0x1745: case 0x1746: case 0x1747:
+        case 0x174c: case 0x174d: case 0x174e: case 0x174f:
+            write_timer(&riot002.timer, address, value, IRQ_RIOT002);
             break;
     }
 }
@@ -378,20 +460,9 @@ void riot003write(uint16_t address, uint8_t value) {
             riot003.pbdd = value;
             break;
 
-        case 0x1704:
-            reset_timer(&riot003.timer, 1, value);
-            break;
-
-        case 0x1705:
-            reset_timer(&riot003.timer, 8, value);
-            break;
-
-        case 0x1706:
-            reset_timer(&riot003.timer, 64, value);
-            break;
-
-        case 0x1707:
-            reset_timer(&riot003.timer, 1024, value);
+        case 0x1704: case 0x1705: case 0x1706: case 0x1707:
+        case 0x170c: case 0x170d: case 0x170e: case 0x170f:
+            write_timer(&riot003.timer, address, value, IRQ_RIOT003);
             break;
     }
 }
@@ -399,6 +470,7 @@ void riot003write(uint16_t address, uint8_t value) {
 void init_timer(TIMER *timer) {
 	timer->mult = 0;
 	timer->timeout = 0;
+	timer->irq = 0;
 }
 
 void reset_timer(TIMER *timer, int scale, uint8_t start_value) {
@@ -409,7 +481,22 @@ void reset_timer(TIMER *timer, int scale, uint8_t start_value) {
     timer->count = start_value;
 }
 
-void update_timer(TIMER *timer, uint32_t ticks) {
+// On a 6530 the bottom two address bits of a timer write pick the scale,
+// and A3 says whether it interrupts when it times out. Writing it, or
+// reading it, clears the interrupt, and a read's A3 turns interrupts on
+// or off the same way.
+void write_timer(TIMER *timer, uint16_t address, uint8_t value, uint32_t source) {
+    static const int scales[4] = { 1, 8, 64, 1024 };
+    reset_timer(timer, scales[address & 3], value);
+    read_timer(timer, address, source);
+}
+
+void read_timer(TIMER *timer, uint16_t address, uint32_t source) {
+    timer->irq = (address & 8) ? source : 0;
+    irq_lower(source);
+}
+
+HOTPATH void update_timer(TIMER *timer, uint32_t ticks) {
     if (!timer->mult || timer->timeout) {
         return;
     }
@@ -417,6 +504,7 @@ void update_timer(TIMER *timer, uint32_t ticks) {
         timer->tick_accum++;
         if (timer->tick_accum >= timer->mult) {
             timer->timeout = 1;
+            if (timer->irq) irq_raise(timer->irq);
             timer->tick_accum = 0;
             timer->count = timer->start_value - (ticks - timer->count);
         } else {
@@ -427,6 +515,160 @@ void update_timer(TIMER *timer, uint32_t ticks) {
     }
 }
 
+#ifdef IDLE_SKIP
+uint32_t idle_skipped_cycles;
+uint32_t idle_skips;
+uint32_t idle_sleeps;
+
+// Where the last possible idle loop read its register, and when
+static uint16_t idle_pc;
+static uint32_t idle_clock;
+
+// Checks whether the instruction that is reading address is spinning in a
+// loop that does nothing but poll it, something like
+//     WAIT  BIT $1747
+//           BPL WAIT
+// The read has to be an absolute BIT/LDA/LDX/LDY, followed by nothing but
+// immediate-mode logic/compares, transfers or NOPs, and a conditional branch
+// back to the read. A loop like that doesn't change anything from one pass
+// to the next, so it can only end when the register does. To make sure the
+// branch really goes back, the loop isn't reported until the same read comes
+// around again exactly one pass worth of cycles later.
+// Returns the number of instructions in the loop, or 0 if it isn't one.
+HOTPATH int idle_loop(uint16_t address) {
+    uint16_t start = pc - 3;
+    uint8_t opcode = read6502(start);
+    int instructions = 1;
+    int cycles;
+
+    if ((opcode != 0x2c) && (opcode != 0xad) && (opcode != 0xae) && (opcode != 0xac)) {
+        return 0;
+    }
+    if ((read6502(start + 1) != (address & 0xff)) || (read6502(start + 2) != (address >> 8))) {
+        return 0;
+    }
+    cycles = ticktable[opcode];
+
+    for (uint16_t addr = pc; instructions < 4; instructions++) {
+        opcode = read6502(addr);
+        if ((opcode & 0x1f) == 0x10) {
+            // Conditional branch, which has to go back to the read
+            uint16_t next = addr + 2;
+            if ((uint16_t) (next + (int8_t) read6502(addr + 1)) != start) {
+                return 0;
+            }
+            cycles += ticktable[opcode] + (((next ^ start) & 0xff00) ? 2 : 1);
+            instructions++;
+            break;
+        }
+        switch (opcode) {
+            case 0x09: case 0x29: case 0x49:  // ORA, AND, EOR immediate
+            case 0xc9: case 0xe0: case 0xc0:  // CMP, CPX, CPY immediate
+                addr += 2;
+                break;
+            case 0xea:                        // NOP
+            case 0xaa: case 0xa8:             // TAX, TAY
+            case 0x8a: case 0x98:             // TXA, TYA
+                addr++;
+                break;
+            default:
+                return 0;
+        }
+        cycles += ticktable[opcode];
+    }
+    if ((opcode & 0x1f) != 0x10) {
+        return 0;
+    }
+
+    if ((idle_pc == pc) && (clockticks6502 - idle_clock == (uint32_t) cycles)) {
+        return instructions;
+    }
+    idle_pc = pc;
+    idle_clock = clockticks6502;
+    return 0;
+}
+
+// Runs both RIOT timers forward to the point where timer expires, the same
+// way the main loop would have if it had kept emulating the idle loop, and
+// charges the cycles the loop would have taken to clockticks6502
+void idle_skip(TIMER *timer, int loop_instructions) {
+    uint32_t cycles_per_pass = clockticks6502 - idle_clock;
+    uint32_t steps = 0;
+    uint32_t skipped;
+
+    while (!timer->timeout) {
+        update_timer(&riot003.timer, 16);
+        update_timer(&riot002.timer, 16);
+        steps++;
+    }
+    skipped = steps * cycles_per_pass / loop_instructions;
+    clockticks6502 += skipped;
+    idle_skipped_cycles += skipped;
+    idle_skips++;
+    idle_pc = 0;
+}
+
+// Emulated cycles a keypad loop can wait before it's worth sleeping, about
+// one SysTick at the KIM-1's 1 MHz
+#define IDLE_SLEEP_CYCLES 1000
+
+// Waits out a loop polling the keypad port, which only a key press or a
+// serial character can end, unless something the 6502 would see comes
+// first. With an IRQ waiting nothing is skipped at all, so the interrupt
+// is taken on the next instruction. With a RIOT timer running, or the VIA
+// due within IDLE_SLEEP_CYCLES, emulated time is moved on to whichever
+// of them comes first and the loop carries on from there. Only with
+// nothing due does the ARM core sleep until the next interrupt, and then
+// the time it slept is charged to clockticks6502 in whole passes of the
+// loop, stopping at the VIA's next event, so the 6502 sees the time go by
+// rather than the loop running once per SysTick.
+void idle_wait(int loop_instructions) {
+    uint32_t cycles_per_pass = clockticks6502 - idle_clock;
+    uint32_t due = UINT32_MAX;
+    uint32_t skipped;
+
+    if (irq_pending) {
+        return;
+    }
+#ifdef VIA
+    if ((int32_t) (via_event - clockticks6502) > 0) {
+        due = via_event - clockticks6502;
+    } else {
+        return;
+    }
+#endif
+
+    int riot003_running = riot003.timer.mult && !riot003.timer.timeout;
+    int riot002_running = riot002.timer.mult && !riot002.timer.timeout;
+    if (riot003_running || riot002_running) {
+        // As idle_skip does, but for whichever timer or VIA event is first
+        uint32_t steps = 0;
+        while (!(riot003_running && riot003.timer.timeout) &&
+               !(riot002_running && riot002.timer.timeout) &&
+               ((steps + 1) * cycles_per_pass / loop_instructions < due)) {
+            update_timer(&riot003.timer, 16);
+            update_timer(&riot002.timer, 16);
+            steps++;
+        }
+        skipped = steps * cycles_per_pass / loop_instructions;
+        idle_skips++;
+    } else if (due < IDLE_SLEEP_CYCLES) {
+        skipped = (due + cycles_per_pass - 1) / cycles_per_pass * cycles_per_pass;
+        idle_skips++;
+    } else {
+        uint32_t start = DWT->CYCCNT;
+        __WFI();
+        skipped = (DWT->CYCCNT - start) / (SystemCoreClock / 1000000);
+        if (skipped > due) skipped = due;
+        skipped -= skipped % cycles_per_pass;
+        idle_sleeps++;
+    }
+    clockticks6502 += skipped;
+    idle_skipped_cycles += skipped;
+    idle_pc = 0;
+}
+#endif
+
 // Reads a paper tape input line, filtering out anything that isn't part of the paper tape
 // protocol, and expecting it to start with a semicolon
 int read_paper_tape_line() {
@@ -559,7 +801,125 @@ void paper_tape_receive() {
     }
 }
 
-void check_pc() {
+// The addresses check_pc looks for. Anything that runs more than one
+// instruction per step has to stop at these.
+int watch6502(uint16_t address) {
+#ifdef LIBRARY
+    if ((address >> 8) == LIBRARY_PAGE) return 1;
+#endif
+#ifdef TAPE
+    if ((address == TAPE_DUMPT) || (address == TAPE_LOADT)) return 1;
+#endif
+#ifdef FLOAT_ACCEL
+    if ((address & 0xff80) == FLOAT_TRAPS) return 1;
+#endif
+    return (address == 0x1e5a) || (address == 0x1ea0);
+}
+
+#ifdef LIBRARY
+// Loads the library program that pc picks and runs it, or goes back to the
+// monitor if there isn't one
+void library_run() {
+    char line[64];
+    int len;
+    const LIBRARY_PROGRAM *program = library_load(pc & 0xff);
+
+    if (program) {
+        len = snprintf(line, sizeof(line), "Loaded %.16s\r\n", program->name);
+        pc = program->start;
+    } else {
+        len = snprintf(line, sizeof(line), "No program %02X in the library\r\n", pc & 0xff);
+        pc = 0x1c4f; // START
+    }
+    HAL_UART_Transmit(&huart1, (uint8_t *) line, len, 1000);
+}
+#endif
+
+#ifdef TAPE
+// Sets up the ROM's VEB, the little routine at 17EC that DUMPT and LOADT
+// call for each byte, as LDA/STA abs and where it would have stopped
+static void tape_veb(uint8_t opcode, uint16_t address) {
+    write6502(0x17ec, opcode);
+    write6502(0x17ed, address & 0xff);
+    write6502(0x17ee, address >> 8);
+}
+
+// DUMPT - saves SAL,SAH up to but not including EAL,EAH to the virtual tape
+// as file ID, leaves the ROM's variables as it would, and goes back to the
+// monitor showing 0000. The ROM has no way to fail, so FFFF there means the
+// file didn't fit on the tape.
+void tape_dumpt() {
+    char line[64];
+    int len;
+    uint8_t id = read6502(0x17f9);
+    uint16_t start = read6502(0x17f5) | (read6502(0x17f6) << 8);
+    uint16_t end = read6502(0x17f7) | (read6502(0x17f8) << 8);
+    uint16_t length = end > start ? end - start : 0;
+    const TAPE_FILE *file = tape_save(id, start, length);
+
+    tape_veb(0xad, start + length);
+    write6502(0x17ef, 0x60); // RTS
+    if (file) {
+        write6502(0x17e7, file->checksum & 0xff);
+        write6502(0x17e8, file->checksum >> 8);
+        a = 0;
+        len = snprintf(line, sizeof(line), "Saved %02X, %u bytes from %04X\r\n", id, length, start);
+    } else {
+        a = 0xff;
+        len = snprintf(line, sizeof(line), "No room on the tape for %02X\r\n", id);
+    }
+    write6502(0xfa, a);
+    write6502(0xfb, a);
+    pc = 0x1c4f; // START
+    HAL_UART_Transmit(&huart1, (uint8_t *) line, len, 1000);
+}
+
+// LOADT - loads file ID from the virtual tape, or with ID 00 or FF whatever
+// was saved last, FF putting it at SAL,SAH instead of where it came from.
+// Goes back to the monitor showing 0000, or FFFF if the checksum is wrong.
+// The ROM would keep listening for a file that isn't there until you
+// pressed RS, but here it gives up with FFFF.
+void tape_loadt() {
+    char line[64];
+    int len;
+    uint8_t id = read6502(0x17f9);
+    uint16_t address = read6502(0x17f5) | (read6502(0x17f6) << 8);
+    uint16_t checksum = 0;
+    const TAPE_FILE *file = tape_find(id);
+
+    if (file) {
+        const uint8_t *data = (const uint8_t *) (file + 1);
+        if (id != 0xff) {
+            address = file->address;
+        }
+        checksum = (file->address & 0xff) + (file->address >> 8);
+        for (uint32_t i = 0; i < file->length; i++) {
+            write6502(address + i, data[i]);
+            checksum += data[i];
+        }
+        a = checksum == file->checksum ? 0 : 0xff;
+        len = snprintf(line, sizeof(line), "Loaded %02X, %u bytes at %04X%s\r\n", file->id,
+                file->length, address, a ? ", bad checksum" : "");
+        address += file->length;
+    } else {
+        a = 0xff;
+        len = snprintf(line, sizeof(line), "No file %02X on the tape\r\n", id);
+    }
+
+    tape_veb(0x8d, address);
+    write6502(0x17ef, 0x4c); // JMP 190F
+    write6502(0x17f0, 0x0f);
+    write6502(0x17f1, 0x19);
+    write6502(0x17e7, checksum & 0xff);
+    write6502(0x17e8, checksum >> 8);
+    write6502(0xfa, a);
+    write6502(0xfb, a);
+    pc = 0x1c4f; // START
+    HAL_UART_Transmit(&huart1, (uint8_t *) line, len, 1000);
+}
+#endif
+
+HOTPATH void check_pc() {
     // Serial IO in the KIM-1 is hard to emulate because it is based on CPU timing.
     // As long as you use the ROM routines to read/write, the emulator will work
     // because it notices when you are trying to read/write a serial char and takes over
@@ -567,7 +927,7 @@ void check_pc() {
 	if (pc == 0x1e5a) {  // GETCH - read serial char
         // Look at the return addr to see if this might have been called from the
         // paper tape read
-		int return_addr = (RAM[0x102+sp] << 8) + RAM[0x101+sp];
+		int return_addr = (LOW_RAM[0x100 | ((sp + 2) & 0xff)] << 8) + LOW_RAM[0x100 | ((sp + 1) & 0xff)];
         if (return_addr == 0x1ce9) {
             // If a paper tape read, clear the return value from the stack since
             // we will return straight to whatever called LOAD, and use the ARM
@@ -577,16 +937,33 @@ void check_pc() {
 			return;
 		}
 
-        // Read a serial char
-		while (HAL_UART_Receive(&huart1, &receive_char, 1, 1000) != HAL_OK);
+        // Read a serial char, skipping over any that the ARM side handles itself
+#ifdef BENCHMARK
+		benchmark_wait_start();
+#endif
+		do {
+#ifdef IDLE_SKIP
+			// SysTick wakes the core every millisecond, which is often enough
+			// to pick up each character before the next one arrives
+			while (!__HAL_UART_GET_FLAG(&huart1, UART_FLAG_RXNE)) {
+				__WFI();
+				idle_sleeps++;
+			}
+#endif
+			while (HAL_UART_Receive(&huart1, &receive_char, 1, 1000) != HAL_OK);
+		} while (check_escape(receive_char));
+#ifdef BENCHMARK
+		benchmark_wait_end();
+#endif
 		a = receive_char;
 
         // Allow control-D to go back to the built-in keyboard/display
 		if (receive_char == 4) {
 			serial_mode = 0;
-			RAM[0x102+sp] = 0x1c;
-			RAM[0x101+sp] = 0x4e;  // to escape serial mode, jump back to START symbol
+			LOW_RAM[0x100 | ((sp + 2) & 0xff)] = 0x1c;
+			LOW_RAM[0x100 | ((sp + 1) & 0xff)] = 0x4e;  // to escape serial mode, jump back to START symbol
 			                       // change the return address on the stack from 1c6c to 1c4e
+			DIRTY_WRITE(0x100);
 		}
 		y = 0xff;
 		pc = 0x1e85;
@@ -595,9 +972,102 @@ void check_pc() {
 		transmit_char = a;
 		HAL_UART_Transmit(&huart1, &transmit_char, 1, 100);
 		pc = 0x1ed3;
+#ifdef LIBRARY
+	} else if ((pc >> 8) == LIBRARY_PAGE) {
+		library_run();
+#endif
+#ifdef TAPE
+	} else if (pc == TAPE_DUMPT) {
+		tape_dumpt();
+	} else if (pc == TAPE_LOADT) {
+		tape_loadt();
+#endif
+#ifdef FLOAT_ACCEL
+	} else if ((pc & 0xff80) == FLOAT_TRAPS) {
+		float_trap();
+#endif
 	}
 }
 
+// Some control characters typed at the serial console are commands for the
+// emulator rather than input for the KIM-1. Returns 1 if the character was
+// one of those.
+int check_escape(uint8_t ch) {
+#ifdef OPCODE_PROFILE
+    if (ch == PROFILE_DUMP_CHAR) {
+        profile_dump();
+        return 1;
+    }
+#endif
+#ifdef PC_PROFILE
+    if (ch == PC_PROFILE_DUMP_CHAR) {
+        pc_profile_dump();
+        return 1;
+    }
+#endif
+#ifdef INSTRUCTION_TRACE
+    if (ch == TRACE_DUMP_CHAR) {
+        trace_dump();
+        return 1;
+    }
+#endif
+#ifdef BENCHMARK
+    if (ch == BENCHMARK_CHAR) {
+        benchmark_report();
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+#ifdef SNAPSHOT
+// Waits for the key on the scan line being driven to come back up. Returns 1
+// if it was down for at least ms milliseconds.
+static int key_held(uint32_t ms) {
+    uint32_t start = HAL_GetTick();
+    int held = 0;
+    while (HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_11) == 0) {
+        if (HAL_GetTick() - start >= ms) held = 1;
+    }
+    return held;
+}
+
+// Saves or restores a snapshot and says how it went on the serial port.
+// Returns 1 if the machine was restored.
+static int snapshot_key(int restore) {
+    char line[64];
+    int len;
+    int restored = 0;
+
+    if (restore) {
+        if (snapshot_restore()) {
+            len = snprintf(line, sizeof(line), "No snapshot to restore\r\n");
+        } else {
+            // The registers are back, but the pins they drive aren't
+            riot002write(0x1741, riot002.padd);
+            riot002write(0x1740, riot002.sad);
+#ifdef SUPERINSTRUCTIONS
+            fuse6502(!sst_mode);
+#endif
+#ifdef JIT
+            jit6502(!sst_mode);
+#endif
+            len = snprintf(line, sizeof(line), "Snapshot restored\r\n");
+            restored = 1;
+        }
+    } else {
+        uint32_t size = snapshot_save();
+        if (size) {
+            len = snprintf(line, sizeof(line), "Snapshot saved, %lu bytes\r\n", size);
+        } else {
+            len = snprintf(line, sizeof(line), "Snapshot save failed\r\n");
+        }
+    }
+    HAL_UART_Transmit(&huart1, (uint8_t *) line, len, 1000);
+    return restored;
+}
+#endif
+
 // On the original KIM-1, the ST, RS, and SST buttons/switch went straight
 // to pins on the 6502, so they could occur at any time, and not just when
 // the KIM-1 was scanning input. Since the Blackpill lets the KIM-1 do the
@@ -615,7 +1085,15 @@ int check_special() {
 			HAL_Delay(50);  // Delay to debounce
 			bit = HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_11);
     		if (bit == 0) { // If the key is still down, do an NMI
+#ifdef SNAPSHOT
+                // unless it is held down, which saves a snapshot
+                if (key_held(SNAPSHOT_HOLD_TIME)) {
+                    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_9, 1);
+                    return snapshot_key(0);
+                }
+#else
     			while (HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_11) == 0);
+#endif
                 // KIM-1 has hardware circuitry to prevent NMI when
                 // address lines 10,11,12 are all high
                 if (!(pc & 0x1c00)) {
@@ -637,9 +1115,20 @@ int check_special() {
 			HAL_Delay(50);  // debounce delay
 			bit = HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_11);
     		if (bit == 0) {
+#ifdef SNAPSHOT
+                // Holding RS down restores the snapshot instead of resetting
+                if (key_held(SNAPSHOT_HOLD_TIME)) {
+                    HAL_GPIO_WritePin(GPIOC, GPIO_PIN_15, 1);
+                    return snapshot_key(1);
+                }
+#else
     			while (HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_11) == 0);
+#endif
     			HAL_GPIO_WritePin(GPIOC, GPIO_PIN_15, 1);
     			reset6502();
+#ifdef VIA
+                via_reset();
+#endif
                 serial_mode = 0;
     			return 1;
     		}
@@ -673,6 +1162,12 @@ int check_special() {
 				sst_mode = flag;
 			}
             serial_mode = 0;
+#ifdef SUPERINSTRUCTIONS
+            fuse6502(!sst_mode);
+#endif
+#ifdef JIT
+            jit6502(!sst_mode);
+#endif
             HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0, 1);
 			return 1;
 		}
@@ -716,6 +1211,48 @@ int main(void)
   MX_USART1_UART_Init();
   /* USER CODE BEGIN 2 */
 
+#ifdef BANKED_RAM
+  // Before the checks, which might write to the bank window
+  bank_init();
+#endif
+
+  // The self checks run code through the emulator that writes the zero
+  // page, the stack, RIOT RAM and the RIOT ports and timers, so they go
+  // before any of that is set up for real
+#ifdef SUPERINSTRUCTIONS
+  // Make sure the superinstructions do the same thing as the instructions
+  // they replace, and fall back to running them one at a time if not
+  int fuse_failed = fuse_check();
+  if (fuse_failed) {
+      char line[64];
+      int len = snprintf(line, sizeof(line), "Superinstruction check failed on test %d\r\n", fuse_failed);
+      HAL_UART_Transmit(&huart1, (uint8_t *) line, len, 1000);
+      fuse6502(0);
+  }
+#endif
+
+#ifdef JIT
+  // And for the Thumb-2 translation of RAM code
+  int jit_failed = jit_check();
+  if (jit_failed) {
+      char line[64];
+      int len = snprintf(line, sizeof(line), "JIT check failed on test %d\r\n", jit_failed);
+      HAL_UART_Transmit(&huart1, (uint8_t *) line, len, 1000);
+      jit6502(0);
+  }
+#endif
+
+  // The RIOTs and VIA are reset below, but an IRQ the checks raised has
+  // to be dropped here
+  irq_pending = 0;
+  irq_check = 0;
+
+#ifdef IDLE_SKIP
+  // idle_wait times its sleeps with the cycle counter
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
   HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, 0);
 
   for (int i=0; i < 8; i++) {
@@ -735,6 +1272,9 @@ int main(void)
 
   init_timer(&riot002.timer);
   init_timer(&riot003.timer);
+#ifdef VIA
+  via_reset();
+#endif
 
   // Set the vectors that the KIM-1 ROM uses
   write6502(0x17fa, 0);
@@ -748,11 +1288,29 @@ int main(void)
   serial_mode = 0;
 
   // Reset the CPU
+  clockticks6502 = 0;
   reset6502();
 
+#ifdef OPCODE_PROFILE
+  profile_init();
+#endif
+#ifdef PC_PROFILE
+  MX_TIM2_Init();
+  HAL_TIM_Base_Start_IT(&htim2);
+#endif
+#ifdef INSTRUCTION_TRACE
+  // Keep a record of the last instructions from power-on, so there is
+  // something to look at if the emulator gets stuck or faults
+  trace6502(1);
+#endif
+
   // Set the countdown for checking the special keys
   int check_special_ticks = SPECIAL_CHECK_TIME;
 
+#ifdef BENCHMARK
+  benchmark_reset();
+#endif
+
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -766,24 +1324,42 @@ int main(void)
       // address line is 0x1cxx (bits 10, 11, and 12 of the address)
 	  uint8_t enable_SST_NMI = sst_mode && !(pc & 0x1c00);
 
-      step6502();
+      int steps = step6502();
+      BENCHMARK_COUNT(steps);
+      HOST_COUNT(steps);
 
       // If we are in SST mode and can send an NMI, send it
       if (sst_mode && enable_SST_NMI) {
   		  nmi6502();
       }
 
+#ifdef VIA
+      // Let the VIA set any flags that have come due
+      if ((int32_t) (clockticks6502 - via_event) >= 0) {
+          via_update();
+      }
+#endif
+
+      // Take an IRQ if a device has raised one
+      if (irq_check) {
+          irq_service();
+      }
+
       // Update the timer ticks. Since the blackpill can't run the CPU at
       // quite full speed, we update the ticks more frequently. At some point
       // maybe I will convert this to using ARM timers to get more accurate timing.
-      update_timer(&riot003.timer, 16);
-      update_timer(&riot002.timer, 16);
+      // A superinstruction gets the ticks for each instruction in it.
+      for (int i = 0; i < steps; i++) {
+          update_timer(&riot003.timer, 16);
+          update_timer(&riot002.timer, 16);
+      }
 
       // See if the CPU is at any interesting location
       check_pc();
 
       // If it is time to check for special keys, do it
-      if (--check_special_ticks <= 0) {
+      check_special_ticks -= steps;
+      if (check_special_ticks <= 0) {
     	  check_special_ticks = SPECIAL_CHECK_TIME;
     	  check_special();
       }
@@ -869,6 +1445,35 @@ static void MX_USART1_UART_Init(void)
 
 }
 
+#ifdef PC_PROFILE
+/**
+  * @brief TIM2 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_TIM2_Init(void)
+{
+  /* USER CODE BEGIN TIM2_Init 0 */
+
+  // TIM2 counts at 1MHz and overflows PC_SAMPLE_HZ times a second
+  /* USER CODE END TIM2_Init 0 */
+  htim2.Instance = TIM2;
+  htim2.Init.Prescaler = HAL_RCC_GetPCLK1Freq() / 1000000 - 1;
+  htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim2.Init.Period = 1000000 / PC_SAMPLE_HZ - 1;
+  htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN TIM2_Init 2 */
+
+  /* USER CODE END TIM2_Init 2 */
+
+}
+#endif
+
 /**
   * @brief GPIO Initialization Function
   * @param None
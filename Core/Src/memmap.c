@@ -0,0 +1,49 @@
+// The page tables, worked out by the compiler from the layout in memmap.h.
+// Every access to the 6502 address space looks its page up here first,
+// and only goes on to the RIOTs and the other devices if the entry is
+// NULL, so a different layout is only a matter of changing memmap.h and
+// building again. With EXPANDED_RAM the CCM RAM, which is mostly free
+// unless the block cache or the trace recorder has it, carries the
+// expansion RAM on from where SRAM runs out, up to 9C00.
+//
+// The tables are const, so they go in flash and cost no SRAM.
+
+#include "main.h"
+#include "memmap.h"
+
+#if EXPANSION_CCM_PAGES
+uint8_t CCM_RAM[EXPANSION_CCM_PAGES * 256] CCMBSS;
+#define CCM_PAGE(n) (CCM_RAM + (((n) << 8) - EXPANSION_SPLIT))
+#else
+#define CCM_PAGE(n) NULL
+#endif
+
+#ifdef CCMRAM_ZEROPAGE
+#define LOW_PAGE(n) ((n) < 2 ? ZP_RAM + ((n) << 8) : RAM + ((n) << 8))
+#else
+#define LOW_PAGE(n) (RAM + ((n) << 8))
+#endif
+
+#define RAM_PAGE(n) \
+    (((n) << 8) < 0x1000 ? LOW_PAGE(n) : \
+    ((n) << 8) < EXPANSION_START ? NULL : \
+    ((n) << 8) < EXPANSION_SPLIT ? RAM + ((n) << 8) - (EXPANSION_START - 0x1000) : \
+    ((n) << 8) < EXPANSION_END ? CCM_PAGE(n) : NULL)
+#define PAGE(n) RAM_PAGE(n)
+#define PAGES4(n) PAGE(n), PAGE((n) + 1), PAGE((n) + 2), PAGE((n) + 3)
+#define PAGES16(n) PAGES4(n), PAGES4((n) + 4), PAGES4((n) + 8), PAGES4((n) + 12)
+#define PAGES64(n) PAGES16(n), PAGES16((n) + 16), PAGES16((n) + 32), PAGES16((n) + 48)
+
+uint8_t *const page_table[256] = {
+    PAGES64(0x00), PAGES64(0x40), PAGES64(0x80), PAGES64(0xc0)
+};
+
+#undef PAGE
+#define PAGE(n) \
+    ((n) >= 0x18 && (n) < 0x1c ? RIOT003_ROM + (((n) - 0x18) << 8) : \
+    (n) >= 0x1c && (n) < 0x20 ? RIOT002_ROM + (((n) - 0x1c) << 8) : \
+    (n) == 0xff ? RIOT002_ROM + 0x300 : RAM_PAGE(n))
+
+const uint8_t *const read_table[256] = {
+    PAGES64(0x00), PAGES64(0x40), PAGES64(0x80), PAGES64(0xc0)
+};
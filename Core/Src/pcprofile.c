@@ -0,0 +1,78 @@
+// Statistical profile of where the 6502 spends its time. A timer interrupt
+// reads the emulated pc and bumps the histogram bucket it falls in, so the
+// emulator itself runs at full speed.
+//
+// The dump is little-endian binary so it stays small at 9600 baud:
+//   "KPC1"            magic and format version
+//   uint8_t  shift    PC_SAMPLE_SHIFT
+//   uint8_t  0        reserved
+//   uint16_t hz       PC_SAMPLE_HZ
+//   uint32_t total    samples taken since the last dump
+//   uint16_t n        number of non-empty buckets that follow
+//   n times:
+//     uint16_t bucket pc >> shift
+//     uint32_t count
+// The tools/pcprof program turns it into a hot-spot report.
+
+#include "main.h"
+#include "fake6502.h"
+#include "pcprofile.h"
+
+#ifdef PC_PROFILE
+
+extern UART_HandleTypeDef huart1;
+
+static uint32_t pc_samples[PC_SAMPLE_BUCKETS];
+static uint32_t pc_sample_total;
+
+// Called from the TIM2 interrupt. The handler is built with -ffixed-r6 like
+// everything else, so r6 still holds the interrupted 6502 pc.
+void pc_sample() {
+    pc_samples[pc >> PC_SAMPLE_SHIFT]++;
+    pc_sample_total++;
+}
+
+static void put16(uint8_t *buf, uint16_t val) {
+    buf[0] = val & 0xff;
+    buf[1] = val >> 8;
+}
+
+static void put32(uint8_t *buf, uint32_t val) {
+    put16(buf, val & 0xffff);
+    put16(buf + 2, val >> 16);
+}
+
+// Sends the histogram and clears it so the next dump covers a fresh interval
+void pc_profile_dump() {
+    uint8_t buf[16];
+    uint16_t used = 0;
+
+    // Hold off sampling so the header matches the buckets that follow
+    HAL_NVIC_DisableIRQ(TIM2_IRQn);
+
+    for (int i = 0; i < PC_SAMPLE_BUCKETS; i++) {
+        if (pc_samples[i]) used++;
+    }
+
+    memcpy(buf, "KPC1", 4);
+    buf[4] = PC_SAMPLE_SHIFT;
+    buf[5] = 0;
+    put16(buf + 6, PC_SAMPLE_HZ);
+    put32(buf + 8, pc_sample_total);
+    put16(buf + 12, used);
+    HAL_UART_Transmit(&huart1, buf, 14, 1000);
+
+    for (int i = 0; i < PC_SAMPLE_BUCKETS; i++) {
+        if (pc_samples[i] == 0) continue;
+
+        put16(buf, i);
+        put32(buf + 2, pc_samples[i]);
+        HAL_UART_Transmit(&huart1, buf, 6, 1000);
+        pc_samples[i] = 0;
+    }
+    pc_sample_total = 0;
+
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+#endif
@@ -0,0 +1,56 @@
+// Per-opcode execution counts and cycle costs, compiled in with OPCODE_PROFILE.
+// The counters live in CCM RAM so they don't take anything away from the
+// emulated 6502 memory.
+
+#include "main.h"
+#include "profile.h"
+
+#ifdef OPCODE_PROFILE
+
+extern UART_HandleTypeDef huart1;
+
+uint32_t opcode_count[256] CCMBSS;
+uint32_t opcode_cycles[256] CCMBSS;
+
+// The number of cycles it takes just to read the cycle counter twice, which
+// gets subtracted from each handler's total
+static uint32_t profile_overhead;
+
+void profile_init() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    uint32_t start = DWT->CYCCNT;
+    profile_overhead = DWT->CYCCNT - start;
+}
+
+static void profile_print(char *line, int len) {
+    HAL_UART_Transmit(&huart1, (uint8_t *) line, len, 1000);
+}
+
+// Prints one line per opcode that has been executed since the last dump,
+// then clears the counters so the next dump covers a fresh interval.
+void profile_dump() {
+    char line[64];
+    uint32_t total_count = 0;
+    uint32_t total_cycles = 0;
+
+    profile_print(line, snprintf(line, sizeof(line), "\r\nOP      COUNT     CYCLES   AVG\r\n"));
+    for (int op = 0; op < 256; op++) {
+        uint32_t count = opcode_count[op];
+        if (count == 0) continue;
+
+        uint32_t cycles = opcode_cycles[op] - count * profile_overhead;
+        profile_print(line, snprintf(line, sizeof(line), "%02X %10lu %10lu %5lu\r\n",
+                op, count, cycles, cycles / count));
+        total_count += count;
+        total_cycles += cycles;
+        opcode_count[op] = 0;
+        opcode_cycles[op] = 0;
+    }
+    profile_print(line, snprintf(line, sizeof(line), "ALL %9lu %10lu\r\n",
+            total_count, total_cycles));
+}
+
+#endif
@@ -0,0 +1,251 @@
+// Saving the whole machine to flash and putting it back, compiled in with
+// SNAPSHOT. Memory is saved as image records, runs of pages that aren't all
+// zero, each compressed with LZ4 unless that would make it bigger. With
+// DIRTY_PAGES, a save after that only adds a delta with the pages that were
+// written since, until the area is full. Each header goes in last, so a
+// save that was cut short by a reset never looks valid.
+
+#include "main.h"
+#include "fake6502.h"
+#include "image.h"
+#include "dirty.h"
+#include "irq.h"
+#include "snapshot.h"
+#include "storage.h"
+
+#ifdef SNAPSHOT
+
+// Supplied by main.c
+extern RIOT riot002;
+extern RIOT riot003;
+extern uint8_t serial_mode;
+extern uint8_t sst_mode;
+
+#define ADLER_MOD 65521
+
+typedef struct SNAPSHOT_WRITER {
+    STORAGE_WRITER storage;
+    uint32_t adler_a, adler_b;
+} SNAPSHOT_WRITER;
+
+static void snapshot_put(void *context, uint8_t b) {
+    SNAPSHOT_WRITER *writer = context;
+    writer->adler_a = (writer->adler_a + b) % ADLER_MOD;
+    writer->adler_b = (writer->adler_b + writer->adler_a) % ADLER_MOD;
+    storage_put(&writer->storage, b);
+}
+
+static uint32_t adler32(const uint8_t *p, uint32_t len) {
+    uint32_t a = 1, b = 0;
+    while (len--) {
+        a = (a + *p++) % ADLER_MOD;
+        b = (b + a) % ADLER_MOD;
+    }
+    return (b << 16) | a;
+}
+
+static void save_timer(uint32_t *saved, const TIMER *timer) {
+    saved[0] = timer->mult;
+    saved[1] = timer->tick_accum;
+    saved[2] = timer->start_value;
+    saved[3] = timer->count;
+    saved[4] = timer->timeout;
+}
+
+static void restore_timer(TIMER *timer, const uint32_t *saved) {
+    timer->mult = saved[0];
+    timer->tick_accum = saved[1];
+    timer->start_value = saved[2];
+    timer->count = saved[3];
+    timer->timeout = saved[4];
+}
+
+static void save_riot(uint8_t *saved, const RIOT *riot) {
+    saved[0] = riot->padd;
+    saved[1] = riot->sad;
+    saved[2] = riot->pbdd;
+    saved[3] = riot->sbd;
+}
+
+static void restore_riot(RIOT *riot, const uint8_t *saved) {
+    riot->padd = saved[0];
+    riot->sad = saved[1];
+    riot->pbdd = saved[2];
+    riot->sbd = saved[3];
+}
+
+static uint32_t header_checksum(const SNAPSHOT_HEADER *header) {
+    return adler32((const uint8_t *) header, sizeof(SNAPSHOT_HEADER));
+}
+
+// Returns the records after header if it is a good snapshot or delta,
+// depending on magic, or NULL if not
+static const uint8_t *snapshot_records(const SNAPSHOT_HEADER *header, uint32_t magic) {
+    uint32_t room = SNAPSHOT_FLASH_END - (uintptr_t) header;
+
+    if ((room < sizeof(SNAPSHOT_HEADER)) || (header->magic != magic) ||
+            (header->version != SNAPSHOT_VERSION) ||
+            (header->header_size < sizeof(SNAPSHOT_HEADER)) || (header->header_size > room) ||
+            (header->length > room - header->header_size)) {
+        return NULL;
+    }
+    const uint8_t *records = (const uint8_t *) header + header->header_size;
+    if ((adler32(records, header->length) != header->checksum) ||
+            image_check(records, header->length)) {
+        return NULL;
+    }
+    return records;
+}
+
+// Where whatever comes after header would go
+static uint32_t snapshot_end(const SNAPSHOT_HEADER *header) {
+    return ((uintptr_t) header + header->header_size + header->length + 3) & ~3;
+}
+
+// Returns the delta after header, or NULL if there isn't a good one
+static const SNAPSHOT_HEADER *snapshot_next(const SNAPSHOT_HEADER *header) {
+    const SNAPSHOT_HEADER *next = (const SNAPSHOT_HEADER *) snapshot_end(header);
+    if (!snapshot_records(next, SNAPSHOT_DELTA) || (next->previous != header_checksum(header))) {
+        return NULL;
+    }
+    return next;
+}
+
+#ifdef DIRTY_PAGES
+// The header of the save or restore that memory matched, apart from the
+// pages written since, or NULL if there hasn't been one since power on
+static const SNAPSHOT_HEADER *snapshot_synced;
+
+static void count_put(void *context, uint8_t b) {
+    (*(uint32_t *) context)++;
+}
+#endif
+
+uint32_t snapshot_save() {
+    SNAPSHOT_WRITER writer;
+    SNAPSHOT_HEADER header;
+    const SNAPSHOT_HEADER *previous = NULL;
+    uint32_t start = SNAPSHOT_FLASH;
+
+#ifdef DIRTY_PAGES
+    // If memory still matches the last snapshot or delta in flash, only the
+    // pages written since then need saving, as long as they fit
+    if (snapshot_synced && snapshot_records((const SNAPSHOT_HEADER *) SNAPSHOT_FLASH, SNAPSHOT_MAGIC)) {
+        const SNAPSHOT_HEADER *last = (const SNAPSHOT_HEADER *) SNAPSHOT_FLASH;
+        for (const SNAPSHOT_HEADER *next = snapshot_next(last); next; next = snapshot_next(next)) {
+            last = next;
+        }
+        // The room left is unsigned, so check there is space for a header
+        // at all before working out how much comes after it. If there
+        // isn't, this is a full snapshot from the start of the area.
+        uint32_t end = snapshot_end(last);
+        if ((last == snapshot_synced) && (end + sizeof(SNAPSHOT_HEADER) <= SNAPSHOT_FLASH_END)) {
+            uint32_t size = 0;
+            image_save(count_put, &size, 1);
+            if (size <= SNAPSHOT_FLASH_END - sizeof(SNAPSHOT_HEADER) - end) {
+                previous = last;
+                start = end;
+            }
+        }
+    }
+#endif
+
+    writer.adler_a = 1;
+    writer.adler_b = 0;
+    if (previous) {
+        storage_append(&writer.storage, start, SNAPSHOT_FLASH_END, STORAGE_PAGE_END(start));
+    } else {
+        storage_open(&writer.storage, start, SNAPSHOT_FLASH_END);
+    }
+    storage_skip(&writer.storage, sizeof(SNAPSHOT_HEADER));
+    image_save(snapshot_put, &writer, previous != NULL);
+    if (storage_close(&writer.storage)) {
+#ifdef DIRTY_PAGES
+        // Whatever is in flash now, the next save has to be a full one
+        snapshot_synced = NULL;
+#endif
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = previous ? SNAPSHOT_DELTA : SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.header_size = sizeof(SNAPSHOT_HEADER);
+    header.length = writer.storage.address - start - sizeof(SNAPSHOT_HEADER);
+    header.checksum = (writer.adler_b << 16) | writer.adler_a;
+    if (previous) header.previous = header_checksum(previous);
+
+    header.state.clockticks = clockticks6502;
+    save_timer(header.state.timer[0], &riot002.timer);
+    save_timer(header.state.timer[1], &riot003.timer);
+    header.state.pc = pc;
+    header.state.a = a;
+    header.state.x = x;
+    header.state.y = y;
+    header.state.sp = sp;
+    header.state.status = status;
+    header.state.serial_mode = serial_mode;
+    header.state.sst_mode = sst_mode;
+    save_riot(header.state.riot[0], &riot002);
+    save_riot(header.state.riot[1], &riot003);
+    header.state.irq = riot002.timer.irq | riot003.timer.irq;
+
+    if (storage_program(start, &header, sizeof(header))) {
+#ifdef DIRTY_PAGES
+        snapshot_synced = NULL;
+#endif
+        return 0;
+    }
+#ifdef DIRTY_PAGES
+    dirty_clear();
+    snapshot_synced = (const SNAPSHOT_HEADER *) start;
+#endif
+    return sizeof(header) + header.length;
+}
+
+int snapshot_restore() {
+    const SNAPSHOT_HEADER *header = (const SNAPSHOT_HEADER *) SNAPSHOT_FLASH;
+
+    // Make sure the snapshot is whole before changing anything. A delta
+    // that isn't is left out, along with anything after it.
+    if (!snapshot_records(header, SNAPSHOT_MAGIC)) {
+        return 1;
+    }
+    image_clear();
+    for (const SNAPSHOT_HEADER *next = header; next; next = snapshot_next(next)) {
+        if (image_load((const uint8_t *) next + next->header_size, next->length)) {
+            return 1;
+        }
+        header = next;
+    }
+
+    clockticks6502 = header->state.clockticks;
+    restore_timer(&riot002.timer, header->state.timer[0]);
+    restore_timer(&riot003.timer, header->state.timer[1]);
+    pc = header->state.pc;
+    a = header->state.a;
+    x = header->state.x;
+    y = header->state.y;
+    sp = header->state.sp;
+    status = header->state.status;
+    serial_mode = header->state.serial_mode;
+    sst_mode = header->state.sst_mode;
+    restore_riot(&riot002, header->state.riot[0]);
+    restore_riot(&riot003, header->state.riot[1]);
+    riot002.timer.irq = header->state.irq & IRQ_RIOT002;
+    riot003.timer.irq = header->state.irq & IRQ_RIOT003;
+    irq_pending = 0;
+    if (riot002.timer.timeout && riot002.timer.irq) irq_raise(IRQ_RIOT002);
+    if (riot003.timer.timeout && riot003.timer.irq) irq_raise(IRQ_RIOT003);
+
+#ifdef DIRTY_PAGES
+    dirty_clear();
+    snapshot_synced = header;
+#endif
+#ifdef BLOCK_CACHE
+    // Everything the cache decoded may have changed
+    cache_flush();
+#endif
+    return 0;
+}
+#endif
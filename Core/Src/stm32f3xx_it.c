@@ -23,6 +23,8 @@
 #include "stm32f3xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "pcprofile.h"
+#include "trace.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -56,6 +58,9 @@
 /* USER CODE END 0 */
 
 /* External variables --------------------------------------------------------*/
+#ifdef PC_PROFILE
+extern TIM_HandleTypeDef htim2;
+#endif
 
 /* USER CODE BEGIN EV */
 
@@ -85,6 +90,10 @@ void NMI_Handler(void)
 void HardFault_Handler(void)
 {
   /* USER CODE BEGIN HardFault_IRQn 0 */
+#ifdef INSTRUCTION_TRACE
+  // Send out the instructions that led up to the fault
+  trace_dump();
+#endif
 
   /* USER CODE END HardFault_IRQn 0 */
   while (1)
@@ -199,6 +208,21 @@ void SysTick_Handler(void)
 /* please refer to the startup file (startup_stm32f3xx.s).                    */
 /******************************************************************************/
 
+#ifdef PC_PROFILE
+/**
+  * @brief This function handles TIM2 global interrupt.
+  */
+void TIM2_IRQHandler(void)
+{
+  /* USER CODE BEGIN TIM2_IRQn 0 */
+  // The update interrupt is the only one enabled, so skip HAL_TIM_IRQHandler
+  // and its callback dispatch to keep the sample as cheap as possible
+  __HAL_TIM_CLEAR_IT(&htim2, TIM_IT_UPDATE);
+  pc_sample();
+  /* USER CODE END TIM2_IRQn 0 */
+}
+#endif
+
 /* USER CODE BEGIN 1 */
 
 /* USER CODE END 1 */
@@ -0,0 +1,104 @@
+// Writing to the area at the top of flash that the firmware doesn't use.
+// The flash is memory mapped, so reading it back is just a pointer.
+
+#include "main.h"
+#include "storage.h"
+
+#if defined(SNAPSHOT) || defined(TAPE) || defined(BANKED_RAM)
+
+uint32_t storage_erases;
+
+static int storage_erase(uint32_t address) {
+    FLASH_EraseInitTypeDef erase;
+    uint32_t page_error;
+
+    storage_erases++;
+    erase.TypeErase = FLASH_TYPEERASE_PAGES;
+    erase.PageAddress = address;
+    erase.NbPages = 1;
+    return HAL_FLASHEx_Erase(&erase, &page_error) != HAL_OK;
+}
+
+void storage_open(STORAGE_WRITER *writer, uint32_t address, uint32_t end) {
+    writer->address = address;
+    writer->end = end;
+    writer->erased = address & ~(STORAGE_PAGE_SIZE - 1);
+    writer->pending = 0;
+    writer->error = 0;
+
+    HAL_FLASH_Unlock();
+    writer->error = storage_erase(writer->erased);
+    writer->erased += STORAGE_PAGE_SIZE;
+}
+
+void storage_append(STORAGE_WRITER *writer, uint32_t address, uint32_t end, uint32_t erased) {
+    writer->address = address;
+    writer->end = end;
+    writer->erased = erased;
+    writer->pending = 0;
+    writer->error = 0;
+
+    HAL_FLASH_Unlock();
+}
+
+void storage_skip(STORAGE_WRITER *writer, uint32_t len) {
+    writer->address += len;
+    if (writer->address > writer->end) {
+        writer->error = 1;
+    }
+    while (!writer->error && (writer->address > writer->erased)) {
+        writer->error = storage_erase(writer->erased);
+        writer->erased += STORAGE_PAGE_SIZE;
+    }
+}
+
+void storage_put(STORAGE_WRITER *writer, uint8_t b) {
+    if (writer->error) return;
+    if (writer->address >= writer->end) {
+        writer->error = 1;
+        return;
+    }
+    if (writer->address & 1) {
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, writer->address - 1,
+                writer->pending | (b << 8)) != HAL_OK) {
+            writer->error = 1;
+        }
+    } else {
+        if (writer->address >= writer->erased) {
+            writer->error = storage_erase(writer->erased);
+            writer->erased += STORAGE_PAGE_SIZE;
+        }
+        writer->pending = b;
+    }
+    writer->address++;
+}
+
+void storage_write(STORAGE_WRITER *writer, const void *data, uint32_t len) {
+    const uint8_t *p = data;
+    while (len--) {
+        storage_put(writer, *p++);
+    }
+}
+
+int storage_close(STORAGE_WRITER *writer) {
+    if (writer->address & 1) {
+        storage_put(writer, 0xff);
+    }
+    HAL_FLASH_Lock();
+    return writer->error;
+}
+
+int storage_program(uint32_t address, const void *data, uint32_t len) {
+    const uint8_t *p = data;
+    int error = 0;
+
+    HAL_FLASH_Unlock();
+    for (uint32_t i = 0; i < len && !error; i += 2) {
+        uint16_t half = p[i];
+        if (i + 1 < len) half |= p[i + 1] << 8;
+        error = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address + i, half) != HAL_OK;
+    }
+    HAL_FLASH_Lock();
+    return error;
+}
+#endif
@@ -0,0 +1,174 @@
+// A virtual cassette tape in flash, compiled in with TAPE. main.c traps the
+// ROM's DUMPT and LOADT and does what they would to the ROM's variables,
+// and this keeps the files they save, so a dump or load takes a few
+// milliseconds instead of minutes of tones.
+
+#include <stddef.h>
+#include "main.h"
+#include "fake6502.h"
+#include "storage.h"
+#include "tape.h"
+
+#ifdef TAPE
+
+#define TAPE_HALF ((TAPE_FLASH_END - TAPE_FLASH) / 2)
+
+static uint32_t half_start(int half) {
+    return TAPE_FLASH + half * TAPE_HALF;
+}
+
+static int half_valid(int half) {
+    const TAPE_HEADER *header = (const TAPE_HEADER *) half_start(half);
+    return (header->magic == TAPE_MAGIC) && (header->version == TAPE_VERSION);
+}
+
+static uint32_t half_generation(int half) {
+    return ((const TAPE_HEADER *) half_start(half))->generation;
+}
+
+// Returns the half that holds the tape, or -1 if neither does yet
+static int tape_half() {
+    if (half_valid(0) && half_valid(1)) {
+        return half_generation(1) > half_generation(0);
+    }
+    if (half_valid(0)) return 0;
+    if (half_valid(1)) return 1;
+    return -1;
+}
+
+static uint32_t file_size(uint16_t length) {
+    return sizeof(TAPE_FILE) + ((length + 1) & ~1);
+}
+
+// Returns the file at address, or NULL if the tape ends there. A file that
+// was cut short by losing power still takes up its space, but isn't done.
+static const TAPE_FILE *file_at(uint32_t address, uint32_t end) {
+    const TAPE_FILE *file = (const TAPE_FILE *) address;
+
+    if ((address + sizeof(TAPE_FILE) > end) || (file->length == 0xffff) ||
+            (file_size(file->length) > end - address)) {
+        return NULL;
+    }
+    return file;
+}
+
+static const TAPE_FILE *first_file(int half) {
+    return file_at(half_start(half) + sizeof(TAPE_HEADER), half_start(half) + TAPE_HALF);
+}
+
+static const TAPE_FILE *next_file(int half, const TAPE_FILE *file) {
+    return file_at((uintptr_t) file + file_size(file->length), half_start(half) + TAPE_HALF);
+}
+
+// Whether a file is the newest whole one with its ID
+static int newest(int half, const TAPE_FILE *file) {
+    if (file->done) return 0;
+    for (const TAPE_FILE *later = next_file(half, file); later; later = next_file(half, later)) {
+        if (!later->done && (later->id == file->id)) return 0;
+    }
+    return 1;
+}
+
+const TAPE_FILE *tape_find(uint8_t id) {
+    const TAPE_FILE *found = NULL;
+    int half = tape_half();
+
+    if (half < 0) return NULL;
+    for (const TAPE_FILE *file = first_file(half); file; file = next_file(half, file)) {
+        if (!file->done && ((file->id == id) || (id == 0x00) || (id == 0xff))) {
+            found = file;
+        }
+    }
+    return found;
+}
+
+// Writes the start of a new file and dumps its data from memory, leaving
+// the checksum and done erased to be programmed once it is all there.
+// Returns the checksum.
+static uint16_t dump_file(STORAGE_WRITER *writer, const TAPE_FILE *file) {
+    uint16_t checksum = (file->address & 0xff) + (file->address >> 8);
+
+    storage_write(writer, file, offsetof(TAPE_FILE, checksum));
+    storage_skip(writer, sizeof(TAPE_FILE) - offsetof(TAPE_FILE, checksum));
+    for (uint32_t i = 0; i < file->length; i++) {
+        uint8_t b = read6502(file->address + i);
+        checksum += b;
+        storage_put(writer, b);
+    }
+    if (writer->address & 1) {
+        storage_put(writer, 0xff);
+    }
+    return checksum;
+}
+
+// Programs the checksum and done, which come one after the other
+static int finish_file(uint32_t address, uint16_t checksum) {
+    uint16_t tail[2] = { checksum, 0 };
+    return storage_program(address + offsetof(TAPE_FILE, checksum), tail, sizeof(tail));
+}
+
+// Starts a new tape in the other half, with the newest file for each ID
+// other than the one being saved, then the new one
+static const TAPE_FILE *new_tape(int half, const TAPE_FILE *file) {
+    int other = half < 0 ? 0 : half ^ 1;
+    uint32_t start = half_start(other);
+    uint32_t end = start + TAPE_HALF;
+    TAPE_HEADER header;
+    STORAGE_WRITER writer;
+
+    header.magic = TAPE_MAGIC;
+    header.version = TAPE_VERSION;
+    header.reserved = 0;
+    header.generation = half < 0 ? 1 : half_generation(half) + 1;
+
+    storage_open(&writer, start, end);
+    storage_skip(&writer, sizeof(header));
+    if (half >= 0) {
+        for (const TAPE_FILE *old = first_file(half); old; old = next_file(half, old)) {
+            if ((old->id != file->id) && newest(half, old)) {
+                storage_write(&writer, old, file_size(old->length));
+            }
+        }
+    }
+    uint32_t address = writer.address;
+    if (address + file_size(file->length) > end) {
+        storage_close(&writer);
+        return NULL;
+    }
+    uint16_t checksum = dump_file(&writer, file);
+    // Erase the rest, so there is nothing but erased flash after the last file
+    storage_skip(&writer, end - writer.address);
+    if (storage_close(&writer) || finish_file(address, checksum) ||
+            storage_program(start, &header, sizeof(header))) {
+        return NULL;
+    }
+    return (const TAPE_FILE *) address;
+}
+
+const TAPE_FILE *tape_save(uint8_t id, uint16_t address, uint16_t length) {
+    int half = tape_half();
+    TAPE_FILE file;
+    STORAGE_WRITER writer;
+
+    file.length = length;
+    file.address = address;
+    file.id = id;
+    file.reserved = 0;
+    if (file_size(length) > TAPE_HALF - sizeof(TAPE_HEADER)) return NULL;
+    if (half < 0) return new_tape(half, &file);
+
+    // Find the end of the tape, and add the file there if there's room
+    uint32_t end = half_start(half) + TAPE_HALF;
+    uint32_t tail = half_start(half) + sizeof(TAPE_HEADER);
+    for (const TAPE_FILE *old = first_file(half); old; old = next_file(half, old)) {
+        tail = (uintptr_t) old + file_size(old->length);
+    }
+    if (tail + file_size(length) > end) return new_tape(half, &file);
+
+    // new_tape erased the whole half, so nothing after the tail needs it again
+    storage_append(&writer, tail, end, end);
+    uint16_t checksum = dump_file(&writer, &file);
+    if (storage_close(&writer) || finish_file(tail, checksum)) return NULL;
+    return (const TAPE_FILE *) tail;
+}
+#endif
@@ -0,0 +1,111 @@
+// Instruction trace recorder, compiled in with INSTRUCTION_TRACE. While
+// tracing is on, fake6502 dispatches through a table whose entries record
+// the CPU state before running the real handler, and the last TRACE_ENTRIES
+// instructions are kept in a ring buffer in CCM RAM.
+//
+// The dump is delta compressed since most fields don't change from one
+// instruction to the next:
+//   "KTR1"            magic and format version
+//   uint16_t n        number of records that follow, oldest first
+//   n times:
+//     uint8_t flags   TRACE_PC, TRACE_A, ... for the fields that follow
+//     uint16_t pc     if TRACE_PC, otherwise pc is the previous pc plus
+//                     the length of the previous instruction
+//     uint8_t opcode
+//     0-2 operand bytes, depending on the opcode
+//     uint8_t a, x, y, status, sp if their flags are set
+// The first record has every flag set. The tools/tracedump program decodes
+// it into a disassembly listing.
+
+#include "main.h"
+#include "fake6502.h"
+#include "trace.h"
+
+#ifdef INSTRUCTION_TRACE
+
+#define TRACE_PC     0x01
+#define TRACE_A      0x02
+#define TRACE_X      0x04
+#define TRACE_Y      0x08
+#define TRACE_STATUS 0x10
+#define TRACE_SP     0x20
+
+typedef struct TRACE {
+    uint16_t pc;
+    uint8_t opcode;
+    uint8_t operand[2];
+    uint8_t a, x, y, status, sp;
+} TRACE;
+
+TRACE trace_buf[TRACE_ENTRIES] CCMBSS;
+uint32_t trace_head CCMBSS;
+uint32_t trace_count CCMBSS;
+
+// Called with pc already past the opcode
+void trace_record(uint8_t opcode) {
+    TRACE *t = &trace_buf[trace_head];
+    t->pc = pc - 1;
+    t->opcode = opcode;
+    t->operand[0] = read6502(pc);
+    t->operand[1] = read6502(pc + 1);
+    t->a = a;
+    t->x = x;
+    t->y = y;
+    t->status = status;
+    t->sp = sp;
+    trace_head = (trace_head + 1) & (TRACE_ENTRIES - 1);
+    if (trace_count < TRACE_ENTRIES) trace_count++;
+}
+
+// The dump writes straight to the USART so that it still works from the
+// HardFault handler, when the HAL's UART state can't be trusted
+static void trace_putc(uint8_t ch) {
+    while (!(USART1->ISR & USART_ISR_TXE));
+    USART1->TDR = ch;
+}
+
+void trace_dump() {
+    uint32_t count = trace_count;
+    uint32_t pos = (trace_head - count) & (TRACE_ENTRIES - 1);
+    TRACE prev;
+
+    trace_putc('K');
+    trace_putc('T');
+    trace_putc('R');
+    trace_putc('1');
+    trace_putc(count & 0xff);
+    trace_putc(count >> 8);
+
+    for (uint32_t i = 0; i < count; i++) {
+        TRACE *t = &trace_buf[pos];
+        uint8_t flags = 0;
+
+        if ((i == 0) || (t->pc != (uint16_t) (prev.pc + oplength[prev.opcode]))) flags |= TRACE_PC;
+        if ((i == 0) || (t->a != prev.a)) flags |= TRACE_A;
+        if ((i == 0) || (t->x != prev.x)) flags |= TRACE_X;
+        if ((i == 0) || (t->y != prev.y)) flags |= TRACE_Y;
+        if ((i == 0) || (t->status != prev.status)) flags |= TRACE_STATUS;
+        if ((i == 0) || (t->sp != prev.sp)) flags |= TRACE_SP;
+
+        trace_putc(flags);
+        if (flags & TRACE_PC) {
+            trace_putc(t->pc & 0xff);
+            trace_putc(t->pc >> 8);
+        }
+        trace_putc(t->opcode);
+        for (int j = 1; j < oplength[t->opcode]; j++) {
+            trace_putc(t->operand[j - 1]);
+        }
+        if (flags & TRACE_A) trace_putc(t->a);
+        if (flags & TRACE_X) trace_putc(t->x);
+        if (flags & TRACE_Y) trace_putc(t->y);
+        if (flags & TRACE_STATUS) trace_putc(t->status);
+        if (flags & TRACE_SP) trace_putc(t->sp);
+
+        prev = *t;
+        pos = (pos + 1) & (TRACE_ENTRIES - 1);
+    }
+    while (!(USART1->ISR & USART_ISR_TC));
+}
+
+#endif
@@ -0,0 +1,306 @@
+// The 6522 VIA, compiled in with VIA. update_timer has to be called for
+// every step to keep the RIOT timers going, which is fine for two of them
+// but adds up. The VIA's timers are just the cycle they were started on,
+// so nothing happens between accesses unless an interrupt flag is due,
+// and via_event tells the main loop when that is.
+//
+// The VIA sees clockticks6502 as it was at the start of the instruction
+// that reads or writes it, since fake6502 adds the instruction's cycles
+// after running it.
+
+#include "main.h"
+#include "fake6502.h"
+#include "irq.h"
+#include "via.h"
+
+#ifdef VIA
+
+// Far enough ahead that nothing is due, but near enough that clockticks6502
+// can't wrap past it
+#define VIA_IDLE 0x40000000UL
+
+uint32_t via_event;
+
+static uint8_t orb, ora, ddrb, ddra, acr, pcr, ifr, ier;
+
+// T1 counts down from t1_value starting on cycle t1_start, so it reads
+// t1_value - (clockticks6502 - t1_start). It sets its flag one cycle after
+// it reaches 0, and when it runs free it shows FFFF for that cycle and
+// then reloads from the latch, so each period is 2 cycles longer than the
+// latch. In one shot it just carries on counting down.
+static uint16_t t1_latch;
+static uint16_t t1_value;
+static uint32_t t1_start;
+static uint8_t t1_armed;
+
+// T2 is the same, but only ever one shot, and only its low latch is kept
+static uint8_t t2_latch;
+static uint16_t t2_value;
+static uint32_t t2_start;
+static uint8_t t2_armed;
+
+// The shift register is sr_base shifted one bit every sr_rate cycles from
+// sr_start
+static uint8_t sr, sr_base;
+static uint32_t sr_start;
+static uint32_t sr_rate;
+static uint8_t sr_shifting;
+
+static uint16_t t1_counter() {
+    uint32_t elapsed = clockticks6502 - t1_start;
+    // The cycle before a free running T1 reloads, which sync has already
+    // moved t1_start past
+    if (elapsed == 0xffffffffUL) return 0xffff;
+    return t1_value - elapsed;
+}
+
+static uint16_t t2_counter() {
+    if (acr & VIA_T2_COUNT) return t2_value;
+    return t2_value - (clockticks6502 - t2_start);
+}
+
+static uint8_t sr_mode() {
+    return (acr & VIA_SR_MODE) >> 2;
+}
+
+// Only the modes shifting under T2 or the clock go anywhere, with nothing
+// on CB1
+static int sr_runs() {
+    uint8_t mode = sr_mode();
+    return mode && (mode != 3) && (mode != 7);
+}
+
+static void update_irq() {
+    if (ifr & ier & 0x7f) {
+        if (!(irq_pending & IRQ_VIA)) irq_raise(IRQ_VIA);
+    } else {
+        irq_lower(IRQ_VIA);
+    }
+}
+
+// Sets the flags that are due, and moves a free running T1 on to the
+// period it is in now
+static void sync() {
+    uint32_t now = clockticks6502;
+
+    // Signed, because a free running T1 starts again the cycle after this
+    if (t1_armed && ((int32_t) (now - t1_start) > t1_value)) {
+        ifr |= VIA_IRQ_T1;
+        if (acr & VIA_T1_FREE_RUN) {
+            // There may have been several periods since the last look
+            uint32_t elapsed = now - t1_start - (t1_value + 1);
+            uint32_t period = t1_latch + 2;
+            t1_start += t1_value + 2 + (elapsed / period) * period;
+            t1_value = t1_latch;
+        } else {
+            t1_armed = 0;
+        }
+    }
+
+    if (t2_armed && !(acr & VIA_T2_COUNT) && (now - t2_start > t2_value)) {
+        ifr |= VIA_IRQ_T2;
+        t2_armed = 0;
+    }
+
+    if (sr_shifting) {
+        uint32_t shifts = (now - sr_start) / sr_rate;
+        if (sr_mode() == 4) {
+            // Free running, which never stops
+            shifts &= 7;
+        } else if (shifts >= 8) {
+            shifts = 8;
+            sr_shifting = 0;
+            ifr |= VIA_IRQ_SR;
+        }
+        if (sr_mode() & 4) {
+            // Shifting out goes round in a circle
+            sr = (uint8_t) (sr_base << shifts) | (sr_base >> (8 - shifts));
+        } else {
+            // Shifting in brings in 1s from CB2, which is left floating
+            sr = (uint8_t) (sr_base << shifts) | (0xff >> (8 - shifts));
+        }
+    }
+}
+
+// Works out when the next flag is due, once sync has caught up
+static void schedule() {
+    uint32_t now = clockticks6502;
+    uint32_t next = VIA_IDLE;
+
+    if (t1_armed && (t1_start + t1_value + 1 - now < next)) {
+        next = t1_start + t1_value + 1 - now;
+    }
+    if (t2_armed && !(acr & VIA_T2_COUNT) && (t2_start + t2_value + 1 - now < next)) {
+        next = t2_start + t2_value + 1 - now;
+    }
+    if (sr_shifting && (sr_mode() != 4) && (sr_start + 8 * sr_rate - now < next)) {
+        next = sr_start + 8 * sr_rate - now;
+    }
+    via_event = now + next;
+    update_irq();
+}
+
+static void start_shift() {
+    ifr &= ~VIA_IRQ_SR;
+    sr_shifting = sr_runs();
+    if (!sr_shifting) return;
+    sr_base = sr;
+    sr_start = clockticks6502;
+    // A bit takes two edges on CB1, which the clock or T2 toggles
+    sr_rate = ((sr_mode() & 3) == 2) ? 2 : 2 * (t2_latch + 2);
+}
+
+static uint8_t port(uint8_t out, uint8_t ddr) {
+    return (out & ddr) | ~ddr;
+}
+
+void via_reset() {
+    // Like the RES pin, which leaves the timers and shift register alone
+    sync();
+    orb = ora = ddrb = ddra = acr = pcr = ifr = ier = 0;
+    sr_shifting = 0;
+    schedule();
+}
+
+void via_update() {
+    sync();
+    schedule();
+}
+
+uint8_t via_read(uint16_t address) {
+    uint8_t value;
+
+    sync();
+    switch (address & 0x0f) {
+    case VIA_ORB:
+        value = port(orb, ddrb);
+        break;
+    case VIA_ORA:
+    case VIA_ORA_NH:
+        value = port(ora, ddra);
+        break;
+    case VIA_DDRB:
+        value = ddrb;
+        break;
+    case VIA_DDRA:
+        value = ddra;
+        break;
+    case VIA_T1CL:
+        value = t1_counter();
+        ifr &= ~VIA_IRQ_T1;
+        break;
+    case VIA_T1CH:
+        value = t1_counter() >> 8;
+        break;
+    case VIA_T1LL:
+        value = t1_latch;
+        break;
+    case VIA_T1LH:
+        value = t1_latch >> 8;
+        break;
+    case VIA_T2CL:
+        value = t2_counter();
+        ifr &= ~VIA_IRQ_T2;
+        break;
+    case VIA_T2CH:
+        value = t2_counter() >> 8;
+        break;
+    case VIA_SR:
+        value = sr;
+        start_shift();
+        break;
+    case VIA_ACR:
+        value = acr;
+        break;
+    case VIA_PCR:
+        value = pcr;
+        break;
+    case VIA_IFR:
+        value = ifr | ((ifr & ier & 0x7f) ? VIA_IRQ_ANY : 0);
+        break;
+    default:
+        value = ier | 0x80;
+        break;
+    }
+    schedule();
+    return value;
+}
+
+void via_write(uint16_t address, uint8_t value) {
+    sync();
+    switch (address & 0x0f) {
+    case VIA_ORB:
+        orb = value;
+        break;
+    case VIA_ORA:
+    case VIA_ORA_NH:
+        ora = value;
+        break;
+    case VIA_DDRB:
+        ddrb = value;
+        break;
+    case VIA_DDRA:
+        ddra = value;
+        break;
+    case VIA_T1CL:
+    case VIA_T1LL:
+        t1_latch = (t1_latch & 0xff00) | value;
+        break;
+    case VIA_T1CH:
+        t1_latch = (t1_latch & 0x00ff) | (value << 8);
+        t1_value = t1_latch;
+        t1_start = clockticks6502;
+        t1_armed = 1;
+        ifr &= ~VIA_IRQ_T1;
+        break;
+    case VIA_T1LH:
+        t1_latch = (t1_latch & 0x00ff) | (value << 8);
+        ifr &= ~VIA_IRQ_T1;
+        break;
+    case VIA_T2CL:
+        t2_latch = value;
+        break;
+    case VIA_T2CH:
+        t2_value = (value << 8) | t2_latch;
+        t2_start = clockticks6502;
+        t2_armed = 1;
+        ifr &= ~VIA_IRQ_T2;
+        break;
+    case VIA_SR:
+        sr = value;
+        start_shift();
+        break;
+    case VIA_ACR:
+        // T2 stops counting down while it counts pulses, so start it again
+        // from where it is now
+        if ((acr ^ value) & VIA_T2_COUNT) {
+            t2_value = t2_counter();
+            t2_start = clockticks6502;
+        }
+        // A free running T1 interrupts every time round, even after a one
+        // shot has run out
+        if ((value & VIA_T1_FREE_RUN) && !t1_armed) {
+            t1_value = t1_counter();
+            t1_start = clockticks6502;
+            t1_armed = 1;
+        }
+        acr = value;
+        if (sr_shifting && !sr_runs()) sr_shifting = 0;
+        break;
+    case VIA_PCR:
+        pcr = value;
+        break;
+    case VIA_IFR:
+        ifr &= ~value;
+        break;
+    case VIA_IER:
+        if (value & 0x80) {
+            ier |= value & 0x7f;
+        } else {
+            ier &= ~value;
+        }
+        break;
+    }
+    schedule();
+}
+#endif
@@ -0,0 +1,357 @@
+; Math routines for kim1-blackpill, each one twice with the same
+; interface: once in plain 6502 code, and once handing the work to the
+; math coprocessor of a COPROCESSOR build (see Core/Inc/coproc.h).
+; Copy whichever you need into your own program.
+;
+; Going to 0200 runs a benchmark with the 6502 versions and 0203 runs it
+; with the coprocessor ones. Each does a thousand multiplies, divides and
+; BCD conversions and a CRC of the monitor ROM, then goes back to the
+; monitor showing a sum of all the results, which should come out the
+; same both ways.
+
+        .org $0200
+
+; Zero page
+NUM1    = $D0           ; first operand, 2 bytes
+NUM2    = $D2           ; second operand, 2 bytes
+RESULT  = $D4           ; result, 4 bytes
+TEMP    = $D8           ; scratch for the 6502 versions, 4 bytes
+MULV    = $C0           ; the versions the benchmark calls
+DIVV    = $C2
+BCDV    = $C4
+CRCV    = $C6
+COUNT   = $C8
+SUM     = $CA
+
+; Coprocessor registers and commands
+CP_A    = $1400
+CP_B    = $1404
+CP_R    = $1408
+CP_CMD  = $1410
+MUL16   = 1
+DIV16   = 3
+BIN2BCD = 6
+CRC16   = 8
+
+; Monitor
+POINTL  = $FA
+POINTH  = $FB
+START   = $1C4F
+
+        JMP BENCH
+        LDX #7                  ; copy the coprocessor vectors
+        BNE BENCH1
+BENCH:  LDX #15                 ; or the 6502 ones
+BENCH1: LDY #7
+VCOPY:  LDA VECTORS,X
+        STA MULV,Y
+        DEX
+        DEY
+        BPL VCOPY
+
+        LDA #0
+        STA SUM
+        STA SUM+1
+        LDA #<1000
+        STA COUNT
+        LDA #>1000
+        STA COUNT+1
+
+LOOP:   LDA COUNT               ; NUM1 = COUNT ^ $9E37
+        EOR #$37
+        STA NUM1
+        LDA COUNT+1
+        EOR #$9E
+        STA NUM1+1
+        LDA COUNT               ; NUM2 = COUNT | $21, never 0
+        ORA #$21
+        STA NUM2
+        LDA COUNT+1
+        STA NUM2+1
+        JSR CALLMUL
+        JSR ADDSUM
+        JSR CALLDIV
+        JSR ADDSUM
+        JSR CALLBCD
+        JSR ADDSUM
+        LDA COUNT
+        BNE LOOP1
+        DEC COUNT+1
+LOOP1:  DEC COUNT
+        LDA COUNT
+        ORA COUNT+1
+        BNE LOOP
+
+        LDA #$00                ; CRC of 1C00-1FFF
+        STA NUM1
+        STA RESULT
+        STA RESULT+1
+        STA RESULT+2
+        STA RESULT+3
+        STA NUM2
+        LDA #$1C
+        STA NUM1+1
+        LDA #$04
+        STA NUM2+1
+        JSR CALLCRC
+        JSR ADDSUM
+
+        LDA SUM
+        STA POINTL
+        LDA SUM+1
+        STA POINTH
+        JMP START
+
+CALLMUL: JMP (MULV)
+CALLDIV: JMP (DIVV)
+CALLBCD: JMP (BCDV)
+CALLCRC: JMP (CRCV)
+
+; SUM += both halves of RESULT
+ADDSUM: CLC
+        LDA SUM
+        ADC RESULT
+        STA SUM
+        LDA SUM+1
+        ADC RESULT+1
+        STA SUM+1
+        CLC
+        LDA SUM
+        ADC RESULT+2
+        STA SUM
+        LDA SUM+1
+        ADC RESULT+3
+        STA SUM+1
+        RTS
+
+VECTORS: .word CMUL16, CDIV16, CBCD16, CCRC16
+        .word SMUL16, SDIV16, SBCD16, SCRC16
+
+; RESULT (4 bytes) = NUM1 * NUM2
+SMUL16: LDA #0
+        STA RESULT+2
+        STA RESULT+3
+        LDA NUM1
+        STA RESULT
+        LDA NUM1+1
+        STA RESULT+1
+        LDX #16
+        LSR RESULT+1
+        ROR RESULT
+SMUL1:  BCC SMUL2
+        CLC
+        LDA RESULT+2
+        ADC NUM2
+        STA RESULT+2
+        LDA RESULT+3
+        ADC NUM2+1
+        STA RESULT+3
+SMUL2:  ROR RESULT+3
+        ROR RESULT+2
+        ROR RESULT+1
+        ROR RESULT
+        DEX
+        BNE SMUL1
+        RTS
+
+CMUL16: LDA NUM1
+        STA CP_A
+        LDA NUM1+1
+        STA CP_A+1
+        LDA NUM2
+        STA CP_B
+        LDA NUM2+1
+        STA CP_B+1
+        LDA #MUL16
+        STA CP_CMD
+        LDA CP_R
+        STA RESULT
+        LDA CP_R+1
+        STA RESULT+1
+        LDA CP_R+2
+        STA RESULT+2
+        LDA CP_R+3
+        STA RESULT+3
+        RTS
+
+; RESULT (2 bytes) = NUM1 / NUM2, RESULT+2 (2 bytes) = the remainder.
+; NUM2 mustn't be 0.
+SDIV16: LDA #0
+        STA RESULT+2
+        STA RESULT+3
+        LDA NUM1
+        STA RESULT
+        LDA NUM1+1
+        STA RESULT+1
+        LDX #16
+SDIV1:  ASL RESULT
+        ROL RESULT+1
+        ROL RESULT+2
+        ROL RESULT+3
+        LDA RESULT+2
+        BCS SDIV2               ; 17 bits, so more than NUM2
+        CMP NUM2
+        LDA RESULT+3
+        SBC NUM2+1
+        BCC SDIV3
+        LDA RESULT+2
+SDIV2:  SBC NUM2
+        STA RESULT+2
+        LDA RESULT+3
+        SBC NUM2+1
+        STA RESULT+3
+        INC RESULT
+SDIV3:  DEX
+        BNE SDIV1
+        RTS
+
+CDIV16: LDA NUM1
+        STA CP_A
+        LDA NUM1+1
+        STA CP_A+1
+        LDA NUM2
+        STA CP_B
+        LDA NUM2+1
+        STA CP_B+1
+        LDA #DIV16
+        STA CP_CMD
+        LDA CP_R
+        STA RESULT
+        LDA CP_R+1
+        STA RESULT+1
+        LDA CP_R+4
+        STA RESULT+2
+        LDA CP_R+5
+        STA RESULT+3
+        RTS
+
+; RESULT (3 bytes) = NUM1 as 5 BCD digits, lowest two first. RESULT+3 = 0.
+; fake6502 leaves out decimal mode, so this counts off powers of ten
+; rather than adding with SED.
+SBCD16: LDA NUM1
+        STA TEMP
+        LDA NUM1+1
+        STA TEMP+1
+        LDX #0
+        JSR DIGIT
+        STY RESULT+2
+        JSR DIGIT
+        TYA
+        ASL A
+        ASL A
+        ASL A
+        ASL A
+        STA RESULT+1
+        JSR DIGIT
+        TYA
+        ORA RESULT+1
+        STA RESULT+1
+        JSR DIGIT
+        TYA
+        ASL A
+        ASL A
+        ASL A
+        ASL A
+        ORA TEMP
+        STA RESULT
+        LDA #0
+        STA RESULT+3
+        RTS
+
+; Y = how many times power of ten X goes into TEMP, taking them off it,
+; and X moves on to the next one
+DIGIT:  LDY #0
+DIGIT1: LDA TEMP
+        SEC
+        SBC POWLO,X
+        STA TEMP+2
+        LDA TEMP+1
+        SBC POWHI,X
+        BCC DIGIT2
+        STA TEMP+1
+        LDA TEMP+2
+        STA TEMP
+        INY
+        BNE DIGIT1
+DIGIT2: INX
+        RTS
+
+POWLO:  .byte <10000, <1000, <100, <10
+POWHI:  .byte >10000, >1000, >100, >10
+
+CBCD16: LDA NUM1
+        STA CP_A
+        LDA NUM1+1
+        STA CP_A+1
+        LDA #0
+        STA CP_A+2
+        STA CP_A+3
+        STA RESULT+3
+        LDA #BIN2BCD
+        STA CP_CMD
+        LDA CP_R
+        STA RESULT
+        LDA CP_R+1
+        STA RESULT+1
+        LDA CP_R+2
+        STA RESULT+2
+        RTS
+
+; RESULT (2 bytes) = the CRC-16/XMODEM of NUM2 bytes at NUM1, carrying on
+; from RESULT, which starts at 0
+SCRC16: LDA NUM1
+        STA TEMP
+        LDA NUM1+1
+        STA TEMP+1
+        LDA NUM2
+        STA TEMP+2
+        LDA NUM2+1
+        STA TEMP+3
+        LDY #0
+SCRC1:  LDA TEMP+2
+        ORA TEMP+3
+        BEQ SCRC5
+        LDA (TEMP),Y
+        EOR RESULT+1
+        STA RESULT+1
+        LDX #8
+SCRC2:  ASL RESULT
+        ROL RESULT+1
+        BCC SCRC3
+        LDA RESULT+1
+        EOR #$10
+        STA RESULT+1
+        LDA RESULT
+        EOR #$21
+        STA RESULT
+SCRC3:  DEX
+        BNE SCRC2
+        INC TEMP
+        BNE SCRC4
+        INC TEMP+1
+SCRC4:  LDA TEMP+2
+        BNE SCRC6
+        DEC TEMP+3
+SCRC6:  DEC TEMP+2
+        JMP SCRC1
+SCRC5:  RTS
+
+CCRC16: LDA NUM1
+        STA CP_A
+        LDA NUM1+1
+        STA CP_A+1
+        LDA NUM2
+        STA CP_B
+        LDA NUM2+1
+        STA CP_B+1
+        LDA RESULT
+        STA CP_R
+        LDA RESULT+1
+        STA CP_R+1
+        LDA #CRC16
+        STA CP_CMD
+        LDA CP_R
+        STA RESULT
+        LDA CP_R+1
+        STA RESULT+1
+        RTS
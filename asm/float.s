@@ -0,0 +1,506 @@
+; A benchmark for the floating point unit of a FLOAT_ACCEL build (see
+; Core/Inc/floataccel.h), in the shape of a BASIC loop:
+;
+;       X = 0
+;       FOR I = 1 TO 200: T = I * I: X = X + T: X = X - T / I: NEXT
+;
+; The numbers are Microsoft BASIC's, with the FAC and ARG laid out the way
+; BASIC has them, and it loads and stores them with routines like BASIC's
+; own. Only the arithmetic changes, the same as when BASIC's FADDT, FSUBT,
+; FMULTT and FDIVT are patched with a JMP to the unit, so the difference
+; is what patching BASIC would save.
+;
+; Going to 0200 does the arithmetic with the 6502 routines here, which
+; work the way BASIC's do, a bit at a time. 0203 hands it to the unit.
+; Both go back to the monitor showing 9622, the first two bytes of X
+; packed, which is 2666600.
+
+        .org $0200
+
+; Zero page, BASIC's layout from FAC
+FAC     = $B0           ; exponent, then 4 bytes of mantissa
+FACSIGN = $B5
+ARG     = $B8
+ARGSIGN = $BD
+FACEXT  = $BF           ; the mantissa's fifth byte
+RES     = $C0           ; 5 bytes, a product or quotient being built
+DIVD    = $C5           ; 5 bytes, what's left of the dividend
+TEMP    = $CA           ; 3 bytes
+AEXT    = $CD           ; ARG's fifth byte while it is shifted to add
+PTR     = $CE           ; 2 bytes
+ADDV    = $D0           ; the versions the benchmark calls
+SUBV    = $D2
+MULV    = $D4
+DIVV    = $D6
+COUNT   = $D8
+
+; Floating point unit
+FP_FAC  = $1600
+FP_ADD  = $1681         ; the traps, which return with RTS
+FP_SUB  = $1682
+FP_MUL  = $1683
+FP_DIV  = $1684
+
+; Monitor
+POINTL  = $FA
+POINTH  = $FB
+START   = $1C4F
+
+        JMP BENCH
+        LDX #7                  ; copy the unit's vectors
+        BNE BENCH1
+BENCH:  LDX #15                 ; or the 6502 ones
+BENCH1: LDY #7
+VCOPY:  LDA VECTORS,X
+        STA ADDV,Y
+        DEX
+        DEY
+        BPL VCOPY
+
+        LDA #FAC                ; tell the unit where the FAC is
+        STA FP_FAC
+        LDA #0
+        STA FP_FAC+1
+
+        LDA #<ZERO              ; X = 0
+        LDY #>ZERO
+        JSR LOADFAC
+        LDA #<XV
+        LDY #>XV
+        JSR STORE
+        LDA #<ONE               ; I = 1
+        LDY #>ONE
+        JSR LOADFAC
+        LDA #<IV
+        LDY #>IV
+        JSR STORE
+        LDA #200
+        STA COUNT
+
+LOOP:   LDA #<IV                ; T = I * I
+        LDY #>IV
+        JSR LOADARG
+        LDA #<IV
+        LDY #>IV
+        JSR LOADFAC
+        JSR CALLMUL
+        LDA #<TV
+        LDY #>TV
+        JSR STORE
+        LDA #<XV                ; X = X + T
+        LDY #>XV
+        JSR LOADARG
+        JSR CALLADD
+        LDA #<XV
+        LDY #>XV
+        JSR STORE
+        LDA #<TV                ; X = X - T / I
+        LDY #>TV
+        JSR LOADARG
+        LDA #<IV
+        LDY #>IV
+        JSR LOADFAC
+        JSR CALLDIV
+        LDA #<XV
+        LDY #>XV
+        JSR LOADARG
+        JSR CALLSUB
+        LDA #<XV
+        LDY #>XV
+        JSR STORE
+        LDA #<ONE               ; I = I + 1
+        LDY #>ONE
+        JSR LOADARG
+        LDA #<IV
+        LDY #>IV
+        JSR LOADFAC
+        JSR CALLADD
+        LDA #<IV
+        LDY #>IV
+        JSR STORE
+        DEC COUNT
+        BNE LOOP
+
+        LDA XV
+        STA POINTH
+        LDA XV+1
+        STA POINTL
+        JMP START
+
+CALLADD: JMP (ADDV)
+CALLSUB: JMP (SUBV)
+CALLMUL: JMP (MULV)
+CALLDIV: JMP (DIVV)
+
+VECTORS: .word FP_ADD, FP_SUB, FP_MUL, FP_DIV
+        .word SADD, SSUB, SMUL, SDIV
+
+ZERO:   .byte $00, $00, $00, $00, $00
+ONE:    .byte $81, $00, $00, $00, $00
+XV:     .byte 0, 0, 0, 0, 0
+IV:     .byte 0, 0, 0, 0, 0
+TV:     .byte 0, 0, 0, 0, 0
+
+; ARG = the packed number at Y,A
+LOADARG: STA PTR
+        STY PTR+1
+        LDY #4
+LDARG1: LDA (PTR),Y
+        STA ARG,Y
+        DEY
+        BPL LDARG1
+        LDA ARG+1
+        STA ARGSIGN
+        ORA #$80
+        STA ARG+1
+        RTS
+
+; FAC = the packed number at Y,A
+LOADFAC: STA PTR
+        STY PTR+1
+        LDY #4
+LDFAC1: LDA (PTR),Y
+        STA FAC,Y
+        DEY
+        BPL LDFAC1
+        LDA FAC+1
+        STA FACSIGN
+        ORA #$80
+        STA FAC+1
+        LDA #0
+        STA FACEXT
+        RTS
+
+; The packed number at Y,A = the FAC, rounded with FACEXT
+STORE:  STA PTR
+        STY PTR+1
+        LDA FACEXT
+        BPL STORE2
+        LDX #4
+STORE1: INC FAC,X
+        BNE STORE2
+        DEX
+        BNE STORE1
+        LDA #$80
+        STA FAC+1
+        INC FAC
+STORE2: LDA #0
+        STA FACEXT
+        LDY #4
+STORE3: LDA FAC,Y
+        STA (PTR),Y
+        DEY
+        BNE STORE3
+        LDA FAC+1
+        EOR FACSIGN
+        AND #$7F
+        EOR FACSIGN
+        INY
+        STA (PTR),Y
+        LDA FAC
+        DEY
+        STA (PTR),Y
+        RTS
+
+; The 6502 versions, which like BASIC's throw away anything below FACEXT
+; rather than rounding. They don't check for overflow, which the
+; benchmark doesn't need, and stop with BRK instead.
+
+; FAC = ARG - FAC
+SSUB:   LDA FACSIGN
+        EOR #$FF
+        STA FACSIGN
+
+; FAC = ARG + FAC
+SADD:   LDA ARG
+        BEQ ADDRTS              ; ARG is 0
+        LDA FAC
+        BNE ADD1
+        LDX #5                  ; FAC is 0, so it's ARG
+ACOPY:  LDA ARG,X
+        STA FAC,X
+        DEX
+        BPL ACOPY
+        LDA #0
+        STA FACEXT
+ADDRTS: RTS
+ADD1:   SEC                     ; the FAC has to be the bigger one
+        SBC ARG
+        BCS ADD2
+        LDX #5
+SWAP:   LDA FAC,X
+        LDY ARG,X
+        STA ARG,X
+        STY FAC,X
+        DEX
+        BPL SWAP
+        LDA #0
+        STA FACEXT
+        LDA FAC
+        SEC
+        SBC ARG
+ADD2:   LDY #0                  ; shift ARG right by A bits
+        STY AEXT
+ADD3:   CMP #8
+        BCC ADD4
+        CMP #40
+        BCS ADDRTS              ; too small to matter
+        SBC #7                  ; less 8, with the carry clear
+        LDX ARG+4
+        STX AEXT
+        LDX ARG+3
+        STX ARG+4
+        LDX ARG+2
+        STX ARG+3
+        LDX ARG+1
+        STX ARG+2
+        LDX #0
+        STX ARG+1
+        BEQ ADD3
+ADD4:   TAX
+        BEQ ADD6
+ADD5:   LSR ARG+1
+        ROR ARG+2
+        ROR ARG+3
+        ROR ARG+4
+        ROR AEXT
+        DEX
+        BNE ADD5
+ADD6:   LDA FACSIGN
+        EOR ARGSIGN
+        BMI ADD7
+        CLC                     ; the same sign, so add
+        LDA FACEXT
+        ADC AEXT
+        STA FACEXT
+        LDA FAC+4
+        ADC ARG+4
+        STA FAC+4
+        LDA FAC+3
+        ADC ARG+3
+        STA FAC+3
+        LDA FAC+2
+        ADC ARG+2
+        STA FAC+2
+        LDA FAC+1
+        ADC ARG+1
+        STA FAC+1
+        BCC ADD8
+        ROR FAC+1
+        ROR FAC+2
+        ROR FAC+3
+        ROR FAC+4
+        ROR FACEXT
+        INC FAC
+        BEQ ADD9
+ADD8:   RTS
+ADD9:   BRK
+ADD7:   SEC                     ; different signs, so subtract
+        LDA FACEXT
+        SBC AEXT
+        STA FACEXT
+        LDA FAC+4
+        SBC ARG+4
+        STA FAC+4
+        LDA FAC+3
+        SBC ARG+3
+        STA FAC+3
+        LDA FAC+2
+        SBC ARG+2
+        STA FAC+2
+        LDA FAC+1
+        SBC ARG+1
+        STA FAC+1
+        BCS NORM
+        SEC                     ; ARG was bigger, so negate
+        LDA #0
+        SBC FACEXT
+        STA FACEXT
+        LDX #4
+NEG1:   LDA #0
+        SBC FAC,X
+        STA FAC,X
+        DEX
+        BNE NEG1
+        LDA FACSIGN
+        EOR #$FF
+        STA FACSIGN
+
+; Shifts the FAC left until the top bit of the mantissa is set
+NORM:   LDA FAC+1
+        ORA FAC+2
+        ORA FAC+3
+        ORA FAC+4
+        ORA FACEXT
+        BEQ ZEROFAC
+NORM1:  LDA FAC+1
+        BMI NORM2
+        ASL FACEXT
+        ROL FAC+4
+        ROL FAC+3
+        ROL FAC+2
+        ROL FAC+1
+        DEC FAC
+        BNE NORM1
+ZEROFAC: LDA #0
+        STA FAC
+NORM2:  RTS
+
+; FAC = ARG * FAC
+SMUL:   LDA FAC
+        BEQ MULRTS              ; FAC is 0
+        LDA ARG
+        BNE MUL1
+        STA FAC                 ; ARG is 0
+MULRTS: RTS
+MUL1:   CLC                     ; the exponents add, less 128
+        ADC FAC
+        BCS MUL2
+        SBC #$7F
+        BCC ZEROFAC
+        BEQ ZEROFAC
+        BCS MUL3
+MUL2:   ADC #$7F
+        BCC MUL3
+        BRK
+MUL3:   STA FAC
+        LDA FACSIGN
+        EOR ARGSIGN
+        STA FACSIGN
+        LDA #0
+        STA RES
+        STA RES+1
+        STA RES+2
+        STA RES+3
+        STA RES+4
+        LDX #4                  ; a byte of the FAC at a time, lowest first
+MUL4:   LDA FAC,X
+        BNE MUL5
+        LDA RES+3               ; all 0, so just shift a byte
+        STA RES+4
+        LDA RES+2
+        STA RES+3
+        LDA RES+1
+        STA RES+2
+        LDA RES
+        STA RES+1
+        LDA #0
+        STA RES
+        BEQ MUL8
+MUL5:   LSR A
+        ORA #$80                ; a 1 to stop after eight bits
+MUL6:   TAY
+        BCC MUL7
+        CLC
+        LDA RES+3
+        ADC ARG+4
+        STA RES+3
+        LDA RES+2
+        ADC ARG+3
+        STA RES+2
+        LDA RES+1
+        ADC ARG+2
+        STA RES+1
+        LDA RES
+        ADC ARG+1
+        STA RES
+MUL7:   ROR RES
+        ROR RES+1
+        ROR RES+2
+        ROR RES+3
+        ROR RES+4
+        TYA
+        LSR A
+        BNE MUL6
+MUL8:   DEX
+        BNE MUL4
+        JMP RESULT
+
+; FAC = ARG / FAC
+SDIV:   LDA FAC
+        BNE DIV1
+        BRK                     ; dividing by 0
+DIV1:   LDA ARG
+        BNE DIV2
+        STA FAC                 ; ARG is 0
+        RTS
+DIV2:   SEC                     ; the exponents subtract, plus 129
+        SBC FAC
+        BCC DIV3
+        ADC #$80
+        BCC DIV4
+        BRK
+DIV3:   ADC #$81
+        BCC TOOSMALL
+        BNE DIV4
+TOOSMALL: JMP ZEROFAC           ; too small
+DIV4:   STA FAC
+        LDA FACSIGN
+        EOR ARGSIGN
+        STA FACSIGN
+        LDA #0
+        STA DIVD
+        LDA ARG+1
+        STA DIVD+1
+        LDA ARG+2
+        STA DIVD+2
+        LDA ARG+3
+        STA DIVD+3
+        LDA ARG+4
+        STA DIVD+4
+        LDX #40                 ; a bit of the quotient each time round
+DIV5:   SEC
+        LDA DIVD+4
+        SBC FAC+4
+        STA TEMP+2
+        LDA DIVD+3
+        SBC FAC+3
+        STA TEMP+1
+        LDA DIVD+2
+        SBC FAC+2
+        STA TEMP
+        LDA DIVD+1
+        SBC FAC+1
+        TAY
+        LDA DIVD
+        SBC #0
+        BCC DIV6                ; it doesn't go
+        STA DIVD
+        STY DIVD+1
+        LDA TEMP
+        STA DIVD+2
+        LDA TEMP+1
+        STA DIVD+3
+        LDA TEMP+2
+        STA DIVD+4
+DIV6:   ROL RES+4
+        ROL RES+3
+        ROL RES+2
+        ROL RES+1
+        ROL RES
+        ASL DIVD+4
+        ROL DIVD+3
+        ROL DIVD+2
+        ROL DIVD+1
+        ROL DIVD
+        DEX
+        BNE DIV5
+
+; The FAC's mantissa = RES, shifted left a bit if the top one isn't set
+RESULT: LDA RES
+        BMI RESULT1
+        ASL RES+4
+        ROL RES+3
+        ROL RES+2
+        ROL RES+1
+        ROL RES
+        DEC FAC
+        BEQ TOOSMALL
+RESULT1: LDX #3
+RESULT2: LDA RES,X
+        STA FAC+1,X
+        DEX
+        BPL RESULT2
+        LDA RES+4
+        STA FACEXT
+        RTS
@@ -0,0 +1,37 @@
+# Builds the firmware as Release and as MinSizeRel, each with and without
+# LTO, and prints how big each one is, so you can weigh the flash each costs
+# against how fast it runs. Speed needs the board, so build with BENCHMARK on
+# and compare the control-B numbers for the loops in the README. Run from
+# the top directory with
+#   cmake -P build_report.cmake
+# and put any other options every build should have in OPTIONS, such as
+#   cmake -DOPTIONS="-DBENCHMARK=ON;-DEXPANDED_RAM=ON" -P build_report.cmake
+# Each build is left in build-report, ready to flash.
+
+if (NOT SIZE)
+    set(SIZE arm-none-eabi-size)
+endif ()
+
+set(report "")
+foreach (type Release MinSizeRel)
+    foreach (lto OFF ON)
+        set(dir ${CMAKE_CURRENT_LIST_DIR}/build-report/${type}-lto-${lto})
+        execute_process(COMMAND ${CMAKE_COMMAND} -S ${CMAKE_CURRENT_LIST_DIR} -B ${dir}
+                -DCMAKE_BUILD_TYPE=${type} -DLTO=${lto} ${OPTIONS}
+                OUTPUT_QUIET RESULT_VARIABLE failed)
+        if (NOT failed)
+            execute_process(COMMAND ${CMAKE_COMMAND} --build ${dir} -j
+                    OUTPUT_QUIET RESULT_VARIABLE failed)
+        endif ()
+        if (failed)
+            message(FATAL_ERROR "The ${type} build with LTO ${lto} failed, see ${dir}")
+        endif ()
+
+        execute_process(COMMAND ${SIZE} ${dir}/kim1-blackpill.elf OUTPUT_VARIABLE sizes)
+        string(REGEX MATCH "\n *([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)" match "${sizes}")
+        math(EXPR flash "${CMAKE_MATCH_1} + ${CMAKE_MATCH_2}")
+        string(APPEND report "${type}\tLTO ${lto}\tflash ${flash}\tdata ${CMAKE_MATCH_2}\tbss ${CMAKE_MATCH_3}\n")
+    endforeach ()
+endforeach ()
+
+message(STATUS "Build sizes in bytes:\n${report}")
@@ -0,0 +1,29 @@
+# Prints how much SRAM and CCM RAM a build leaves free, from the symbols
+# the linker script defines. --print-memory-usage only gives the totals,
+# and what matters when sizing EXPANSION_SRAM_PAGES and EXPANSION_CCM_PAGES
+# is what is left after the heap and stack. Run after linking with
+#   cmake -DNM=arm-none-eabi-nm -DELF=kim1-blackpill.elf -P memory_report.cmake
+
+execute_process(COMMAND ${NM} ${ELF} OUTPUT_VARIABLE symbols)
+
+function(symbol name var)
+    string(REGEX MATCH "([0-9a-fA-F]+) [A-Za-z] ${name}\n" match "${symbols}")
+    if (NOT match)
+        message(FATAL_ERROR "${ELF} has no ${name}")
+    endif ()
+    math(EXPR value "0x${CMAKE_MATCH_1}")
+    set(${var} ${value} PARENT_SCOPE)
+endfunction()
+
+symbol(_ebss ebss)
+symbol(_estack estack)
+symbol(_Min_Heap_Size heap)
+symbol(_Min_Stack_Size stack)
+symbol(_eccmbss eccmbss)
+
+# The sizes from STM32F303CCTX_FLASH.ld
+math(EXPR ccm_end "0x10000000 + 8 * 1024")
+
+math(EXPR sram_free "${estack} - ${ebss} - ${heap} - ${stack}")
+math(EXPR ccm_free "${ccm_end} - ${eccmbss}")
+message(STATUS "Free SRAM: ${sram_free} bytes, free CCM RAM: ${ccm_free} bytes")
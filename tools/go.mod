@@ -0,0 +1,3 @@
+module kim1tools
+
+go 1.16
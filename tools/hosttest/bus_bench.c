@@ -0,0 +1,123 @@
+// Times the interpreter on the host, for comparing ways of finding the
+// memory behind an address, and builds with and without the block cache.
+// The mixed loop touches the zero page, the stack, 0300 through ($10),Y,
+// the ROM and expansion RAM, so every kind of memory bus.h looks up is in
+// it. The other two are the loops the README suggests for control-B, one
+// that stays in RAM and one that spends its time in the ROM's SCANDS.
+// Numbers from a PC only say which way is faster there; the board's have
+// to come from a BENCHMARK build.
+
+#include <stdio.h>
+#include <time.h>
+#include "main.h"
+#include "fake6502.h"
+#include "hostbus.h"
+
+#define FLAG_CONSTANT 0x20
+#define RUNS 1000
+
+static const uint8_t mixed[] = {
+    0xA2, 0x00,             // 0200 LDX #0
+    0x8A,                   // 0202 TXA
+    0x85, 0x10,             //      STA $10
+    0xA9, 0x03,             //      LDA #3
+    0x85, 0x11,             //      STA $11
+    0xA0, 0x00,             //      LDY #0
+    0x98,                   // 020B TYA
+    0x18,                   //      CLC
+    0x65, 0x10,             //      ADC $10
+    0x91, 0x10,             //      STA ($10),Y
+    0x20, 0x40, 0x02,       //      JSR $0240
+    0xC8,                   //      INY
+    0xD0, 0xF4,             //      BNE $020B
+    0xE8,                   //      INX
+    0xE0, 0x40,             //      CPX #$40
+    0xD0, 0xE6,             //      BNE $0202
+    0x4C, 0x1C, 0x02,       // 021C JMP $021C
+};
+
+static const uint8_t subroutine[] = {
+    0x48,                   // 0240 PHA
+    0xE6, 0x20,             //      INC $20
+    0xB1, 0x10,             //      LDA ($10),Y
+    0x45, 0x21,             //      EOR $21
+    0x85, 0x21,             //      STA $21
+    0xB9, 0x00, 0x1C,       //      LDA $1C00,Y
+    0x99, 0x00, 0x20,       //      STA $2000,Y
+    0x79, 0x00, 0x20,       //      ADC $2000,Y
+    0x85, 0x22,             //      STA $22
+    0x68,                   //      PLA
+    0x60,                   //      RTS
+};
+
+static const uint8_t ram_loop[] = {
+    0xA2, 0x00,             // 0200 LDX #0
+    0xA0, 0x00,             // 0202 LDY #0
+    0x88,                   // 0204 DEY
+    0xD0, 0xFD,             //      BNE $0204
+    0xCA,                   //      DEX
+    0xD0, 0xF8,             //      BNE $0202
+};
+
+// SCANDS uses X and Y itself, so the count is in the zero page
+static const uint8_t rom_loop[] = {
+    0xA9, 0x00,             // 0200 LDA #0
+    0x85, 0x30,             //      STA $30
+    0x20, 0x1F, 0x1F,       // 0204 JSR SCANDS
+    0xC6, 0x30,             //      DEC $30
+    0xD0, 0xF9,             //      BNE $0204
+};
+
+typedef struct BENCH {
+    const char *name;
+    const uint8_t *code;
+    uint8_t length;
+    uint16_t end;           // where it has finished
+    int runs;
+} BENCH;
+
+static const BENCH benches[] = {
+    { "mixed", mixed, sizeof(mixed), 0x021C, RUNS },
+    { "RAM loop", ram_loop, sizeof(ram_loop), 0x0200 + sizeof(ram_loop), RUNS },
+    { "ROM loop", rom_loop, sizeof(rom_loop), 0x0200 + sizeof(rom_loop), RUNS / 10 },
+};
+
+static double now() {
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static void bench(const BENCH *b) {
+    double best = 0;
+    uint32_t instructions = 0;
+
+    // Each run is timed on its own, and the quickest is the one least
+    // disturbed by anything else the machine was doing
+    for (int run = 0; run < b->runs; run++) {
+        host_fill(1);
+        for (unsigned i = 0; i < b->length; i++) write6502(0x0200 + i, b->code[i]);
+        for (unsigned i = 0; i < sizeof(subroutine); i++) write6502(0x0240 + i, subroutine[i]);
+#ifdef BLOCK_CACHE
+        cache_flush();
+#endif
+        pc = 0x0200;
+        sp = 0xFF;
+        status = FLAG_CONSTANT;
+        instructions = 0;
+        double start = now();
+        while (pc != b->end) {
+            instructions += step6502();
+        }
+        double ns = (now() - start) * 1e9 / instructions;
+        if ((run == 0) || (ns < best)) best = ns;
+    }
+
+    printf("bus_bench: %-8s %u instructions a run, checksum %08X, quickest of %d %.2fns an instruction\n",
+        b->name, instructions, host_checksum(), b->runs, best);
+}
+
+int main() {
+    for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        bench(&benches[i]);
+    }
+    return 0;
+}
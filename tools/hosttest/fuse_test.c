@@ -0,0 +1,174 @@
+// Checks the superinstructions against the instructions they replace.
+// Each program is run with fusion off and on, recording the pc and cycle
+// count after every step and every device access with the cycle count it
+// saw. A fused run has fewer steps, but each one has to land on a pc and
+// cycle count the unfused run went through, and the devices have to see
+// exactly the same accesses on the same cycles.
+
+#include <stdio.h>
+#include "main.h"
+#include "fake6502.h"
+#include "hostbus.h"
+
+#define FLAG_CONSTANT 0x20
+#define ORIGIN 0x0200
+#define MAX_STEPS 4096
+
+typedef struct STEP {
+    uint16_t pc;
+    uint32_t cycles;
+} STEP;
+
+typedef struct RUN {
+    STEP step[MAX_STEPS];
+    int steps;
+    DEVICE_ACCESS device[64];
+    int devices;
+    uint8_t a, x, y, status, sp;
+    uint32_t checksum;
+} RUN;
+
+typedef struct PROGRAM {
+    const char *name;
+    uint8_t length;
+    uint8_t code[40];
+} PROGRAM;
+
+// Every fusion, with the stores going to devices as well as RAM
+static const PROGRAM programs[] = {
+    { "LDA zp, STA abs to a RIOT", 17, {
+        0xA9, 0x5A, 0x85, 0x10,                     // LDA #$5A, STA $10
+        0xA2, 0x04,                                 // LDX #4
+        0xA5, 0x10, 0x8D, 0x04, 0x17,               // LDA $10, STA $1704
+        0xA5, 0x10, 0x8D, 0x00, 0x11,               // LDA $10, STA $1100
+        0xCA } },                                   // DEX
+    { "LDA zp, STA abs in a loop", 14, {
+        0xA2, 0x08,                                 // LDX #8
+        0xA5, 0x10, 0x8D, 0x00, 0x13,               // LDA $10, STA $1300
+        0xA5, 0x10, 0x8D, 0x00, 0x03,               // LDA $10, STA $0300
+        0xCA, 0xD0 } },                             // DEX, BNE (offset below)
+    { "LDA zp, STA zp", 12, {
+        0xA9, 0x33, 0x85, 0x12,                     // LDA #$33, STA $12
+        0xA5, 0x12, 0x85, 0x13,                     // LDA $12, STA $13
+        0xA5, 0x13, 0x85, 0x14 } },                 // LDA $13, STA $14
+    { "DEX BNE, DEY BNE", 10, {
+        0xA2, 0x05, 0xCA, 0xD0, 0xFD,               // LDX #5, DEX, BNE
+        0xA0, 0x03, 0x88, 0xD0, 0xFD } },           // LDY #3, DEY, BNE
+    { "INY CPY BNE, INX CPX BNE", 14, {
+        0xA0, 0x00, 0xC8, 0xC0, 0x10, 0xD0, 0xFB,   // LDY #0, INY, CPY #$10, BNE
+        0xA2, 0xF0, 0xE8, 0xE0, 0xF8, 0xD0, 0xFB } }, // LDX #$F0, INX, CPX #$F8, BNE
+    { "ASL A twice, ROL zp twice", 19, {
+        0xA9, 0xC0, 0x85, 0x10,                     // LDA #$C0, STA $10
+        0xA9, 0x81, 0x0A, 0x0A, 0x0A, 0x0A,         // LDA #$81, ASL x 4
+        0x38, 0x26, 0x10, 0x26, 0x11,               // SEC, ROL $10, ROL $11
+        0xA9, 0xA0, 0x0A, 0x0A } },                 // LDA #$A0, ASL x 2
+    { "a store into the next instruction", 12, {
+        0xA9, 0x33, 0x85, 0x12,                     // LDA #$33, STA $12
+        0xA5, 0x12, 0x8D, 0x0A, 0x02,               // LDA $12, STA $020A
+        0xA9, 0x77, 0xEA } },                       // LDA #$77, changed to #$33
+};
+
+static int failures;
+
+static void run(const PROGRAM *p, int fused, RUN *r) {
+    uint16_t end;
+
+    host_fill(1);
+    for (int i = 0; i < p->length; i++) {
+        write6502(ORIGIN + i, p->code[i]);
+    }
+    end = ORIGIN + p->length;
+    if (p->code[p->length - 1] == 0xD0) {
+        // A BNE at the end goes back to the start after the LDX
+        write6502(end, (uint8_t) (ORIGIN + 2 - (end + 1)));
+        end++;
+    }
+    fuse6502(fused);
+    cache_flush();
+
+    pc = ORIGIN;
+    a = x = y = 0;
+    status = FLAG_CONSTANT;
+    sp = 0xFF;
+    clockticks6502 = 0;
+    device_log_count = 0;
+    r->steps = 0;
+    while ((pc != end) && (r->steps < MAX_STEPS)) {
+        step6502();
+        r->step[r->steps].pc = pc;
+        r->step[r->steps].cycles = clockticks6502;
+        r->steps++;
+    }
+
+    r->devices = device_log_count;
+    for (int i = 0; (i < device_log_count) && (i < 64); i++) {
+        r->device[i] = device_log[i];
+    }
+    r->a = a;
+    r->x = x;
+    r->y = y;
+    r->status = status;
+    r->sp = sp;
+    r->checksum = host_checksum();
+}
+
+static void compare(const PROGRAM *p) {
+    static RUN plain, fused;
+    int j = 0;
+
+    run(p, 0, &plain);
+    run(p, 1, &fused);
+
+    if (fused.steps >= plain.steps) {
+        printf("%s: %d steps fused and %d plain, nothing was fused\n", p->name, fused.steps, plain.steps);
+        failures++;
+    }
+    for (int i = 0; i < fused.steps; i++) {
+        while ((j < plain.steps) && (plain.step[j].cycles < fused.step[i].cycles)) j++;
+        if ((j == plain.steps) || (plain.step[j].pc != fused.step[i].pc) ||
+            (plain.step[j].cycles != fused.step[i].cycles)) {
+            printf("%s: fused step %d ends at %04X on cycle %u, which the plain run never did\n",
+                p->name, i, fused.step[i].pc, fused.step[i].cycles);
+            failures++;
+            break;
+        }
+    }
+
+    if (plain.devices != fused.devices) {
+        printf("%s: %d device accesses plain and %d fused\n", p->name, plain.devices, fused.devices);
+        failures++;
+    } else {
+        for (int i = 0; (i < plain.devices) && (i < 64); i++) {
+            const DEVICE_ACCESS *d1 = &plain.device[i], *d2 = &fused.device[i];
+            if ((d1->cycle != d2->cycle) || (d1->address != d2->address) ||
+                (d1->value != d2->value) || (d1->write != d2->write)) {
+                printf("%s: device access %d is %04X=%02X on cycle %u plain and %04X=%02X on cycle %u fused\n",
+                    p->name, i, d1->address, d1->value, d1->cycle, d2->address, d2->value, d2->cycle);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    if ((plain.a != fused.a) || (plain.x != fused.x) || (plain.y != fused.y) ||
+        (plain.status != fused.status) || (plain.sp != fused.sp) || (plain.checksum != fused.checksum)) {
+        printf("%s: registers or memory differ\n", p->name);
+        failures++;
+    }
+}
+
+int main() {
+    for (unsigned i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        compare(&programs[i]);
+    }
+
+    // And the check the board runs at power on
+    int failed = fuse_check();
+    if (failed) {
+        printf("fuse_check failed on test %d\n", failed);
+        failures++;
+    }
+
+    printf("fuse_test: %s\n", failures ? "FAILED" : "ok");
+    return failures != 0;
+}
@@ -0,0 +1,85 @@
+// The memory map of main.c without the hardware behind it, for the host
+// tests. RAM and ROM come from the same page tables in memmap.c
+
+#include "main.h"
+#include "fake6502.h"
+#include "memmap.h"
+#include "hostbus.h"
+
+uint8_t RAM[RAM_SIZE];
+uint8_t RIOT_RAM[0x80];
+
+DEVICE_ACCESS device_log[DEVICE_LOG_SIZE];
+int device_log_count;
+
+static void device_access(uint16_t address, uint8_t value, uint8_t write) {
+    if (device_log_count < DEVICE_LOG_SIZE) {
+        DEVICE_ACCESS *d = &device_log[device_log_count];
+        d->cycle = clockticks6502;
+        d->address = address;
+        d->value = value;
+        d->write = write;
+    }
+    device_log_count++;
+}
+
+uint8_t read6502(uint16_t addr) {
+    const uint8_t *page = read_table[addr >> 8];
+    if (RAM_DIRECT(addr)) {
+        return RAM[addr];
+    } else if (page) {
+        return page[addr & 0xff];
+    } else if ((addr >= 0x1780) && (addr < 0x1800)) {
+        return RIOT_RAM[addr - 0x1780];
+    }
+    device_access(addr, 0, 0);
+    return 0;
+}
+
+void write6502(uint16_t addr, uint8_t val) {
+    uint8_t *page = page_table[addr >> 8];
+    CACHE_WRITE(addr);
+    if (RAM_DIRECT(addr)) {
+        RAM[addr] = val;
+    } else if (page) {
+        page[addr & 0xff] = val;
+    } else if ((addr >= 0x1780) && (addr < 0x1800)) {
+        RIOT_RAM[addr - 0x1780] = val;
+    } else if (!read_table[addr >> 8]) {
+        device_access(addr, val, 1);
+    }
+}
+
+int watch6502(uint16_t address) {
+    return 0;
+}
+
+uint8_t *span6502(uint16_t address, uint32_t length) {
+    return NULL;
+}
+
+uint32_t host_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+void host_fill(uint32_t seed) {
+    for (uint32_t i = 0; i < RAM_SIZE; i++) {
+        RAM[i] = host_random(&seed);
+    }
+    for (uint32_t i = 0; i < sizeof(RIOT_RAM); i++) {
+        RIOT_RAM[i] = host_random(&seed);
+    }
+}
+
+uint32_t host_checksum() {
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i < RAM_SIZE; i++) {
+        sum = sum * 31 + RAM[i];
+    }
+    for (uint32_t i = 0; i < sizeof(RIOT_RAM); i++) {
+        sum = sum * 31 + RIOT_RAM[i];
+    }
+    return sum;
+}
@@ -0,0 +1,34 @@
+#ifndef __HOSTBUS_H
+#define __HOSTBUS_H
+
+#include <stdint.h>
+
+// read6502 and write6502 for the host tests. The RAM, the RIOT RAM and
+// the ROMs are where main.c puts them, and every other access, which on
+// the board would be a RIOT register or some other device, is written to
+// the log with the cycle count it saw.
+
+typedef struct DEVICE_ACCESS {
+    uint32_t cycle;
+    uint16_t address;
+    uint8_t value;
+    uint8_t write;
+} DEVICE_ACCESS;
+
+#define DEVICE_LOG_SIZE 4096
+
+extern DEVICE_ACCESS device_log[DEVICE_LOG_SIZE];
+extern int device_log_count;
+
+extern uint8_t RIOT_RAM[0x80];
+
+// Fills the RAM and the RIOT RAM with pseudo-random bytes from seed
+void host_fill(uint32_t seed);
+
+// A checksum of all of the RAM, for comparing two runs
+uint32_t host_checksum();
+
+// A pseudo-random number generator that is the same everywhere
+uint32_t host_random(uint32_t *seed);
+
+#endif /* __HOSTBUS_H */
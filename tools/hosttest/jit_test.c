@@ -0,0 +1,177 @@
+// Checks jit_decode and jit_interpret, the model the Thumb-2 translator
+// follows, against the interpreter. Random blocks of the instructions the
+// JIT takes are decoded, run through jit_interpret, and then run again
+// from the same state through fake6502, and the registers, cycles and
+// memory have to come out the same.
+
+#include <stdio.h>
+#include "main.h"
+#include "fake6502.h"
+#include "jit.h"
+#include "memmap.h"
+#include "hostbus.h"
+
+#define FLAG_CONSTANT 0x20
+#define BLOCK_START 0x0400
+
+#define RUNS 20000
+
+typedef struct STATE {
+    uint16_t pc;
+    uint8_t a, x, y, status;
+    uint32_t cycles;
+    uint32_t checksum;
+    int devices;
+} STATE;
+
+static uint8_t translatable[256];
+static int failures;
+
+// Finds the opcodes the JIT takes by asking it about each one
+static void find_translatable() {
+    for (int opcode = 0; opcode < 256; opcode++) {
+        JIT_BLOCK block;
+
+        write6502(BLOCK_START, opcode);
+        write6502(BLOCK_START + 1, 0x10);
+        write6502(BLOCK_START + 2, 0x03);
+        translatable[opcode] = jit_decode(&block, BLOCK_START) > 0;
+    }
+}
+
+// An operand for an absolute instruction somewhere the JIT can read and
+// write, but not on the block's own page
+static uint16_t absolute(uint32_t *seed) {
+    static const uint16_t areas[] = { 0x0000, 0x0300, 0x0f00, 0x1780, 0x1c00, EXPANSION_START };
+    uint16_t area = areas[host_random(seed) % (sizeof(areas) / sizeof(areas[0]))];
+
+    return area + (host_random(seed) & ((area == 0x1780) ? 0x7f : 0xff));
+}
+
+static void random_block(uint32_t *seed) {
+    uint16_t addr = BLOCK_START;
+
+    for (int i = 0; i < JIT_BLOCK_MAX; i++) {
+        uint8_t opcode;
+        do {
+            opcode = host_random(seed);
+        } while (!translatable[opcode]);
+
+        write6502(addr, opcode);
+        if (oplength[opcode] == 2) {
+            write6502(addr + 1, host_random(seed));
+        } else if (oplength[opcode] == 3) {
+            uint16_t arg = absolute(seed);
+            write6502(addr + 1, arg & 0xff);
+            write6502(addr + 2, arg >> 8);
+        }
+        addr += oplength[opcode];
+    }
+}
+
+static void random_registers(uint32_t *seed) {
+    a = host_random(seed);
+    x = host_random(seed);
+    y = host_random(seed);
+    status = host_random(seed) | FLAG_CONSTANT;
+    pc = BLOCK_START;
+}
+
+static void finish(STATE *state, uint32_t start) {
+    state->pc = pc;
+    state->a = a;
+    state->x = x;
+    state->y = y;
+    state->status = status;
+    state->cycles = clockticks6502 - start;
+    state->checksum = host_checksum();
+    state->devices = device_log_count;
+}
+
+static int differs(const STATE *s1, const STATE *s2) {
+    return (s1->pc != s2->pc) || (s1->a != s2->a) || (s1->x != s2->x) ||
+        (s1->y != s2->y) || (s1->status != s2->status) ||
+        (s1->cycles != s2->cycles) || (s1->checksum != s2->checksum) ||
+        (s1->devices != s2->devices);
+}
+
+static void show(const char *name, const STATE *s) {
+    printf("  %-11s pc %04X a %02X x %02X y %02X p %02X cycles %u sum %08X devices %d\n",
+        name, s->pc, s->a, s->x, s->y, s->status, s->cycles, s->checksum, s->devices);
+}
+
+// Puts the same random block, memory and registers in place for run
+static void setup(uint32_t run) {
+    uint32_t seed = run * 2654435761UL;
+
+    host_fill(seed);
+    random_block(&seed);
+    random_registers(&seed);
+    device_log_count = 0;
+}
+
+static void check_random(uint32_t run) {
+    JIT_BLOCK block;
+    STATE interpreted, translated;
+    uint32_t start;
+    int count;
+
+    setup(run);
+    count = jit_decode(&block, BLOCK_START);
+    if (!count) {
+        printf("run %u: the first instruction wasn't decoded\n", run);
+        failures++;
+        return;
+    }
+    start = clockticks6502;
+    jit_interpret(&block);
+    finish(&translated, start);
+
+    setup(run);
+    start = clockticks6502;
+    for (int i = 0; i < count; i++) {
+        step6502();
+    }
+    finish(&interpreted, start);
+
+    if (differs(&interpreted, &translated) || translated.devices) {
+        printf("run %u: %d instructions from %04X differ\n", run, count, BLOCK_START);
+        show("interpreted", &interpreted);
+        show("translated", &translated);
+        failures++;
+    }
+}
+
+// A block has to end before anything that isn't RAM or ROM, since devices
+// look at the cycle count, which a translated block only adds to at the end
+static void check_devices() {
+    static const uint16_t devices[] = { 0x1000, 0x1100, 0x1200, 0x1300, 0x1700, 0x1740, 0x9c00, 0xa000 };
+
+    for (unsigned i = 0; i < sizeof(devices) / sizeof(devices[0]); i++) {
+        static const uint8_t accesses[] = { 0xAD, 0x8D, 0xEE };
+        for (unsigned j = 0; j < sizeof(accesses); j++) {
+            JIT_BLOCK block;
+            uint8_t code[] = { 0xA9, 0x01, accesses[j], devices[i] & 0xff, devices[i] >> 8, 0xEA };
+
+            for (unsigned k = 0; k < sizeof(code); k++) {
+                write6502(BLOCK_START + k, code[k]);
+            }
+            if (jit_decode(&block, BLOCK_START) != 1) {
+                printf("%02X %04X was translated\n", accesses[j], devices[i]);
+                failures++;
+            }
+        }
+    }
+}
+
+int main() {
+    find_translatable();
+    check_devices();
+    for (uint32_t run = 0; run < RUNS; run++) {
+        check_random(run);
+        if (failures > 10) break;
+    }
+
+    printf("jit_test: %s\n", failures ? "FAILED" : "ok");
+    return failures != 0;
+}
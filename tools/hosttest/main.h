@@ -0,0 +1,14 @@
+#ifndef __MAIN_H
+#define __MAIN_H
+
+// Stands in for Core/Inc/main.h in the host builds, which have no HAL
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "ccmram.h"
+
+// The barriers jit.c puts after writing code
+#define __DSB()
+#define __ISB()
+
+#endif /* __MAIN_H */
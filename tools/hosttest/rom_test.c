@@ -0,0 +1,121 @@
+// Checks the translated ROM in romblocks.inc against the interpreter. Every
+// address a translated block starts at is run from a few different random
+// states, once through the block and once through the interpreter for the
+// same number of instructions, and the registers, cycle count, memory and
+// every device access with the cycle count it saw have to come out the same.
+
+#include <stdio.h>
+#include "main.h"
+#include "fake6502.h"
+#include "hostbus.h"
+
+#define FLAG_CONSTANT 0x20
+#define STATES 16
+
+typedef struct RUN {
+    int instructions;
+    uint16_t pc;
+    uint8_t a, x, y, status, sp;
+    uint32_t cycles;
+    DEVICE_ACCESS device[64];
+    int devices;
+    uint32_t checksum;
+} RUN;
+
+static int failures;
+
+static void run(uint16_t start, uint32_t seed, int translated, int instructions, RUN *r) {
+    host_fill(seed);
+    a = host_random(&seed);
+    x = host_random(&seed);
+    y = host_random(&seed);
+    status = host_random(&seed) | FLAG_CONSTANT;
+    sp = host_random(&seed);
+    pc = start;
+    clockticks6502 = 0;
+    device_log_count = 0;
+
+    translate6502(translated);
+    if (translated) {
+        r->instructions = step6502();
+    } else {
+        r->instructions = 0;
+        while (r->instructions < instructions) {
+            r->instructions += step6502();
+        }
+    }
+
+    r->pc = pc;
+    r->a = a;
+    r->x = x;
+    r->y = y;
+    r->status = status;
+    r->sp = sp;
+    r->cycles = clockticks6502;
+    r->devices = device_log_count;
+    for (int i = 0; (i < device_log_count) && (i < 64); i++) {
+        r->device[i] = device_log[i];
+    }
+    r->checksum = host_checksum();
+}
+
+static int compare(uint16_t start, uint32_t seed) {
+    static RUN translated, plain;
+
+    run(start, seed, 1, 0, &translated);
+    run(start, seed, 0, translated.instructions, &plain);
+
+    if ((translated.pc != plain.pc) || (translated.a != plain.a) || (translated.x != plain.x) ||
+        (translated.y != plain.y) || (translated.status != plain.status) || (translated.sp != plain.sp)) {
+        printf("%04X: after %d instructions pc %04X A %02X X %02X Y %02X P %02X S %02X translated, "
+            "pc %04X A %02X X %02X Y %02X P %02X S %02X interpreted\n", start, translated.instructions,
+            translated.pc, translated.a, translated.x, translated.y, translated.status, translated.sp,
+            plain.pc, plain.a, plain.x, plain.y, plain.status, plain.sp);
+        return 1;
+    }
+    if (translated.cycles != plain.cycles) {
+        printf("%04X: %u cycles translated and %u interpreted\n", start, translated.cycles, plain.cycles);
+        return 1;
+    }
+    if (translated.devices != plain.devices) {
+        printf("%04X: %d device accesses translated and %d interpreted\n",
+            start, translated.devices, plain.devices);
+        return 1;
+    }
+    for (int i = 0; (i < plain.devices) && (i < 64); i++) {
+        const DEVICE_ACCESS *d1 = &translated.device[i], *d2 = &plain.device[i];
+        if ((d1->cycle != d2->cycle) || (d1->address != d2->address) ||
+            (d1->value != d2->value) || (d1->write != d2->write)) {
+            printf("%04X: device access %d is %04X=%02X on cycle %u translated and %04X=%02X on cycle %u interpreted\n",
+                start, i, d1->address, d1->value, d1->cycle, d2->address, d2->value, d2->cycle);
+            return 1;
+        }
+    }
+    if (translated.checksum != plain.checksum) {
+        printf("%04X: memory differs\n", start);
+        return 1;
+    }
+    return 0;
+}
+
+int main() {
+    int blocks = 0;
+
+    for (uint16_t start = 0x1800; start < 0x2000; start++) {
+        if (!rom_translated(start)) continue;
+        blocks++;
+        for (uint32_t state = 0; state < STATES; state++) {
+            if (compare(start, start * 2654435761UL + state)) {
+                failures++;
+                break;
+            }
+        }
+    }
+    if (blocks == 0) {
+        printf("no translated blocks\n");
+        failures++;
+    }
+
+    printf("rom_test: %d blocks, %s\n", blocks, failures ? "FAILED" : "ok");
+    return failures != 0;
+}
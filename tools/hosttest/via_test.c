@@ -0,0 +1,321 @@
+// Checks via.c's timers, worked out from the cycle count, against the
+// cycle by cycle behaviour of a 6522: when T1 and T2 time out in one shot
+// mode, the latch + 2 period of a free running T1, catching up over many
+// periods at once, where via_event lands, and how IFR and IER are set and
+// cleared.
+
+#include <stdio.h>
+#include "main.h"
+#include "fake6502.h"
+#include "irq.h"
+#include "via.h"
+
+#define REG(reg) (VIA_ADDRESS + (reg))
+
+uint32_t clockticks6502;
+uint8_t irq_pending, irq_check;
+
+static int failures;
+
+#define CHECK(condition, ...) { \
+    if (!(condition)) { \
+        printf("%s: ", __func__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+}
+
+static void at(uint32_t cycle) {
+    clockticks6502 = cycle;
+    // As the main loop does after each step
+    if ((int32_t) (clockticks6502 - via_event) >= 0) via_update();
+}
+
+// Reading T1CL clears the T1 flag, so anything looking at the flag has to
+// do it first
+static uint16_t t1_counter() {
+    uint8_t high = via_read(REG(VIA_T1CH));
+    return (high << 8) | via_read(REG(VIA_T1CL));
+}
+
+static int ifr(uint8_t flag) {
+    return (via_read(REG(VIA_IFR)) & flag) != 0;
+}
+
+static void start_t1(uint32_t cycle, uint16_t latch) {
+    clockticks6502 = cycle;
+    via_write(REG(VIA_T1CL), latch & 0xff);
+    via_write(REG(VIA_T1CH), latch >> 8);
+}
+
+static void start_t2(uint32_t cycle, uint16_t value) {
+    clockticks6502 = cycle;
+    via_write(REG(VIA_T2CL), value & 0xff);
+    via_write(REG(VIA_T2CH), value >> 8);
+}
+
+static void reset(uint32_t cycle) {
+    clockticks6502 = cycle;
+    via_reset();
+    via_write(REG(VIA_IFR), 0x7f);
+    irq_pending = 0;
+    irq_check = 0;
+}
+
+// T1 counts N, N-1 ... 0, then FFFF with the flag set, N + 1 cycles after
+// it was started, and in one shot mode just keeps counting down
+static void t1_one_shot() {
+    const uint16_t latch = 5;
+    reset(1000);
+    start_t1(1000, latch);
+
+    for (uint32_t i = 0; i <= latch + 3; i++) {
+        at(1000 + i);
+        CHECK(ifr(VIA_IRQ_T1) == (i >= latch + 1u), "flag at +%u is %d", i, ifr(VIA_IRQ_T1));
+    }
+
+    // The counter, read at each cycle from a fresh start
+    start_t1(2000, latch);
+    for (uint32_t i = 0; i <= latch + 3; i++) {
+        clockticks6502 = 2000 + i;
+        uint16_t want = (uint16_t) (latch - i);
+        uint16_t counter = via_read(REG(VIA_T1CL)) | (via_read(REG(VIA_T1CH)) << 8);
+        CHECK(counter == want, "counter at +%u is %04X, want %04X", i, counter, want);
+    }
+
+    // It doesn't set the flag again when it wraps round
+    via_write(REG(VIA_IFR), VIA_IRQ_T1);
+    at(2000 + 70000);
+    CHECK(!ifr(VIA_IRQ_T1), "the flag was set again after wrapping");
+}
+
+// T2 is the same in one shot mode, started by writing T2CH
+static void t2_one_shot() {
+    const uint16_t value = 0x0102;
+    reset(5000);
+    start_t2(5000, value);
+
+    for (uint32_t i = 0; i <= value + 3u; i++) {
+        at(5000 + i);
+        CHECK(ifr(VIA_IRQ_T2) == (i >= value + 1u), "flag at +%u is %d", i, ifr(VIA_IRQ_T2));
+    }
+    clockticks6502 = 5000 + 0x200;
+    uint16_t counter = (via_read(REG(VIA_T2CH)) << 8) | via_read(REG(VIA_T2CL));
+    CHECK(counter == (uint16_t) (value - 0x200), "counter is %04X, want %04X", counter, (uint16_t) (value - 0x200));
+
+    // Only once
+    at(5000 + 0x20000);
+    CHECK(!ifr(VIA_IRQ_T2), "the flag was set again after wrapping");
+
+    // Counting pulses on PB6, which nothing drives, it stands still
+    via_write(REG(VIA_ACR), VIA_T2_COUNT);
+    uint16_t before = (via_read(REG(VIA_T2CH)) << 8) | via_read(REG(VIA_T2CL));
+    clockticks6502 += 500;
+    uint16_t after = (via_read(REG(VIA_T2CH)) << 8) | via_read(REG(VIA_T2CL));
+    CHECK(before == after, "counting pulses it went from %04X to %04X", before, after);
+    via_write(REG(VIA_ACR), 0);
+}
+
+// Free running, T1 shows N ... 0, FFFF, then N again, so the flag is set
+// every N + 2 cycles
+static void t1_free_run() {
+    const uint16_t latch = 3;
+    const uint32_t period = latch + 2;
+    reset(10000);
+    via_write(REG(VIA_ACR), VIA_T1_FREE_RUN);
+    start_t1(10000, latch);
+
+    int flags = 0;
+    for (uint32_t i = 0; i < 12 * period; i++) {
+        at(10000 + i);
+        uint32_t phase = i % period;
+        uint16_t want = (phase <= latch) ? latch - phase : 0xffff;
+        int flag = ifr(VIA_IRQ_T1);
+        CHECK(flag == (phase == latch + 1), "flag at +%u is %d", i, flag);
+        flags += flag;
+
+        uint16_t counter = t1_counter();
+        CHECK(counter == want, "counter at +%u is %04X, want %04X", i, counter, want);
+    }
+    CHECK(flags == 12, "the flag was set %d times in 12 periods", flags);
+
+    // A bigger latch, checked only where each period should start
+    reset(20000);
+    via_write(REG(VIA_ACR), VIA_T1_FREE_RUN);
+    start_t1(20000, 998);
+    for (int n = 1; n <= 5; n++) {
+        uint32_t due = 20000 + 999 + (n - 1) * 1000;
+        at(due - 1);
+        CHECK(!ifr(VIA_IRQ_T1), "period %d flag a cycle early", n);
+        at(due);
+        CHECK(ifr(VIA_IRQ_T1), "period %d flag not set on time", n);
+        via_read(REG(VIA_T1CL));
+        at(due + 1);
+        CHECK(t1_counter() == 998, "period %d didn't reload from the latch", n);
+    }
+}
+
+// Nobody looks at the VIA for thousands of periods, and it still has to be
+// in the right place in the right period
+static void t1_catch_up() {
+    const uint16_t latch = 3;
+    reset(30000);
+    via_write(REG(VIA_ACR), VIA_T1_FREE_RUN);
+    start_t1(30000, latch);
+
+    clockticks6502 = 30000 + 5 * 12345 + 2;
+    via_update();
+    CHECK(ifr(VIA_IRQ_T1), "the flag wasn't set after many periods");
+    CHECK(t1_counter() == 1, "counter is %04X, want 0001", t1_counter());
+
+    // And the next period starts on time
+    via_write(REG(VIA_IFR), VIA_IRQ_T1);
+    CHECK(via_event == 30000 + 5 * 12345 + 4, "next event at %u, want %u", via_event, 30000 + 5 * 12345 + 4);
+    at(30000 + 5 * 12345 + 3);
+    CHECK(!ifr(VIA_IRQ_T1), "the flag was set early");
+    at(30000 + 5 * 12345 + 4);
+    CHECK(ifr(VIA_IRQ_T1), "the flag wasn't set after catching up");
+
+    // Across the cycle count wrapping round
+    reset(0xfffffff0UL);
+    via_write(REG(VIA_ACR), VIA_T1_FREE_RUN);
+    start_t1(0xfffffff0UL, 100);
+    clockticks6502 = (uint32_t) (0xfffffff0UL + 102 * 1000 + 50);
+    via_update();
+    CHECK(t1_counter() == 50, "after wrapping the counter is %04X, want 0032", t1_counter());
+}
+
+// via_event is the cycle the next flag is due on, whichever timer that is,
+// and far enough ahead not to matter when nothing is running
+static void event_schedule() {
+    // Let anything still running from before run out
+    reset(39000);
+    start_t1(39000, 0);
+    start_t2(39000, 0);
+    at(39001);
+    reset(40000);
+    CHECK((int32_t) (via_event - 40000) >= 0x10000000, "idle event at %u, now 40000", via_event);
+
+    start_t1(40000, 100);
+    CHECK(via_event == 40101, "T1 event at %u, want 40101", via_event);
+    start_t2(40010, 50);
+    CHECK(via_event == 40061, "T2 event at %u, want 40061", via_event);
+
+    at(40060);
+    CHECK(!ifr(VIA_IRQ_T2), "T2 flag early");
+    at(40061);
+    CHECK(ifr(VIA_IRQ_T2), "T2 flag not set when due");
+    CHECK(via_event == 40101, "after T2 the event is at %u, want 40101", via_event);
+    at(40101);
+    CHECK(ifr(VIA_IRQ_T1), "T1 flag not set when due");
+    CHECK((int32_t) (via_event - 40101) >= 0x10000000, "after both the event is at %u", via_event);
+
+    // Restarting a timer moves the event
+    start_t1(41000, 500);
+    start_t1(41100, 10);
+    CHECK(via_event == 41111, "restarted T1 event at %u, want 41111", via_event);
+
+    // The shift register shifting out under phi2 takes 16 cycles
+    reset(50000);
+    via_write(REG(VIA_ACR), 6 << 2);
+    clockticks6502 = 50000;
+    via_write(REG(VIA_SR), 0x81);
+    CHECK(via_event == 50016, "shift event at %u, want 50016", via_event);
+    at(50015);
+    CHECK(!ifr(VIA_IRQ_SR), "shift flag early");
+    at(50016);
+    CHECK(ifr(VIA_IRQ_SR), "shift flag not set when due");
+    CHECK(via_read(REG(VIA_SR)) == 0x81, "shifting out 8 times left %02X", via_read(REG(VIA_SR)));
+    via_write(REG(VIA_ACR), 0);
+}
+
+// IFR bits are cleared by the register accesses the datasheet lists or by
+// writing 1s to IFR. IFR bit 7 and IRQ follow whether any flag is enabled
+// in IER, which is set or cleared by bit 7 of what is written to it.
+static void flags_and_enables() {
+    reset(60000);
+    start_t1(60000, 10);
+    start_t2(60000, 10);
+    at(60011);
+    CHECK(via_read(REG(VIA_IFR)) == (VIA_IRQ_T1 | VIA_IRQ_T2), "IFR is %02X with nothing enabled", via_read(REG(VIA_IFR)));
+    CHECK(!(irq_pending & IRQ_VIA), "IRQ with nothing enabled");
+
+    // Enabling a flag that is already set pulls IRQ low
+    via_write(REG(VIA_IER), 0x80 | VIA_IRQ_T1);
+    CHECK(via_read(REG(VIA_IER)) == (0x80 | VIA_IRQ_T1), "IER reads %02X", via_read(REG(VIA_IER)));
+    CHECK(via_read(REG(VIA_IFR)) == (VIA_IRQ_ANY | VIA_IRQ_T1 | VIA_IRQ_T2), "IFR is %02X", via_read(REG(VIA_IFR)));
+    CHECK((irq_pending & IRQ_VIA) && irq_check, "no IRQ with T1 enabled");
+
+    // Reading T1CH doesn't clear anything, reading T1CL does
+    via_read(REG(VIA_T1CH));
+    CHECK(ifr(VIA_IRQ_T1), "reading T1CH cleared the flag");
+    via_read(REG(VIA_T1CL));
+    CHECK(!ifr(VIA_IRQ_T1), "reading T1CL didn't clear the flag");
+    CHECK(!(irq_pending & IRQ_VIA), "IRQ still low with only a disabled flag");
+    CHECK(!(via_read(REG(VIA_IFR)) & VIA_IRQ_ANY), "IFR bit 7 set with only a disabled flag");
+
+    // Writing T1LH clears it too, and so does writing T1CH
+    start_t1(61000, 10);
+    at(61011);
+    CHECK(ifr(VIA_IRQ_T1), "T1 flag not set");
+    via_write(REG(VIA_T1LH), 0);
+    CHECK(!ifr(VIA_IRQ_T1), "writing T1LH didn't clear the flag");
+    start_t1(62000, 10);
+    at(62011);
+    start_t1(62011, 10);
+    CHECK(!ifr(VIA_IRQ_T1), "writing T1CH didn't clear the flag");
+
+    // Reading T2CL clears T2, and writing T2CH does too
+    CHECK(ifr(VIA_IRQ_T2), "T2 flag lost");
+    via_read(REG(VIA_T2CL));
+    CHECK(!ifr(VIA_IRQ_T2), "reading T2CL didn't clear the flag");
+    start_t2(63000, 10);
+    at(63011);
+    start_t2(63011, 10);
+    CHECK(!ifr(VIA_IRQ_T2), "writing T2CH didn't clear the flag");
+
+    // Writing 1s to IFR clears only those flags
+    at(63022);
+    start_t1(63022, 0);
+    at(63023);
+    CHECK(ifr(VIA_IRQ_T1) && ifr(VIA_IRQ_T2), "flags not set");
+    via_write(REG(VIA_IFR), VIA_IRQ_T2);
+    CHECK(ifr(VIA_IRQ_T1) && !ifr(VIA_IRQ_T2), "writing IFR cleared the wrong flags");
+    CHECK(irq_pending & IRQ_VIA, "IRQ should still be low");
+
+    // Disabling the flag lets IRQ go, without clearing the flag
+    via_write(REG(VIA_IER), VIA_IRQ_T1);
+    CHECK(via_read(REG(VIA_IER)) == 0x80, "IER reads %02X after clearing", via_read(REG(VIA_IER)));
+    CHECK(!(irq_pending & IRQ_VIA), "IRQ still low after disabling");
+    CHECK(ifr(VIA_IRQ_T1), "disabling cleared the flag");
+
+    // Writing IER without bit 7 and with no bits leaves it alone
+    via_write(REG(VIA_IER), 0x80 | VIA_IRQ_T2 | VIA_IRQ_SR);
+    via_write(REG(VIA_IER), 0x00);
+    CHECK(via_read(REG(VIA_IER)) == (0x80 | VIA_IRQ_T2 | VIA_IRQ_SR), "IER reads %02X", via_read(REG(VIA_IER)));
+}
+
+// Nothing is wired to the ports, so input bits read 1
+static void ports() {
+    reset(70000);
+    via_write(REG(VIA_DDRB), 0x0f);
+    via_write(REG(VIA_ORB), 0x05);
+    CHECK(via_read(REG(VIA_ORB)) == 0xf5, "port B reads %02X", via_read(REG(VIA_ORB)));
+    via_write(REG(VIA_DDRA), 0xff);
+    via_write(REG(VIA_ORA_NH), 0x3c);
+    CHECK(via_read(REG(VIA_ORA)) == 0x3c, "port A reads %02X", via_read(REG(VIA_ORA)));
+}
+
+int main() {
+    t1_one_shot();
+    t2_one_shot();
+    t1_free_run();
+    t1_catch_up();
+    event_schedule();
+    flags_and_enables();
+    ports();
+
+    printf("via_test: %s\n", failures ? "FAILED" : "ok");
+    return failures != 0;
+}
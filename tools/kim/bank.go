@@ -0,0 +1,105 @@
+package kim
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+)
+
+// Bank is the newest copy of one bank of a BANKED_RAM build's banked RAM
+type Bank struct {
+	Number int
+	Packed int // bytes it takes in flash, less than BankSize if compressed
+	Data   []byte
+}
+
+// Where the banked RAM's store lives in flash, and how it is laid out, as
+// in storage.h and bank.h. The store is BankFlashSize bytes, from CMake's
+// BANK_FLASH_SIZE, ending where the tape starts.
+const (
+	BankFlashSize = 0x8000
+	BankSize      = 0x1000
+
+	bankMagic   = 0x424d494b // "KIMB"
+	bankVersion = 1
+	bankRaw     = 0
+	bankLZ4     = 1
+)
+
+type bankRecord struct {
+	Packed   uint16
+	Bank     uint8
+	Encoding uint8
+	Reserved uint16
+	Done     uint16
+}
+
+// BankAddress is where a store of size bytes starts
+func BankAddress(size int) int {
+	return TapeAddress - size
+}
+
+// ReadBanks returns the newest copy of every bank that has been written to
+// a bank store read out of flash, in bank order. The store can be any
+// size, and is split into two halves the same as on the board.
+func ReadBanks(image []byte) ([]Bank, error) {
+	half := len(image) / 2
+	size := binary.Size(tapeHeader{})
+	if half < size {
+		return nil, fmt.Errorf("the store is only %d bytes", len(image))
+	}
+
+	// The store is in whichever half has the higher generation. The
+	// header is the same shape as the tape's.
+	current := -1
+	var generation uint32
+	for i := 0; i < 2; i++ {
+		var h tapeHeader
+		binary.Read(bytes.NewReader(image[i*half:]), binary.LittleEndian, &h)
+		if h.Magic == bankMagic && h.Version == bankVersion && (current < 0 || h.Generation > generation) {
+			current = i
+			generation = h.Generation
+		}
+	}
+	if current < 0 {
+		return nil, fmt.Errorf("there isn't a bank store there")
+	}
+	store := image[current*half : (current+1)*half]
+
+	newest := map[int]Bank{}
+	recordSize := binary.Size(bankRecord{})
+	for offset := size; offset+recordSize <= len(store); {
+		var r bankRecord
+		binary.Read(bytes.NewReader(store[offset:]), binary.LittleEndian, &r)
+		start := offset + recordSize
+		end := start + int(r.Packed)
+		if r.Packed == 0xffff || end > len(store) {
+			break
+		}
+		offset = (end + 1) &^ 1
+		if r.Done != 0 {
+			continue
+		}
+		data := store[start:end]
+		if r.Encoding == bankLZ4 {
+			var err error
+			if data, err = Decompress(data, BankSize); err != nil {
+				return nil, fmt.Errorf("bank %02X: %v", r.Bank, err)
+			}
+		}
+		newest[int(r.Bank)] = Bank{int(r.Bank), int(r.Packed), data}
+	}
+
+	var banks []Bank
+	for n := 0; n < 256; n++ {
+		if b, ok := newest[n]; ok {
+			banks = append(banks, b)
+		}
+	}
+	return banks, nil
+}
+
+// String describes the bank the way kimbank lists them
+func (b Bank) String() string {
+	return fmt.Sprintf("%02X %5d bytes in flash", b.Number, b.Packed)
+}
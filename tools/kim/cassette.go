@@ -0,0 +1,356 @@
+package kim
+
+import "math"
+
+// The KIM-1 cassette format, as DUMPT in the 6530-003 ROM writes it and
+// LOADT reads it. Each character is 8 bits, low bit first, and each bit is
+// three parts, each 9 cycles of the high tone or 6 of the low one. A 0 is
+// high, high, low and a 1 is high, low, low. A file is 100 SYNs, a *, the
+// ID, SAL, SAH and the data as pairs of hex digits, a /, the checksum low
+// byte first, and two EOTs.
+const (
+	highTone   = 3700
+	lowTone    = 2400
+	highCycles = 9
+	lowCycles  = 6
+
+	syn        = 0x16
+	eot        = 0x04
+	syncLength = 100
+	amplitude  = 16000
+)
+
+const hexDigits = "0123456789ABCDEF"
+
+type encoder struct {
+	rate     float64
+	samples  []int16
+	leftover float64 // how far past the end of the last tone its last sample was, in seconds
+}
+
+// tone adds whole cycles of a sine wave, carrying on from where the last
+// tone ended so there is no jump in between
+func (e *encoder) tone(frequency float64, cycles int) {
+	step := frequency / e.rate
+	p := e.leftover * frequency
+	for ; p < float64(cycles); p += step {
+		e.samples = append(e.samples, int16(amplitude*math.Sin(2*math.Pi*p)))
+	}
+	e.leftover = (p - float64(cycles)) / frequency
+}
+
+func (e *encoder) char(c byte) {
+	for i := 0; i < 8; i++ {
+		e.tone(highTone, highCycles)
+		if c&1 == 0 {
+			e.tone(highTone, highCycles)
+		} else {
+			e.tone(lowTone, lowCycles)
+		}
+		e.tone(lowTone, lowCycles)
+		c >>= 1
+	}
+}
+
+func (e *encoder) hex(b byte) {
+	e.char(hexDigits[b>>4])
+	e.char(hexDigits[b&15])
+}
+
+func (e *encoder) silence(seconds float64) {
+	for n := int(seconds * e.rate); n > 0; n-- {
+		e.samples = append(e.samples, 0)
+	}
+	e.leftover = 0
+}
+
+// EncodeCassette returns the sound DUMPT would make saving each of files,
+// with a second of silence after each one, as 16 bit samples at rate
+func EncodeCassette(files []TapeFile, rate int) []int16 {
+	e := &encoder{rate: float64(rate)}
+	e.silence(0.5)
+	for _, f := range files {
+		for i := 0; i < syncLength; i++ {
+			e.char(syn)
+		}
+		e.char('*')
+		e.hex(f.ID)
+		e.hex(byte(f.Address))
+		e.hex(byte(f.Address >> 8))
+		for _, b := range f.Data {
+			e.hex(b)
+		}
+		e.char('/')
+		e.hex(byte(f.Checksum))
+		e.hex(byte(f.Checksum >> 8))
+		e.char(eot)
+		e.char(eot)
+		e.silence(1)
+	}
+	return e.samples
+}
+
+// DecodeCassette finds the files in a recording of KIM-1 cassette tones,
+// including ones whose checksum is wrong. It works in three passes, each a
+// single loop over what the one before made: the times the signal crosses
+// zero, then the bits from the time between crossings, and then the
+// characters and files in the bits. An hour of audio takes a few seconds.
+func DecodeCassette(samples []int16, rate int) []TapeFile {
+	crossings := zeroCrossings(samples, float64(rate))
+	bits := readBits(crossings, float64(rate))
+	return readFiles(bits)
+}
+
+// zeroCrossings returns where the signal crosses zero, in samples. It
+// filters out anything well away from the tones first, and uses hysteresis of a quarter of the recent
+// peak level so that noise near zero doesn't count. Each crossing is placed
+// between the two samples either side of it in proportion to their levels.
+func zeroCrossings(samples []int16, rate float64) []float64 {
+	crossings := make([]float64, 0, len(samples)/4)
+	decay := float32(1 - 20/rate) // the peak level halves in about 35ms
+	var last, peak float32
+	var zero float64
+	high := false
+
+	// A band-pass biquad around the two tones, which also takes out any DC
+	// offset
+	w := 2 * math.Pi * math.Sqrt(highTone*lowTone) / rate
+	alpha := math.Sin(w) / (2 * 0.6)
+	a0 := 1 + alpha
+	b0 := float32(alpha / a0)
+	a1 := float32(-2 * math.Cos(w) / a0)
+	a2 := float32((1 - alpha) / a0)
+	var x1, x2, y1, y2 float32
+
+	for i, s := range samples {
+		x := float32(s)
+		y := b0*(x-x2) - a1*y1 - a2*y2
+		x2, x1 = x1, x
+		y2, y1 = y1, y
+		if (y >= 0) != (last >= 0) {
+			zero = float64(i-1) + float64(last/(last-y))
+		}
+		last = y
+
+		level := y
+		if level < 0 {
+			level = -level
+		}
+		if level > peak {
+			peak = level
+		} else {
+			peak *= decay
+		}
+		threshold := peak / 4
+		if threshold < 64 {
+			threshold = 64
+		}
+
+		if !high && y > threshold {
+			high = true
+			crossings = append(crossings, zero)
+		} else if high && y < -threshold {
+			high = false
+			crossings = append(crossings, zero)
+		}
+	}
+	return crossings
+}
+
+// A gap in the bits, where there was silence or something other than
+// either tone
+const gapBit = 2
+
+// readBits turns the time between crossings, each half a cycle of one tone
+// or the other, into bits, each a run of the high tone and then a run of
+// the low one. Like LOADT, a bit is a 1 if the low tone lasted longer. A
+// single half cycle that looks like the other tone is taken to be noise.
+func readBits(crossings []float64, rate float64) []byte {
+	bits := make([]byte, 0, len(crossings)/30)
+	split := rate / (highTone + lowTone)
+	gap := rate / 1000
+	var runs [2]float64 // time in the high tone and then the low one
+	var other float64   // time in what may turn out to be the other tone
+	count := 0          // half cycles of it
+	tone := -1
+
+	for i := 1; i < len(crossings); i++ {
+		d := crossings[i] - crossings[i-1]
+		if d > gap {
+			if runs[0] > 0 && runs[1] > 0 {
+				bits = append(bits, bit(runs[0], runs[1]))
+			}
+			bits = append(bits, gapBit)
+			runs = [2]float64{}
+			other, count, tone = 0, 0, -1
+			continue
+		}
+
+		t := 0
+		if d >= split {
+			t = 1
+		}
+		if tone < 0 {
+			tone = t
+		}
+		if t == tone {
+			runs[tone] += d + other
+			other, count = 0, 0
+			continue
+		}
+		other += d
+		count++
+		if count < 2 {
+			continue
+		}
+
+		// It really has changed tone. Going back to the high one starts the
+		// next bit.
+		if t == 0 {
+			if runs[1] > 0 && runs[0] > 0 {
+				bits = append(bits, bit(runs[0], runs[1]))
+			}
+			runs = [2]float64{}
+		}
+		runs[t] += other
+		other, count, tone = 0, 0, t
+	}
+	return bits
+}
+
+func bit(high float64, low float64) byte {
+	if low > high {
+		return 1
+	}
+	return 0
+}
+
+// readChar reads the 8 bits at i, low bit first, and drops the top bit as
+// LOADT does. Returns false if there's a gap or the bits run out.
+func readChar(bits []byte, i int) (byte, bool) {
+	if i+8 > len(bits) {
+		return 0, false
+	}
+	var c byte
+	for j := 7; j >= 0; j-- {
+		if bits[i+j] == gapBit {
+			return 0, false
+		}
+		c = c<<1 | bits[i+j]
+	}
+	return c & 0x7f, true
+}
+
+// readHex reads two hex digit characters at i as a byte
+func readHex(bits []byte, i int) (byte, bool) {
+	var b byte
+	for j := 0; j < 2; j++ {
+		c, ok := readChar(bits, i+8*j)
+		if !ok {
+			return 0, false
+		}
+		switch {
+		case c >= '0' && c <= '9':
+			b = b<<4 | (c - '0')
+		case c >= 'A' && c <= 'F':
+			b = b<<4 | (c - 'A' + 10)
+		default:
+			return 0, false
+		}
+	}
+	return b, true
+}
+
+// findSync looks a bit at a time from i for four SYNs in a row, which is
+// where the characters start, and returns the position after them, or -1
+func findSync(bits []byte, i int) int {
+	var shift byte
+	count := 0
+	for ; i < len(bits); i++ {
+		if bits[i] == gapBit {
+			count = 0
+			continue
+		}
+		shift = shift>>1 | bits[i]<<7
+		count++
+		if count >= 8 && shift&0x7f == syn {
+			n := 1
+			for ; n < 4; n++ {
+				if c, ok := readChar(bits, i+1+8*(n-1)); !ok || c != syn {
+					break
+				}
+			}
+			if n == 4 {
+				return i + 1 + 8*3
+			}
+		}
+	}
+	return -1
+}
+
+// readFile reads a file from just after the SYNs at i. Returns the file,
+// whether it was all there, and where to carry on looking.
+func readFile(bits []byte, i int) (TapeFile, bool, int) {
+	var f TapeFile
+	for {
+		c, ok := readChar(bits, i)
+		if !ok {
+			return f, false, i
+		}
+		i += 8
+		if c == '*' {
+			break
+		}
+		if c != syn {
+			return f, false, i
+		}
+	}
+
+	var header [3]byte
+	for j := range header {
+		b, ok := readHex(bits, i)
+		if !ok {
+			return f, false, i
+		}
+		header[j] = b
+		i += 16
+	}
+	f.ID = header[0]
+	f.Address = uint16(header[1]) | uint16(header[2])<<8
+
+	for {
+		if c, ok := readChar(bits, i); ok && c == '/' {
+			i += 8
+			break
+		}
+		b, ok := readHex(bits, i)
+		if !ok || len(f.Data) == 0x10000 {
+			return f, false, i
+		}
+		f.Data = append(f.Data, b)
+		i += 16
+	}
+
+	low, ok := readHex(bits, i)
+	if !ok {
+		return f, false, i
+	}
+	high, ok := readHex(bits, i+16)
+	if !ok {
+		return f, false, i
+	}
+	f.Checksum = uint16(low) | uint16(high)<<8
+	return f, true, i + 32
+}
+
+func readFiles(bits []byte) []TapeFile {
+	var files []TapeFile
+	for i := findSync(bits, 0); i >= 0; i = findSync(bits, i) {
+		f, ok, next := readFile(bits, i)
+		if ok {
+			files = append(files, f)
+		}
+		i = next
+	}
+	return files
+}
@@ -0,0 +1,160 @@
+package kim
+
+import (
+	"bytes"
+	"encoding/binary"
+	"flag"
+	"math"
+	"math/rand"
+	"os"
+	"path/filepath"
+	"testing"
+)
+
+var update = flag.Bool("update", false, "write testdata/reference.wav again")
+
+func testFiles() []TapeFile {
+	every := make([]byte, 256)
+	for i := range every {
+		every[i] = byte(i)
+	}
+	files := []TapeFile{
+		{ID: 0x01, Address: 0x0200, Data: every},
+		{ID: 0x42, Address: 0x2000, Data: []byte{0xa9}},
+		{ID: 0xfe, Address: 0x17f0, Data: []byte{0x00, 0xff, 0x55, 0xaa}},
+	}
+	for i := range files {
+		files[i].Checksum = files[i].Sum()
+	}
+	// A bad checksum has to come through as it was
+	files[1].Checksum ^= 0x0100
+	return files
+}
+
+func sameFiles(t *testing.T, got []TapeFile, want []TapeFile) {
+	t.Helper()
+	if len(got) != len(want) {
+		t.Fatalf("decoded %d files, want %d", len(got), len(want))
+	}
+	for i := range want {
+		g, w := got[i], want[i]
+		if g.ID != w.ID || g.Address != w.Address || g.Checksum != w.Checksum || !bytes.Equal(g.Data, w.Data) {
+			t.Errorf("file %d is %v checksum %04X, want %v checksum %04X", i, g, g.Checksum, w, w.Checksum)
+		}
+	}
+}
+
+// skew plays samples back speed times as fast, the way a tape running
+// fast or slow would
+func skew(samples []int16, speed float64) []int16 {
+	out := make([]int16, 0, int(float64(len(samples))/speed))
+	for p := 0.0; p < float64(len(samples)-1); p += speed {
+		i := int(p)
+		f := p - float64(i)
+		out = append(out, int16(float64(samples[i])*(1-f)+float64(samples[i+1])*f))
+	}
+	return out
+}
+
+// spoil adds hiss, mains hum and a DC offset, and turns the volume down
+func spoil(samples []int16, rate int, seed int64) []int16 {
+	r := rand.New(rand.NewSource(seed))
+	out := make([]int16, len(samples))
+	for i, s := range samples {
+		hum := 2000 * math.Sin(2*math.Pi*60*float64(i)/float64(rate))
+		v := 0.5*float64(s) + hum + 500 + float64(r.Intn(5001)-2500)
+		out[i] = int16(math.Max(-32768, math.Min(32767, v)))
+	}
+	return out
+}
+
+func TestCassetteRoundTrip(t *testing.T) {
+	want := testFiles()
+	for _, rate := range []int{16000, 22050, 44100, 48000} {
+		got := DecodeCassette(EncodeCassette(want, rate), rate)
+		t.Logf("%d Hz", rate)
+		sameFiles(t, got, want)
+	}
+}
+
+func TestCassetteSkewedAndNoisy(t *testing.T) {
+	want := testFiles()
+	samples := EncodeCassette(want, 44100)
+	for _, speed := range []float64{0.94, 0.97, 1.03, 1.06} {
+		got := DecodeCassette(spoil(skew(samples, speed), 44100, int64(speed*100)), 44100)
+		t.Logf("speed %.2f", speed)
+		sameFiles(t, got, want)
+	}
+}
+
+func TestWAVRoundTrip(t *testing.T) {
+	samples := EncodeCassette(testFiles()[1:2], 22050)
+	path := filepath.Join(t.TempDir(), "tape.wav")
+	if err := WriteWAV(path, samples, 22050); err != nil {
+		t.Fatal(err)
+	}
+	got, rate, err := ReadWAV(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if rate != 22050 || len(got) != len(samples) {
+		t.Fatalf("read %d samples at %d Hz, want %d at 22050", len(got), rate, len(samples))
+	}
+	for i := range samples {
+		if got[i] != samples[i] {
+			t.Fatalf("sample %d is %d, want %d", i, got[i], samples[i])
+		}
+	}
+}
+
+// The file in testdata/reference.wav
+var referenceFile = TapeFile{
+	ID:       0x07,
+	Address:  0x0300,
+	Data:     []byte{0xa9, 0x00, 0x85, 0xfb, 0xa9, 0x12, 0x85, 0xfa, 0x20, 0x1f, 0x1f, 0x4c, 0x08, 0x03, 0xea, 0x00},
+	Checksum: 0x0605,
+}
+
+// writeReference makes testdata/reference.wav from the encoder, worn the
+// way an old cassette would be, 3% slow with hiss and hum, and kept small:
+// only the last few SYNs, and 8 bits at 16000 Hz
+func writeReference(t *testing.T, path string) {
+	const rate = 16000
+	e := &encoder{rate: rate}
+	e.char(syn)
+	samples := EncodeCassette([]TapeFile{referenceFile}, rate)
+	samples = samples[rate/2+92*len(e.samples) : len(samples)-rate*4/5]
+	samples = spoil(skew(samples, 0.97), rate, 7)
+
+	var out bytes.Buffer
+	out.WriteString("RIFF")
+	binary.Write(&out, binary.LittleEndian, uint32(36+len(samples)))
+	out.WriteString("WAVEfmt ")
+	binary.Write(&out, binary.LittleEndian, []uint32{16})
+	binary.Write(&out, binary.LittleEndian, []uint16{1, 1})
+	binary.Write(&out, binary.LittleEndian, []uint32{rate, rate})
+	binary.Write(&out, binary.LittleEndian, []uint16{1, 8})
+	out.WriteString("data")
+	binary.Write(&out, binary.LittleEndian, uint32(len(samples)))
+	for _, s := range samples {
+		out.WriteByte(byte(s>>8) + 0x80)
+	}
+	if err := os.WriteFile(path, out.Bytes(), 0644); err != nil {
+		t.Fatal(err)
+	}
+}
+
+func TestReferenceWAV(t *testing.T) {
+	path := filepath.Join("testdata", "reference.wav")
+	if referenceFile.Sum() != referenceFile.Checksum {
+		t.Fatalf("the reference file's checksum should be %04X", referenceFile.Sum())
+	}
+	if *update {
+		writeReference(t, path)
+	}
+	samples, rate, err := ReadWAV(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	sameFiles(t, DecodeCassette(samples, rate), []TapeFile{referenceFile})
+}
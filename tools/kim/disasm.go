@@ -0,0 +1,339 @@
+package kim
+
+import "fmt"
+
+// Mode is a 6502 addressing mode
+type Mode int
+
+const (
+	Imp Mode = iota
+	Acc
+	Imm
+	ZP
+	ZPX
+	ZPY
+	Rel
+	Abs
+	AbsX
+	AbsY
+	Ind
+	IndX
+	IndY
+)
+
+// Op describes one opcode the way the emulator's optable decodes it,
+// including the undocumented ones
+type Op struct {
+	Name string
+	Mode Mode
+}
+
+// Length returns the number of bytes in the instruction, opcode included
+func (op Op) Length() int {
+	switch op.Mode {
+	case Imp, Acc:
+		return 1
+	case Abs, AbsX, AbsY, Ind:
+		return 3
+	}
+	return 2
+}
+
+// Disassemble formats an instruction at pc with the given operand bytes
+func Disassemble(pc uint16, opcode uint8, operand []byte) string {
+	op := Ops[opcode]
+	var lo, word uint16
+	if len(operand) > 0 {
+		lo = uint16(operand[0])
+	}
+	if len(operand) > 1 {
+		word = lo | uint16(operand[1])<<8
+	}
+	switch op.Mode {
+	case Acc:
+		return op.Name + " A"
+	case Imm:
+		return fmt.Sprintf("%s #$%02X", op.Name, lo)
+	case ZP:
+		return fmt.Sprintf("%s $%02X", op.Name, lo)
+	case ZPX:
+		return fmt.Sprintf("%s $%02X,X", op.Name, lo)
+	case ZPY:
+		return fmt.Sprintf("%s $%02X,Y", op.Name, lo)
+	case Rel:
+		return fmt.Sprintf("%s $%04X", op.Name, pc+2+uint16(int8(lo)))
+	case Abs:
+		return fmt.Sprintf("%s $%04X", op.Name, word)
+	case AbsX:
+		return fmt.Sprintf("%s $%04X,X", op.Name, word)
+	case AbsY:
+		return fmt.Sprintf("%s $%04X,Y", op.Name, word)
+	case Ind:
+		return fmt.Sprintf("%s ($%04X)", op.Name, word)
+	case IndX:
+		return fmt.Sprintf("%s ($%02X,X)", op.Name, lo)
+	case IndY:
+		return fmt.Sprintf("%s ($%02X),Y", op.Name, lo)
+	}
+	return op.Name
+}
+
+// Ops is indexed by opcode
+var Ops = [256]Op{
+	{"BRK", Imp},  // 00
+	{"ORA", IndX}, // 01
+	{"NOP", Imp},  // 02
+	{"SLO", IndX}, // 03
+	{"NOP", ZP},   // 04
+	{"ORA", ZP},   // 05
+	{"ASL", ZP},   // 06
+	{"SLO", ZP},   // 07
+	{"PHP", Imp},  // 08
+	{"ORA", Imm},  // 09
+	{"ASL", Acc},  // 0A
+	{"NOP", Imm},  // 0B
+	{"NOP", Abs},  // 0C
+	{"ORA", Abs},  // 0D
+	{"ASL", Abs},  // 0E
+	{"SLO", Abs},  // 0F
+	{"BPL", Rel},  // 10
+	{"ORA", IndY}, // 11
+	{"NOP", Imp},  // 12
+	{"SLO", IndY}, // 13
+	{"NOP", ZPX},  // 14
+	{"ORA", ZPX},  // 15
+	{"ASL", ZPX},  // 16
+	{"SLO", ZPX},  // 17
+	{"CLC", Imp},  // 18
+	{"ORA", AbsY}, // 19
+	{"NOP", Imp},  // 1A
+	{"SLO", AbsY}, // 1B
+	{"NOP", AbsX}, // 1C
+	{"ORA", AbsX}, // 1D
+	{"ASL", AbsX}, // 1E
+	{"SLO", AbsX}, // 1F
+	{"JSR", Abs},  // 20
+	{"AND", IndX}, // 21
+	{"NOP", Imp},  // 22
+	{"RLA", IndX}, // 23
+	{"BIT", ZP},   // 24
+	{"AND", ZP},   // 25
+	{"ROL", ZP},   // 26
+	{"RLA", ZP},   // 27
+	{"PLP", Imp},  // 28
+	{"AND", Imm},  // 29
+	{"ROL", Acc},  // 2A
+	{"NOP", Imm},  // 2B
+	{"BIT", Abs},  // 2C
+	{"AND", Abs},  // 2D
+	{"ROL", Abs},  // 2E
+	{"RLA", Abs},  // 2F
+	{"BMI", Rel},  // 30
+	{"AND", IndY}, // 31
+	{"NOP", Imp},  // 32
+	{"RLA", IndY}, // 33
+	{"NOP", ZPX},  // 34
+	{"AND", ZPX},  // 35
+	{"ROL", ZPX},  // 36
+	{"RLA", ZPX},  // 37
+	{"SEC", Imp},  // 38
+	{"AND", AbsY}, // 39
+	{"NOP", Imp},  // 3A
+	{"RLA", AbsY}, // 3B
+	{"NOP", AbsX}, // 3C
+	{"AND", AbsX}, // 3D
+	{"ROL", AbsX}, // 3E
+	{"RLA", AbsX}, // 3F
+	{"RTI", Imp},  // 40
+	{"EOR", IndX}, // 41
+	{"NOP", Imp},  // 42
+	{"SRE", IndX}, // 43
+	{"NOP", ZP},   // 44
+	{"EOR", ZP},   // 45
+	{"LSR", ZP},   // 46
+	{"SRE", ZP},   // 47
+	{"PHA", Imp},  // 48
+	{"EOR", Imm},  // 49
+	{"LSR", Acc},  // 4A
+	{"NOP", Imm},  // 4B
+	{"JMP", Abs},  // 4C
+	{"EOR", Abs},  // 4D
+	{"LSR", Abs},  // 4E
+	{"SRE", Abs},  // 4F
+	{"BVC", Rel},  // 50
+	{"EOR", IndY}, // 51
+	{"NOP", Imp},  // 52
+	{"SRE", IndY}, // 53
+	{"NOP", ZPX},  // 54
+	{"EOR", ZPX},  // 55
+	{"LSR", ZPX},  // 56
+	{"SRE", ZPX},  // 57
+	{"CLI", Imp},  // 58
+	{"EOR", AbsY}, // 59
+	{"NOP", Imp},  // 5A
+	{"SRE", AbsY}, // 5B
+	{"NOP", AbsX}, // 5C
+	{"EOR", AbsX}, // 5D
+	{"LSR", AbsX}, // 5E
+	{"SRE", AbsX}, // 5F
+	{"RTS", Imp},  // 60
+	{"ADC", IndX}, // 61
+	{"NOP", Imp},  // 62
+	{"RRA", IndX}, // 63
+	{"NOP", ZP},   // 64
+	{"ADC", ZP},   // 65
+	{"ROR", ZP},   // 66
+	{"RRA", ZP},   // 67
+	{"PLA", Imp},  // 68
+	{"ADC", Imm},  // 69
+	{"ROR", Acc},  // 6A
+	{"NOP", Imm},  // 6B
+	{"JMP", Ind},  // 6C
+	{"ADC", Abs},  // 6D
+	{"ROR", Abs},  // 6E
+	{"RRA", Abs},  // 6F
+	{"BVS", Rel},  // 70
+	{"ADC", IndY}, // 71
+	{"NOP", Imp},  // 72
+	{"RRA", IndY}, // 73
+	{"NOP", ZPX},  // 74
+	{"ADC", ZPX},  // 75
+	{"ROR", ZPX},  // 76
+	{"RRA", ZPX},  // 77
+	{"SEI", Imp},  // 78
+	{"ADC", AbsY}, // 79
+	{"NOP", Imp},  // 7A
+	{"RRA", AbsY}, // 7B
+	{"NOP", AbsX}, // 7C
+	{"ADC", AbsX}, // 7D
+	{"ROR", AbsX}, // 7E
+	{"RRA", AbsX}, // 7F
+	{"NOP", Imm},  // 80
+	{"STA", IndX}, // 81
+	{"NOP", Imp},  // 82
+	{"SAX", IndX}, // 83
+	{"STY", ZP},   // 84
+	{"STA", ZP},   // 85
+	{"STX", ZP},   // 86
+	{"SAX", ZP},   // 87
+	{"DEY", Imp},  // 88
+	{"NOP", Imm},  // 89
+	{"TXA", Imp},  // 8A
+	{"NOP", Imm},  // 8B
+	{"STY", Abs},  // 8C
+	{"STA", Abs},  // 8D
+	{"STX", Abs},  // 8E
+	{"SAX", Abs},  // 8F
+	{"BCC", Rel},  // 90
+	{"STA", IndY}, // 91
+	{"NOP", Imp},  // 92
+	{"NOP", IndY}, // 93
+	{"STY", ZPX},  // 94
+	{"STA", ZPX},  // 95
+	{"STX", ZPY},  // 96
+	{"SAX", ZPY},  // 97
+	{"TYA", Imp},  // 98
+	{"STA", AbsY}, // 99
+	{"TXS", Imp},  // 9A
+	{"NOP", AbsY}, // 9B
+	{"NOP", AbsX}, // 9C
+	{"STA", AbsX}, // 9D
+	{"NOP", AbsY}, // 9E
+	{"NOP", AbsY}, // 9F
+	{"LDY", Imm},  // A0
+	{"LDA", IndX}, // A1
+	{"LDX", Imm},  // A2
+	{"LAX", IndX}, // A3
+	{"LDY", ZP},   // A4
+	{"LDA", ZP},   // A5
+	{"LDX", ZP},   // A6
+	{"LAX", ZP},   // A7
+	{"TAY", Imp},  // A8
+	{"LDA", Imm},  // A9
+	{"TAX", Imp},  // AA
+	{"NOP", Imm},  // AB
+	{"LDY", Abs},  // AC
+	{"LDA", Abs},  // AD
+	{"LDX", Abs},  // AE
+	{"LAX", Abs},  // AF
+	{"BCS", Rel},  // B0
+	{"LDA", IndY}, // B1
+	{"NOP", Imp},  // B2
+	{"LAX", IndY}, // B3
+	{"LDY", ZPX},  // B4
+	{"LDA", ZPX},  // B5
+	{"LDX", ZPY},  // B6
+	{"LAX", ZPY},  // B7
+	{"CLV", Imp},  // B8
+	{"LDA", AbsY}, // B9
+	{"TSX", Imp},  // BA
+	{"LAX", AbsY}, // BB
+	{"LDY", AbsX}, // BC
+	{"LDA", AbsX}, // BD
+	{"LDX", AbsY}, // BE
+	{"LAX", AbsY}, // BF
+	{"CPY", Imm},  // C0
+	{"CMP", IndX}, // C1
+	{"NOP", Imp},  // C2
+	{"DCP", IndX}, // C3
+	{"CPY", ZP},   // C4
+	{"CMP", ZP},   // C5
+	{"DEC", ZP},   // C6
+	{"DCP", ZP},   // C7
+	{"INY", Imp},  // C8
+	{"CMP", Imm},  // C9
+	{"DEX", Imp},  // CA
+	{"NOP", Imm},  // CB
+	{"CPY", Abs},  // CC
+	{"CMP", Abs},  // CD
+	{"DEC", Abs},  // CE
+	{"DCP", Abs},  // CF
+	{"BNE", Rel},  // D0
+	{"CMP", IndY}, // D1
+	{"NOP", Imp},  // D2
+	{"DCP", IndY}, // D3
+	{"NOP", ZPX},  // D4
+	{"CMP", ZPX},  // D5
+	{"DEC", ZPX},  // D6
+	{"DCP", ZPX},  // D7
+	{"CLD", Imp},  // D8
+	{"CMP", AbsY}, // D9
+	{"NOP", Imp},  // DA
+	{"DCP", AbsY}, // DB
+	{"NOP", AbsX}, // DC
+	{"CMP", AbsX}, // DD
+	{"DEC", AbsX}, // DE
+	{"DCP", AbsX}, // DF
+	{"CPX", Imm},  // E0
+	{"SBC", IndX}, // E1
+	{"NOP", Imp},  // E2
+	{"ISB", IndX}, // E3
+	{"CPX", ZP},   // E4
+	{"SBC", ZP},   // E5
+	{"INC", ZP},   // E6
+	{"ISB", ZP},   // E7
+	{"INX", Imp},  // E8
+	{"SBC", Imm},  // E9
+	{"NOP", Imp},  // EA
+	{"SBC", Imm},  // EB
+	{"CPX", Abs},  // EC
+	{"SBC", Abs},  // ED
+	{"INC", Abs},  // EE
+	{"ISB", Abs},  // EF
+	{"BEQ", Rel},  // F0
+	{"SBC", IndY}, // F1
+	{"NOP", Imp},  // F2
+	{"ISB", IndY}, // F3
+	{"NOP", ZPX},  // F4
+	{"SBC", ZPX},  // F5
+	{"INC", ZPX},  // F6
+	{"ISB", ZPX},  // F7
+	{"SED", Imp},  // F8
+	{"SBC", AbsY}, // F9
+	{"NOP", Imp},  // FA
+	{"ISB", AbsY}, // FB
+	{"NOP", AbsX}, // FC
+	{"SBC", AbsX}, // FD
+	{"INC", AbsX}, // FE
+	{"ISB", AbsX}, // FF
+}
@@ -0,0 +1,51 @@
+package kim
+
+import (
+	"bufio"
+	"fmt"
+	"io"
+	"os"
+)
+
+// OpenDump opens a binary dump from the emulator. If path is the serial
+// device (set up beforehand with something like "stty -F /dev/ttyUSB0 9600
+// raw"), the trigger character is sent to ask for the dump. Otherwise path
+// is a file the output was captured to. Either way anything before magic,
+// such as KIM-1 terminal output, is skipped.
+func OpenDump(path string, trigger byte, magic string) (*bufio.Reader, io.Closer, error) {
+	info, err := os.Stat(path)
+	if err != nil {
+		return nil, nil, err
+	}
+
+	var f *os.File
+	if info.Mode()&os.ModeCharDevice != 0 {
+		f, err = os.OpenFile(path, os.O_RDWR, 0)
+		if err == nil {
+			_, err = f.Write([]byte{trigger})
+		}
+	} else {
+		f, err = os.Open(path)
+	}
+	if err != nil {
+		return nil, nil, err
+	}
+
+	r := bufio.NewReader(f)
+	matched := 0
+	for matched < len(magic) {
+		b, err := r.ReadByte()
+		if err != nil {
+			f.Close()
+			return nil, nil, fmt.Errorf("no %s dump found in %s", magic, path)
+		}
+		if b == magic[matched] {
+			matched++
+		} else if b == magic[0] {
+			matched = 1
+		} else {
+			matched = 0
+		}
+	}
+	return r, f, nil
+}
@@ -0,0 +1,126 @@
+package kim
+
+import "errors"
+
+var errLZ4 = errors.New("damaged LZ4 block")
+
+// Decompress expands an LZ4 block, the format lz4.c in the firmware writes,
+// which has to come out to exactly length bytes.
+func Decompress(src []byte, length int) ([]byte, error) {
+	dst := make([]byte, 0, length)
+	i := 0
+	readLength := func(n int) (int, error) {
+		if n != 15 {
+			return n, nil
+		}
+		for {
+			if i >= len(src) {
+				return 0, errLZ4
+			}
+			b := src[i]
+			i++
+			n += int(b)
+			if b != 255 {
+				return n, nil
+			}
+		}
+	}
+
+	for i < len(src) {
+		token := src[i]
+		i++
+		count, err := readLength(int(token >> 4))
+		if err != nil {
+			return nil, err
+		}
+		if count > len(src)-i || count > length-len(dst) {
+			return nil, errLZ4
+		}
+		dst = append(dst, src[i:i+count]...)
+		i += count
+
+		// The last sequence stops after its literals
+		if i == len(src) {
+			break
+		}
+
+		if len(src)-i < 2 {
+			return nil, errLZ4
+		}
+		offset := int(src[i]) | int(src[i+1])<<8
+		i += 2
+		match, err := readLength(int(token & 15))
+		if err != nil {
+			return nil, err
+		}
+		match += 4
+		if offset == 0 || offset > len(dst) || match > length-len(dst) {
+			return nil, errLZ4
+		}
+		for j := 0; j < match; j++ {
+			dst = append(dst, dst[len(dst)-offset])
+		}
+	}
+	if len(dst) != length {
+		return nil, errLZ4
+	}
+	return dst, nil
+}
+
+// Compress packs src, at most 65535 bytes, into an LZ4 block with the same
+// limits the firmware keeps to: the last five bytes are literals and no
+// match starts in the last twelve.
+func Compress(src []byte) []byte {
+	var dst []byte
+	putLength := func(n int) {
+		for ; n >= 255; n -= 255 {
+			dst = append(dst, 255)
+		}
+		dst = append(dst, byte(n))
+	}
+	putSequence := func(literals []byte, offset, match int) {
+		extra := 0
+		if match > 0 {
+			extra = match - 4
+		}
+		dst = append(dst, byte(min15(len(literals))<<4|min15(extra)))
+		if len(literals) >= 15 {
+			putLength(len(literals) - 15)
+		}
+		dst = append(dst, literals...)
+		if match > 0 {
+			dst = append(dst, byte(offset), byte(offset>>8))
+			if extra >= 15 {
+				putLength(extra - 15)
+			}
+		}
+	}
+
+	table := map[uint32]int{}
+	anchor := 0
+	for i := 0; i < len(src)-12; {
+		key := uint32(src[i]) | uint32(src[i+1])<<8 | uint32(src[i+2])<<16 | uint32(src[i+3])<<24
+		candidate, ok := table[key]
+		table[key] = i
+		if ok && i-candidate <= 65535 {
+			match := 4
+			for match < len(src)-5-i && src[candidate+match] == src[i+match] {
+				match++
+			}
+			putSequence(src[anchor:i], i-candidate, match)
+			i += match
+			anchor = i
+		} else {
+			i++
+		}
+	}
+	putSequence(src[anchor:], 0, 0)
+	return dst
+}
+
+func min15(n int) int {
+	if n < 15 {
+		return n
+	}
+	return 15
+}
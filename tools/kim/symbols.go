@@ -0,0 +1,122 @@
+// Package kim holds what the host tools know about the KIM-1 itself.
+package kim
+
+import (
+	"sort"
+	"strconv"
+)
+
+// Symbol is a named entry point in the KIM-1 ROMs
+type Symbol struct {
+	Addr uint16
+	Name string
+}
+
+// ROMSymbols are the entry points from the KIM-1 monitor listing, in the
+// 6530-003 (0x1800-0x1bff) and 6530-002 (0x1c00-0x1fff) ROMs
+var ROMSymbols = []Symbol{
+	{0x1800, "DUMPT"},
+	{0x1873, "LOADT"},
+	{0x1932, "INTVEB"},
+	{0x194c, "CHKT"},
+	{0x195e, "OUTBTC"},
+	{0x1961, "OUTBT"},
+	{0x196f, "HEXOUT"},
+	{0x197a, "OUTCHT"},
+	{0x199e, "ONE"},
+	{0x19c4, "ZRO"},
+	{0x19ea, "INCVEB"},
+	{0x19f3, "RDBYT"},
+	{0x1a00, "PACKT"},
+	{0x1a24, "RDCHT"},
+	{0x1a41, "RDBIT"},
+	{0x1c00, "SAVE"},
+	{0x1c1c, "NMIT"},
+	{0x1c1f, "IRQT"},
+	{0x1c22, "RST"},
+	{0x1c4f, "START"},
+	{0x1c64, "CLEAR"},
+	{0x1c6a, "READ"},
+	{0x1ce7, "LOAD"},
+	{0x1d2e, "LOAD7"},
+	{0x1d3e, "LOADER"},
+	{0x1dc8, "GOEXEC"},
+	{0x1e1e, "PRTPNT"},
+	{0x1e2f, "CRLF"},
+	{0x1e31, "PRTST"},
+	{0x1e3b, "PRTBYT"},
+	{0x1e4c, "HEXTA"},
+	{0x1e5a, "GETCH"},
+	{0x1e88, "INITS"},
+	{0x1e8c, "INIT1"},
+	{0x1e9e, "OUTSP"},
+	{0x1ea0, "OUTCH"},
+	{0x1ed4, "DELAY"},
+	{0x1eeb, "DEHALF"},
+	{0x1efe, "AK"},
+	{0x1f19, "SCAND"},
+	{0x1f1f, "SCANDS"},
+	{0x1f40, "KEYIN"},
+	{0x1f48, "CONVD"},
+	{0x1f63, "INCPT"},
+	{0x1f6a, "GETKEY"},
+	{0x1f91, "CHK"},
+	{0x1f9d, "GETBYT"},
+	{0x1fac, "PACK"},
+	{0x1fcc, "OPEN"},
+	{0x1fe7, "TABLE"},
+}
+
+// IsROM reports whether addr is in one of the ROMs, including the copy of
+// the 6530-002 that the emulator mirrors at the top of memory for the vectors
+func IsROM(addr uint16) bool {
+	return (addr >= 0x1800 && addr < 0x2000) || addr >= 0xff00
+}
+
+func romAddr(addr uint16) uint16 {
+	if addr >= 0xff00 {
+		return addr - 0xe000
+	}
+	return addr
+}
+
+// Label names a ROM address as the closest entry point at or before it,
+// for example "SCANDS+5". It returns "" for addresses outside the ROMs.
+func Label(addr uint16) string {
+	if !IsROM(addr) {
+		return ""
+	}
+	addr = romAddr(addr)
+	i := sort.Search(len(ROMSymbols), func(i int) bool { return ROMSymbols[i].Addr > addr }) - 1
+	if i < 0 {
+		return ""
+	}
+	sym := ROMSymbols[i]
+	if sym.Addr == addr {
+		return sym.Name
+	}
+	return sym.Name + "+" + strconv.Itoa(int(addr-sym.Addr))
+}
+
+// Exact returns the name of the entry point at exactly addr, or ""
+func Exact(addr uint16) string {
+	addr = romAddr(addr)
+	for _, sym := range ROMSymbols {
+		if sym.Addr == addr {
+			return sym.Name
+		}
+	}
+	return ""
+}
+
+// Within returns the names of the entry points in [start, end)
+func Within(start uint32, end uint32) []string {
+	var names []string
+	for _, sym := range ROMSymbols {
+		a := uint32(sym.Addr)
+		if (a >= start && a < end) || (a >= 0x1f00 && a+0xe000 >= start && a+0xe000 < end) {
+			names = append(names, sym.Name)
+		}
+	}
+	return names
+}
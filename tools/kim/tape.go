@@ -0,0 +1,129 @@
+package kim
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+)
+
+// TapeFile is one file DUMPT saved, on a cassette or on the virtual tape of
+// a TAPE build
+type TapeFile struct {
+	ID       uint8
+	Address  uint16
+	Data     []byte
+	Checksum uint16 // as saved after the data
+}
+
+// Sum works out the checksum the file should have, the sum of SAL, SAH and
+// the data
+func (f TapeFile) Sum() uint16 {
+	sum := uint16(f.Address&0xff) + f.Address>>8
+	for _, b := range f.Data {
+		sum += uint16(b)
+	}
+	return sum
+}
+
+// Where the virtual tape lives in flash, and how it is laid out, as in
+// storage.h and tape.h
+const (
+	TapeAddress = 0x08028000
+	TapeSize    = 0x8000
+
+	tapeHalf    = TapeSize / 2
+	tapeMagic   = 0x544d494b // "KIMT"
+	tapeVersion = 1
+)
+
+type tapeHeader struct {
+	Magic      uint32
+	Version    uint16
+	Reserved   uint16
+	Generation uint32
+}
+
+type tapeFile struct {
+	Length   uint16
+	Address  uint16
+	ID       uint8
+	Reserved uint8
+	Checksum uint16
+	Done     uint16
+}
+
+// ReadTape returns the files on a virtual tape read out of flash, in the
+// order they were saved, leaving out any that losing power cut short
+func ReadTape(image []byte) ([]TapeFile, error) {
+	if len(image) < TapeSize {
+		return nil, fmt.Errorf("the tape is %d bytes, it should be %d", len(image), TapeSize)
+	}
+
+	// The tape is in whichever half has the higher generation
+	half := -1
+	var generation uint32
+	for i := 0; i < 2; i++ {
+		var h tapeHeader
+		binary.Read(bytes.NewReader(image[i*tapeHalf:]), binary.LittleEndian, &h)
+		if h.Magic == tapeMagic && h.Version == tapeVersion && (half < 0 || h.Generation > generation) {
+			half = i
+			generation = h.Generation
+		}
+	}
+	if half < 0 {
+		return nil, fmt.Errorf("there isn't a tape there")
+	}
+	tape := image[half*tapeHalf : (half+1)*tapeHalf]
+
+	var files []TapeFile
+	size := binary.Size(tapeFile{})
+	for offset := binary.Size(tapeHeader{}); offset+size <= len(tape); {
+		var f tapeFile
+		binary.Read(bytes.NewReader(tape[offset:]), binary.LittleEndian, &f)
+		start := offset + size
+		end := start + int(f.Length)
+		if f.Length == 0xffff || end > len(tape) {
+			break
+		}
+		offset = (end + 1) &^ 1
+		if f.Done == 0 {
+			files = append(files, TapeFile{f.ID, f.Address, tape[start:end], f.Checksum})
+		}
+	}
+	return files, nil
+}
+
+// BuildTape makes a virtual tape holding files, to write into flash with
+// stm32flash
+func BuildTape(files []TapeFile) ([]byte, error) {
+	var out bytes.Buffer
+	binary.Write(&out, binary.LittleEndian, tapeHeader{tapeMagic, tapeVersion, 0, 1})
+	for _, f := range files {
+		binary.Write(&out, binary.LittleEndian, tapeFile{uint16(len(f.Data)), f.Address, f.ID, 0, f.Checksum, 0})
+		out.Write(f.Data)
+		if len(f.Data)&1 != 0 {
+			out.WriteByte(0xff)
+		}
+	}
+	if out.Len() > tapeHalf {
+		return nil, fmt.Errorf("the files take %d bytes, but only %d fit on the tape", out.Len(), tapeHalf)
+	}
+
+	image := out.Bytes()
+	for len(image) < TapeSize {
+		image = append(image, 0xff)
+	}
+	return image, nil
+}
+
+// String describes the file the way kimtape and kimwav list them
+func (f TapeFile) String() string {
+	status := ""
+	if f.Sum() != f.Checksum {
+		status = "  bad checksum"
+	}
+	if len(f.Data) == 0 {
+		return fmt.Sprintf("%02X empty at %04X%s", f.ID, f.Address, status)
+	}
+	return fmt.Sprintf("%02X %04X-%04X %5d bytes%s", f.ID, f.Address, int(f.Address)+len(f.Data)-1, len(f.Data), status)
+}
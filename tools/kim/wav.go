@@ -0,0 +1,88 @@
+package kim
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"os"
+)
+
+// ReadWAV reads a PCM WAV file, 8 or 16 bits, keeping only the first
+// channel. Returns the samples and the sample rate.
+func ReadWAV(path string) ([]int16, int, error) {
+	contents, err := os.ReadFile(path)
+	if err != nil {
+		return nil, 0, err
+	}
+	if len(contents) < 12 || string(contents[0:4]) != "RIFF" || string(contents[8:12]) != "WAVE" {
+		return nil, 0, fmt.Errorf("%s isn't a WAV file", path)
+	}
+
+	var format struct {
+		Format        uint16
+		Channels      uint16
+		Rate          uint32
+		ByteRate      uint32
+		BlockAlign    uint16
+		BitsPerSample uint16
+	}
+	haveFormat := false
+	for chunk := contents[12:]; len(chunk) >= 8; {
+		id := string(chunk[0:4])
+		size := int(binary.LittleEndian.Uint32(chunk[4:8]))
+		body := chunk[8:]
+		if size > len(body) {
+			size = len(body)
+		}
+		body = body[:size]
+		chunk = chunk[8+size:]
+		if size&1 != 0 && len(chunk) > 0 {
+			chunk = chunk[1:]
+		}
+
+		switch id {
+		case "fmt ":
+			binary.Read(bytes.NewReader(body), binary.LittleEndian, &format)
+			// WAVE_FORMAT_EXTENSIBLE keeps the real format at the start of its GUID
+			if format.Format == 0xfffe && len(body) >= 26 {
+				format.Format = binary.LittleEndian.Uint16(body[24:26])
+			}
+			haveFormat = true
+		case "data":
+			if !haveFormat {
+				return nil, 0, fmt.Errorf("%s has its data before its format", path)
+			}
+			if format.Format != 1 || format.Channels == 0 ||
+				(format.BitsPerSample != 8 && format.BitsPerSample != 16) {
+				return nil, 0, fmt.Errorf("%s isn't 8 or 16 bit PCM", path)
+			}
+			step := int(format.Channels) * int(format.BitsPerSample/8)
+			samples := make([]int16, len(body)/step)
+			for i := range samples {
+				if format.BitsPerSample == 8 {
+					samples[i] = int16(body[i*step]-0x80) << 8
+				} else {
+					samples[i] = int16(binary.LittleEndian.Uint16(body[i*step:]))
+				}
+			}
+			return samples, int(format.Rate), nil
+		}
+	}
+	return nil, 0, fmt.Errorf("%s has no data", path)
+}
+
+// WriteWAV writes mono 16 bit samples as a WAV file
+func WriteWAV(path string, samples []int16, rate int) error {
+	var out bytes.Buffer
+	out.WriteString("RIFF")
+	binary.Write(&out, binary.LittleEndian, uint32(36+2*len(samples)))
+	out.WriteString("WAVEfmt ")
+	binary.Write(&out, binary.LittleEndian, []uint32{16})
+	binary.Write(&out, binary.LittleEndian, []uint16{1, 1})
+	binary.Write(&out, binary.LittleEndian, []uint32{uint32(rate), uint32(2 * rate)})
+	binary.Write(&out, binary.LittleEndian, []uint16{2, 16})
+	out.WriteString("data")
+	binary.Write(&out, binary.LittleEndian, uint32(2*len(samples)))
+	binary.Write(&out, binary.LittleEndian, samples)
+	return os.WriteFile(path, out.Bytes(), 0644)
+}
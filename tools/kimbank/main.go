@@ -0,0 +1,52 @@
+// kimbank lists the banks in the banked RAM store of a BANKED_RAM build, as
+// read back out of flash, and given a bank number and a file name, writes
+// that bank's 4K there as a binary to load at A000.
+package main
+
+import (
+	"fmt"
+	"kim1tools/kim"
+	"os"
+	"strconv"
+)
+
+func main() {
+	if len(os.Args) != 2 && len(os.Args) != 4 {
+		fmt.Printf("Please supply a bank store read from flash, and optionally a bank and a file to write it to\n")
+		fmt.Printf("  stm32flash -r banks.bin -S 0x%08x:%d /dev/ttyUSB0\n", kim.BankAddress(kim.BankFlashSize), kim.BankFlashSize)
+		return
+	}
+
+	image, err := os.ReadFile(os.Args[1])
+	if err != nil {
+		fmt.Printf("Error reading bank store: %+v\n", err)
+		return
+	}
+	banks, err := kim.ReadBanks(image)
+	if err != nil {
+		fmt.Printf("Error reading %s: %+v\n", os.Args[1], err)
+		return
+	}
+
+	for _, b := range banks {
+		fmt.Println(b)
+	}
+
+	if len(os.Args) == 4 {
+		n, err := strconv.ParseUint(os.Args[2], 16, 8)
+		if err != nil {
+			fmt.Printf("%s isn't a hex bank number\n", os.Args[2])
+			return
+		}
+		// A bank that has never been written is all zeros
+		data := make([]byte, kim.BankSize)
+		for _, b := range banks {
+			if b.Number == int(n) {
+				data = b.Data
+			}
+		}
+		if err = os.WriteFile(os.Args[3], data, 0644); err != nil {
+			fmt.Printf("Error writing file: %+v\n", err)
+		}
+	}
+}
@@ -0,0 +1,267 @@
+// kimlib packs KIM-1 paper tapes and binary files into a program library
+// for a LIBRARY build, for stm32flash to write into the flash above the
+// firmware. Program nn in the list is run by going to F0nn.
+//
+//	kimlib library.bin game.ptp=0200 monitor.bin@2000 ...
+//
+// A paper tape loads where its records say, and a binary at the address
+// after the @. Either one runs from the address after the =, or else from
+// the first byte it loads.
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"kim1tools/kim"
+	"os"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+)
+
+const (
+	magic   = 0x4c4d494b // "KIML"
+	version = 1
+
+	libraryAddress = 0x08030000
+	librarySize    = 0x6000
+
+	encodingRaw = 0
+	encodingLZ4 = 1
+)
+
+// The parts of the 6502 address space that hold RAM, as image.c has them.
+// A record has to fit in one of them. 9000-9BFF is only there with
+// EXPANDED_RAM, in CCM RAM when memmap.h has its usual layout.
+var areas = [][2]int{
+	{0x0000, 0x0200},
+	{0x0200, 0x1000},
+	{0x1780, 0x17c0},
+	{0x17c0, 0x1800},
+	{0x2000, 0x9000},
+	{0x9000, 0x9c00},
+}
+
+type header struct {
+	Magic   uint32
+	Version uint16
+	Count   uint16
+}
+
+type entry struct {
+	Name     [16]byte
+	Start    uint16
+	Reserved uint16
+	Offset   uint32
+	Length   uint32
+}
+
+type record struct {
+	Address  uint16
+	Length   uint16
+	Packed   uint16
+	Encoding uint8
+	Reserved uint8
+}
+
+type program struct {
+	name   string
+	start  int
+	memory map[int]byte
+}
+
+func main() {
+	if len(os.Args) < 3 {
+		fmt.Printf("Please supply the library file to write and the programs to put in it\n")
+		return
+	}
+
+	var programs []program
+	for _, arg := range os.Args[2:] {
+		p, err := readProgram(arg)
+		if err != nil {
+			fmt.Printf("Error reading %s: %+v\n", arg, err)
+			return
+		}
+		programs = append(programs, p)
+	}
+	if len(programs) > 256 {
+		fmt.Printf("There can only be 256 programs, F000 to F0FF\n")
+		return
+	}
+
+	var data bytes.Buffer
+	entries := make([]entry, len(programs))
+	offset := binary.Size(header{}) + len(programs)*binary.Size(entry{})
+	for i, p := range programs {
+		records, err := pack(p.memory)
+		if err != nil {
+			fmt.Printf("Error packing %s: %+v\n", p.name, err)
+			return
+		}
+		copy(entries[i].Name[:], p.name)
+		entries[i].Start = uint16(p.start)
+		entries[i].Offset = uint32(offset + data.Len())
+		entries[i].Length = uint32(len(records))
+		data.Write(records)
+		fmt.Printf("F0%02X  %-16s  %5d bytes, %5d in flash, starts at %04X\n",
+			i, p.name, len(p.memory), len(records), p.start)
+	}
+
+	var out bytes.Buffer
+	binary.Write(&out, binary.LittleEndian, header{magic, version, uint16(len(programs))})
+	binary.Write(&out, binary.LittleEndian, entries)
+	out.Write(data.Bytes())
+	if out.Len() > librarySize {
+		fmt.Printf("The library is %d bytes, but there are only %d bytes of flash for it\n", out.Len(), librarySize)
+		return
+	}
+	if err := os.WriteFile(os.Args[1], out.Bytes(), 0644); err != nil {
+		fmt.Printf("Error writing library: %+v\n", err)
+		return
+	}
+	fmt.Printf("%d bytes, write it with:\n  stm32flash -w %s -S 0x%08x /dev/ttyUSB0\n", out.Len(), os.Args[1], libraryAddress)
+}
+
+// readProgram reads name.ptp[=start] or name.bin@load[=start]
+func readProgram(arg string) (program, error) {
+	p := program{start: -1, memory: map[int]byte{}}
+	if i := strings.LastIndex(arg, "="); i >= 0 {
+		start, err := strconv.ParseUint(arg[i+1:], 16, 16)
+		if err != nil {
+			return p, fmt.Errorf("bad start address %s", arg[i+1:])
+		}
+		p.start = int(start)
+		arg = arg[:i]
+	}
+	load := -1
+	if i := strings.LastIndex(arg, "@"); i >= 0 {
+		address, err := strconv.ParseUint(arg[i+1:], 16, 16)
+		if err != nil {
+			return p, fmt.Errorf("bad load address %s", arg[i+1:])
+		}
+		load = int(address)
+		arg = arg[:i]
+	}
+	p.name = strings.TrimSuffix(filepath.Base(arg), filepath.Ext(arg))
+	if len(p.name) > 16 {
+		p.name = p.name[:16]
+	}
+
+	contents, err := os.ReadFile(arg)
+	if err != nil {
+		return p, err
+	}
+	if load >= 0 {
+		for i, b := range contents {
+			p.memory[load+i] = b
+		}
+	} else if strings.EqualFold(filepath.Ext(arg), ".ptp") {
+		if err = readPaperTape(contents, p.memory); err != nil {
+			return p, err
+		}
+	} else {
+		return p, fmt.Errorf("a binary needs a load address, like %s@0200", arg)
+	}
+	if len(p.memory) == 0 {
+		return p, fmt.Errorf("nothing to load")
+	}
+
+	if p.start < 0 {
+		p.start = 0x10000
+		for address := range p.memory {
+			if address < p.start {
+				p.start = address
+			}
+		}
+	}
+	return p, nil
+}
+
+// readPaperTape reads the KIM-1 paper tape format: lines of ;, a count, an
+// address, count bytes and a checksum of all of them, in hex, ending with a
+// line with a count of 0
+func readPaperTape(contents []byte, memory map[int]byte) error {
+	scanner := bufio.NewScanner(bytes.NewReader(contents))
+	for line := 1; scanner.Scan(); line++ {
+		text := strings.TrimSpace(scanner.Text())
+		if text == "" {
+			continue
+		}
+		if text[0] != ';' || len(text)%2 != 1 {
+			return fmt.Errorf("line %d isn't a paper tape record", line)
+		}
+		var b []byte
+		for i := 1; i < len(text); i += 2 {
+			v, err := strconv.ParseUint(text[i:i+2], 16, 8)
+			if err != nil {
+				return fmt.Errorf("line %d has a bad hex digit", line)
+			}
+			b = append(b, byte(v))
+		}
+		if len(b) < 5 || len(b) != int(b[0])+5 {
+			return fmt.Errorf("line %d is the wrong length", line)
+		}
+		count := int(b[0])
+		if count == 0 {
+			return nil
+		}
+		sum := 0
+		for _, v := range b[:count+3] {
+			sum += int(v)
+		}
+		if uint16(sum) != uint16(b[count+3])<<8|uint16(b[count+4]) {
+			return fmt.Errorf("line %d has a bad checksum", line)
+		}
+		address := int(b[1])<<8 | int(b[2])
+		for i := 0; i < count; i++ {
+			memory[(address+i)&0xffff] = b[3+i]
+		}
+	}
+	return scanner.Err()
+}
+
+// pack turns memory into image records, one for each run of bytes inside
+// one area
+func pack(memory map[int]byte) ([]byte, error) {
+	var addresses []int
+	for address := range memory {
+		addresses = append(addresses, address)
+	}
+	sort.Ints(addresses)
+
+	var out bytes.Buffer
+	for i := 0; i < len(addresses); {
+		area := -1
+		for j, a := range areas {
+			if addresses[i] >= a[0] && addresses[i] < a[1] {
+				area = j
+			}
+		}
+		if area < 0 {
+			return nil, fmt.Errorf("%04X isn't in RAM", addresses[i])
+		}
+		start := addresses[i]
+		var run []byte
+		for ; i < len(addresses) && addresses[i] == start+len(run) && addresses[i] < areas[area][1]; i++ {
+			run = append(run, memory[addresses[i]])
+		}
+
+		r := record{Address: uint16(start), Length: uint16(len(run)), Encoding: encodingLZ4}
+		data := kim.Compress(run)
+		if len(data) >= len(run) {
+			data = run
+			r.Encoding = encodingRaw
+		}
+		r.Packed = uint16(len(data))
+		binary.Write(&out, binary.LittleEndian, r)
+		out.Write(data)
+		if len(data)&1 != 0 {
+			out.WriteByte(0)
+		}
+	}
+	return out.Bytes(), nil
+}
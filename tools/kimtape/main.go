@@ -0,0 +1,52 @@
+// kimtape lists the files on the virtual cassette tape of a TAPE build, as
+// read back out of flash, and given an ID and a file name, writes the newest
+// file with that ID there as a binary.
+package main
+
+import (
+	"fmt"
+	"kim1tools/kim"
+	"os"
+	"strconv"
+)
+
+func main() {
+	if len(os.Args) != 2 && len(os.Args) != 4 {
+		fmt.Printf("Please supply a tape read from flash, and optionally an ID and a file to write it to\n")
+		fmt.Printf("  stm32flash -r tape.bin -S 0x%08x:%d /dev/ttyUSB0\n", kim.TapeAddress, kim.TapeSize)
+		return
+	}
+
+	image, err := os.ReadFile(os.Args[1])
+	if err != nil {
+		fmt.Printf("Error reading tape: %+v\n", err)
+		return
+	}
+	files, err := kim.ReadTape(image)
+	if err != nil {
+		fmt.Printf("Error reading %s: %+v\n", os.Args[1], err)
+		return
+	}
+
+	newest := map[uint8]kim.TapeFile{}
+	for _, f := range files {
+		fmt.Println(f)
+		newest[f.ID] = f
+	}
+
+	if len(os.Args) == 4 {
+		id, err := strconv.ParseUint(os.Args[2], 16, 8)
+		if err != nil {
+			fmt.Printf("%s isn't a hex ID\n", os.Args[2])
+			return
+		}
+		f, ok := newest[uint8(id)]
+		if !ok {
+			fmt.Printf("There isn't a file %02X on the tape\n", id)
+			return
+		}
+		if err = os.WriteFile(os.Args[3], f.Data, 0644); err != nil {
+			fmt.Printf("Error writing file: %+v\n", err)
+		}
+	}
+}
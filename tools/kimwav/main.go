@@ -0,0 +1,107 @@
+// kimwav converts between the virtual cassette tape of a TAPE build and WAV
+// recordings in the KIM-1's own cassette format, for keeping and sharing
+// programs, or loading them on a real KIM-1.
+//
+//	kimwav tape.bin tape.wav    records the newest file with each ID
+//	kimwav tape.wav tape.bin    decodes a recording into a tape for stm32flash
+//	kimwav tape.wav             lists the files in a recording
+package main
+
+import (
+	"flag"
+	"fmt"
+	"kim1tools/kim"
+	"os"
+	"path/filepath"
+	"strings"
+	"time"
+)
+
+func main() {
+	rate := flag.Int("rate", 44100, "sample rate of the WAV files it writes")
+	flag.Parse()
+	args := flag.Args()
+	if len(args) < 1 || len(args) > 2 {
+		fmt.Printf("Please supply a tape read from flash and a WAV file to write, or a WAV file and optionally a tape to write\n")
+		fmt.Printf("  stm32flash -r tape.bin -S 0x%08x:%d /dev/ttyUSB0\n", kim.TapeAddress, kim.TapeSize)
+		return
+	}
+
+	if isWAV(args[0]) {
+		decode(args)
+	} else if len(args) == 2 && isWAV(args[1]) {
+		encode(args[0], args[1], *rate)
+	} else {
+		fmt.Printf("One of the files has to be a .wav\n")
+	}
+}
+
+func isWAV(path string) bool {
+	return strings.EqualFold(filepath.Ext(path), ".wav")
+}
+
+func decode(args []string) {
+	samples, rate, err := kim.ReadWAV(args[0])
+	if err != nil {
+		fmt.Printf("Error reading recording: %+v\n", err)
+		return
+	}
+	if rate < 16000 {
+		fmt.Printf("%d Hz is too slow to tell the tones apart reliably, try 22050 or more\n", rate)
+	}
+
+	started := time.Now()
+	files := kim.DecodeCassette(samples, rate)
+	fmt.Printf("%.1f seconds of audio decoded in %.2f seconds\n",
+		float64(len(samples))/float64(rate), time.Since(started).Seconds())
+	for _, f := range files {
+		fmt.Println(f)
+	}
+
+	if len(args) == 2 {
+		image, err := kim.BuildTape(files)
+		if err != nil {
+			fmt.Printf("Error making tape: %+v\n", err)
+			return
+		}
+		if err = os.WriteFile(args[1], image, 0644); err != nil {
+			fmt.Printf("Error writing tape: %+v\n", err)
+			return
+		}
+		fmt.Printf("Write it with:\n  stm32flash -w %s -S 0x%08x /dev/ttyUSB0\n", args[1], kim.TapeAddress)
+	}
+}
+
+func encode(tapePath string, wavPath string, rate int) {
+	image, err := os.ReadFile(tapePath)
+	if err != nil {
+		fmt.Printf("Error reading tape: %+v\n", err)
+		return
+	}
+	files, err := kim.ReadTape(image)
+	if err != nil {
+		fmt.Printf("Error reading %s: %+v\n", tapePath, err)
+		return
+	}
+
+	// Only the newest file with each ID, which is the one LOADT would load,
+	// in the order they were saved
+	var newest []kim.TapeFile
+	for i, f := range files {
+		later := false
+		for _, g := range files[i+1:] {
+			later = later || g.ID == f.ID
+		}
+		if !later {
+			newest = append(newest, f)
+			fmt.Println(f)
+		}
+	}
+
+	samples := kim.EncodeCassette(newest, rate)
+	if err = kim.WriteWAV(wavPath, samples, rate); err != nil {
+		fmt.Printf("Error writing recording: %+v\n", err)
+		return
+	}
+	fmt.Printf("%.1f seconds of audio\n", float64(len(samples))/float64(rate))
+}
@@ -0,0 +1,55 @@
+package main
+
+import (
+	"bytes"
+	"kim1tools/kim"
+	"os"
+	"path/filepath"
+	"testing"
+)
+
+// A tape goes to a WAV and back, and only the newest file with each ID,
+// the one LOADT would find, comes back
+func TestTapeToWAVAndBack(t *testing.T) {
+	saved := []kim.TapeFile{
+		{ID: 0x01, Address: 0x0200, Data: []byte{0xa9, 0x01, 0x00}},
+		{ID: 0x02, Address: 0x0300, Data: []byte{0x4c, 0x00, 0x03}},
+		{ID: 0x01, Address: 0x0200, Data: []byte{0xa9, 0x02, 0xea, 0x00}},
+	}
+	for i := range saved {
+		saved[i].Checksum = saved[i].Sum()
+	}
+	image, err := kim.BuildTape(saved)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	dir := t.TempDir()
+	tapePath := filepath.Join(dir, "tape.bin")
+	wavPath := filepath.Join(dir, "tape.wav")
+	decodedPath := filepath.Join(dir, "decoded.bin")
+	if err = os.WriteFile(tapePath, image, 0644); err != nil {
+		t.Fatal(err)
+	}
+	encode(tapePath, wavPath, 22050)
+	decode([]string{wavPath, decodedPath})
+
+	decoded, err := os.ReadFile(decodedPath)
+	if err != nil {
+		t.Fatal(err)
+	}
+	got, err := kim.ReadTape(decoded)
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := saved[1:]
+	if len(got) != len(want) {
+		t.Fatalf("got %d files back, want %d", len(got), len(want))
+	}
+	for i := range want {
+		if got[i].ID != want[i].ID || got[i].Address != want[i].Address ||
+			got[i].Checksum != want[i].Checksum || !bytes.Equal(got[i].Data, want[i].Data) {
+			t.Errorf("file %d is %v, want %v", i, got[i], want[i])
+		}
+	}
+}
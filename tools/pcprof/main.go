@@ -0,0 +1,75 @@
+// pcprof turns the PC histogram from a PC_PROFILE build into a hot-spot
+// report, naming the KIM-1 ROM routines each bucket covers.
+package main
+
+import (
+	"encoding/binary"
+	"fmt"
+	"kim1tools/kim"
+	"os"
+	"sort"
+	"strings"
+)
+
+type header struct {
+	Shift    uint8
+	Reserved uint8
+	Hz       uint16
+	Total    uint32
+	Buckets  uint16
+}
+
+type bucket struct {
+	Index uint16
+	Count uint32
+}
+
+func main() {
+	if len(os.Args) < 2 {
+		fmt.Printf("Please supply a serial device or a file holding a captured dump\n")
+		return
+	}
+
+	r, c, err := kim.OpenDump(os.Args[1], 0x12, "KPC1")
+	if err != nil {
+		fmt.Printf("Error reading dump: %+v\n", err)
+		return
+	}
+	defer c.Close()
+
+	var h header
+	if err = binary.Read(r, binary.LittleEndian, &h); err != nil {
+		fmt.Printf("Error reading header: %+v\n", err)
+		return
+	}
+	buckets := make([]bucket, h.Buckets)
+	if err = binary.Read(r, binary.LittleEndian, buckets); err != nil {
+		fmt.Printf("Error reading buckets: %+v\n", err)
+		return
+	}
+
+	sort.Slice(buckets, func(i, j int) bool { return buckets[i].Count > buckets[j].Count })
+
+	fmt.Printf("%d samples at %d Hz (%.1f seconds), %d byte buckets\n\n",
+		h.Total, h.Hz, float64(h.Total)/float64(h.Hz), 1<<h.Shift)
+	fmt.Printf("%-11s %10s %7s  %s\n", "ADDRESS", "SAMPLES", "PCT", "ROUTINES")
+	for _, b := range buckets {
+		start := uint32(b.Index) << h.Shift
+		end := start + (1 << h.Shift)
+		fmt.Printf("%04X-%04X %10d %6.2f%%  %s\n", start, end-1, b.Count,
+			100*float64(b.Count)/float64(h.Total), label(start, end))
+	}
+}
+
+// label lists the ROM routines that start in the bucket, or if none do,
+// the routine the start of the bucket is part of
+func label(start uint32, end uint32) string {
+	names := kim.Within(start, end)
+	if len(names) > 0 {
+		return strings.Join(names, " ")
+	}
+	if name := kim.Label(uint16(start)); name != "" {
+		return "in " + name
+	}
+	return ""
+}
@@ -0,0 +1,333 @@
+// romxlat translates the reachable code in the KIM-1 ROMs into C for a
+// ROM_TRANSLATE build. Each basic block becomes one function that calls the
+// emulator's own opcode handlers in a row with their operands filled in, so
+// the compiler can inline and specialize them while the flags, cycles and
+// pc come out exactly as the interpreter would leave them.
+//
+// It reads the ROM images from kimroms.c and the handler names from the
+// optable in fake6502.c, and writes romblocks.inc, which fake6502.c
+// includes.
+package main
+
+import (
+	"bufio"
+	"flag"
+	"fmt"
+	"io/ioutil"
+	"kim1tools/kim"
+	"os"
+	"regexp"
+	"sort"
+	"strconv"
+	"strings"
+)
+
+const (
+	romStart = 0x1800
+	romEnd   = 0x2000
+
+	// The RIOT I/O registers. The main loop updates the timers between
+	// steps, so an instruction that might touch one has to start a block.
+	ioStart = 0x1700
+	ioEnd   = 0x1780
+
+	maxBlock = 32
+)
+
+// The addresses that main.c's check_pc traps, which a block can't run past.
+// 1800 and 1873, DUMPT and LOADT, are only trapped with TAPE, but nothing
+// in the ROM runs into them, so ending a block there costs nothing.
+var watched = map[uint16]bool{0x1e5a: true, 0x1ea0: true, 0x1800: true, 0x1873: true}
+
+type instruction struct {
+	addr    uint16
+	opcode  uint8
+	operand uint16
+	length  int
+}
+
+type block struct {
+	start uint16
+	code  []instruction
+}
+
+func main() {
+	romFile := flag.String("rom", "../Core/Src/kimroms.c", "C file with the ROM images")
+	coreFile := flag.String("core", "../Core/Src/fake6502.c", "fake6502.c, for the opcode handler names")
+	outFile := flag.String("o", "../Core/Src/romblocks.inc", "file to write")
+	flag.Parse()
+
+	rom, err := readROM(*romFile)
+	if err != nil {
+		fmt.Printf("Error reading ROMs: %+v\n", err)
+		os.Exit(1)
+	}
+	handlers, err := readOptable(*coreFile)
+	if err != nil {
+		fmt.Printf("Error reading optable: %+v\n", err)
+		os.Exit(1)
+	}
+
+	blocks := translate(rom)
+
+	out, err := os.Create(*outFile)
+	if err != nil {
+		fmt.Printf("Error creating %s: %+v\n", *outFile, err)
+		os.Exit(1)
+	}
+	w := bufio.NewWriter(out)
+	write(w, blocks, handlers)
+	if err = w.Flush(); err == nil {
+		err = out.Close()
+	}
+	if err != nil {
+		fmt.Printf("Error writing %s: %+v\n", *outFile, err)
+		os.Exit(1)
+	}
+
+	count := 0
+	for _, b := range blocks {
+		count += len(b.code)
+	}
+	fmt.Printf("%d blocks, %d instructions\n", len(blocks), count)
+}
+
+// readROM pulls the two ROM arrays out of kimroms.c
+func readROM(path string) ([]byte, error) {
+	src, err := ioutil.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	rom := make([]byte, romEnd-romStart)
+	for name, base := range map[string]int{"RIOT003_ROM": 0x1800, "RIOT002_ROM": 0x1c00} {
+		body, err := arrayBody(string(src), name)
+		if err != nil {
+			return nil, err
+		}
+		n := 0
+		for _, tok := range strings.Split(body, ",") {
+			tok = strings.TrimSpace(tok)
+			if tok == "" {
+				continue
+			}
+			v, err := strconv.ParseUint(tok, 0, 8)
+			if err != nil {
+				return nil, fmt.Errorf("%s: %v", name, err)
+			}
+			if n >= 1024 {
+				return nil, fmt.Errorf("%s has more than 1024 bytes", name)
+			}
+			rom[base-romStart+n] = byte(v)
+			n++
+		}
+		if n != 1024 {
+			return nil, fmt.Errorf("%s has %d bytes, not 1024", name, n)
+		}
+	}
+	return rom, nil
+}
+
+var comment = regexp.MustCompile(`/\*.*?\*/`)
+
+// readOptable returns the handler name for each opcode
+func readOptable(path string) ([256]string, error) {
+	var names [256]string
+	src, err := ioutil.ReadFile(path)
+	if err != nil {
+		return names, err
+	}
+	body, err := arrayBody(string(src), "(*optable")
+	if err != nil {
+		return names, err
+	}
+	body = comment.ReplaceAllString(body, "")
+	n := 0
+	for _, tok := range strings.Split(body, ",") {
+		tok = strings.TrimSpace(tok)
+		if tok == "" {
+			continue
+		}
+		if n >= 256 {
+			return names, fmt.Errorf("optable has more than 256 entries")
+		}
+		names[n] = tok
+		n++
+	}
+	if n != 256 {
+		return names, fmt.Errorf("optable has %d entries, not 256", n)
+	}
+	return names, nil
+}
+
+// arrayBody returns what is between the braces of the initializer that
+// follows the first line containing name and an '='
+func arrayBody(src string, name string) (string, error) {
+	for i := strings.Index(src, name); i >= 0; {
+		rest := src[i:]
+		eq := strings.Index(rest, "=")
+		nl := strings.Index(rest, "\n")
+		if eq >= 0 && (nl < 0 || eq < nl) {
+			open := strings.Index(rest, "{")
+			close := strings.Index(rest, "};")
+			if open < 0 || close < open {
+				break
+			}
+			return rest[open+1 : close], nil
+		}
+		next := strings.Index(src[i+1:], name)
+		if next < 0 {
+			break
+		}
+		i += next + 1
+	}
+	return "", fmt.Errorf("no initializer for %s", name)
+}
+
+func inROM(addr uint16) bool {
+	return addr >= romStart && addr < romEnd
+}
+
+// mayTouchIO reports whether an instruction could read or write a RIOT
+// register, either because its address is one or because it can't be
+// known until it runs
+func mayTouchIO(in instruction) bool {
+	op := kim.Ops[in.opcode]
+	if in.opcode == 0x20 || in.opcode == 0x4c {
+		return false // JSR and JMP only use the address as the new pc
+	}
+	switch op.Mode {
+	case kim.Abs:
+		return in.operand >= ioStart && in.operand < ioEnd
+	case kim.AbsX, kim.AbsY:
+		return uint32(in.operand)+0xff >= ioStart && in.operand < ioEnd
+	case kim.IndX, kim.IndY:
+		return true
+	}
+	return false
+}
+
+func endsBlock(opcode uint8) bool {
+	switch opcode {
+	case 0x00, 0x20, 0x40, 0x4c, 0x60, 0x6c:
+		return true
+	}
+	return opcode&0x1f == 0x10
+}
+
+func decode(rom []byte, addr uint16) (instruction, bool) {
+	opcode := rom[addr-romStart]
+	length := kim.Ops[opcode].Length()
+	if !inROM(addr + uint16(length) - 1) {
+		return instruction{}, false
+	}
+	in := instruction{addr: addr, opcode: opcode, length: length}
+	if length > 1 {
+		in.operand = uint16(rom[addr+1-romStart])
+	}
+	if length > 2 {
+		in.operand |= uint16(rom[addr+2-romStart]) << 8
+	}
+	return in, true
+}
+
+// translate walks the ROM from its vectors and documented entry points,
+// following branches, jumps and calls, and splits the code it finds into
+// blocks. A block ends after a branch, jump, call or return, before an
+// address check_pc watches, and before any instruction but the first that
+// might touch a RIOT register.
+func translate(rom []byte) []block {
+	var work []uint16
+	for _, v := range []uint16{0x1ffa, 0x1ffc, 0x1ffe} {
+		work = append(work, uint16(rom[v-romStart])|uint16(rom[v+1-romStart])<<8)
+	}
+	for _, sym := range kim.ROMSymbols {
+		if sym.Name != "TABLE" {
+			work = append(work, sym.Addr)
+		}
+	}
+
+	done := map[uint16]*block{}
+	for len(work) > 0 {
+		start := work[len(work)-1]
+		work = work[:len(work)-1]
+		if !inROM(start) || done[start] != nil {
+			continue
+		}
+
+		b := &block{start: start}
+		addr := start
+		for len(b.code) < maxBlock {
+			in, ok := decode(rom, addr)
+			if !ok {
+				break
+			}
+			if len(b.code) > 0 && (watched[addr] || mayTouchIO(in)) {
+				work = append(work, addr)
+				break
+			}
+			b.code = append(b.code, in)
+			next := addr + uint16(in.length)
+
+			op := kim.Ops[in.opcode]
+			if op.Mode == kim.Rel {
+				work = append(work, next, next+uint16(int8(in.operand)))
+			} else if in.opcode == 0x20 {
+				work = append(work, in.operand, next)
+			} else if in.opcode == 0x4c {
+				work = append(work, in.operand)
+			}
+			if endsBlock(in.opcode) {
+				break
+			}
+			if len(b.code) == maxBlock {
+				work = append(work, next)
+			}
+			addr = next
+		}
+		if len(b.code) > 0 {
+			done[start] = b
+		}
+	}
+
+	var blocks []block
+	for _, b := range done {
+		blocks = append(blocks, *b)
+	}
+	sort.Slice(blocks, func(i, j int) bool { return blocks[i].start < blocks[j].start })
+	return blocks
+}
+
+func write(w *bufio.Writer, blocks []block, handlers [256]string) {
+	fmt.Fprintf(w, "// Generated by tools/romxlat from kimroms.c and the optable in fake6502.c,\n")
+	fmt.Fprintf(w, "// do not edit. Each function runs one basic block of the KIM-1 ROM through\n")
+	fmt.Fprintf(w, "// the opcode handlers and returns how many instructions it ran.\n")
+	for _, b := range blocks {
+		fmt.Fprintf(w, "\n")
+		if name := kim.Label(b.start); name != "" {
+			fmt.Fprintf(w, "// %s\n", name)
+		}
+		fmt.Fprintf(w, "static int rom_%04x() {\n", b.start)
+		for _, in := range b.code {
+			var operand []byte
+			if in.length > 1 {
+				operand = append(operand, byte(in.operand))
+			}
+			if in.length > 2 {
+				operand = append(operand, byte(in.operand>>8))
+			}
+			line := "    pc++;"
+			if in.length > 1 {
+				line += fmt.Sprintf(" operand = 0x%02x;", in.operand)
+			}
+			line += fmt.Sprintf(" %s(); clockticks6502 += ticktable[0x%02x];", handlers[in.opcode], in.opcode)
+			fmt.Fprintf(w, "%-80s // %04X %s\n", line, in.addr, kim.Disassemble(in.addr, in.opcode, operand))
+		}
+		fmt.Fprintf(w, "    return %d;\n}\n", len(b.code))
+	}
+
+	fmt.Fprintf(w, "\nstatic int (*const rom_blocks[0x%x])() = {\n", romEnd-romStart)
+	for _, b := range blocks {
+		fmt.Fprintf(w, "    [0x%03x] = rom_%04x,\n", b.start-romStart, b.start)
+	}
+	fmt.Fprintf(w, "};\n")
+}
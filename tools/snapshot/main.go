@@ -0,0 +1,180 @@
+// snapshot reads a snapshot saved by a SNAPSHOT build, as read back out of
+// flash, and prints the registers and the memory it and the deltas after it
+// hold. Given a second
+// file name, it also writes the 64K 6502 address space there.
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"hash/adler32"
+	"kim1tools/kim"
+	"os"
+)
+
+const (
+	magic      = 0x534d494b // "KIMS"
+	deltaMagic = 0x444d494b // "KIMD"
+	version    = 2
+
+	encodingRaw = 0
+	encodingLZ4 = 1
+)
+
+// These match snapshot.h
+type state struct {
+	Clockticks uint32
+	Timer      [2][5]uint32
+	PC         uint16
+	A, X, Y    uint8
+	SP, Status uint8
+	SerialMode uint8
+	SSTMode    uint8
+	RIOT       [2][4]uint8
+	IRQ        uint8
+	Reserved   [2]uint8
+}
+
+type header struct {
+	Magic      uint32
+	Version    uint16
+	HeaderSize uint16
+	Length     uint32
+	Checksum   uint32
+	State      state
+	Previous   uint32
+}
+
+type record struct {
+	Address  uint16
+	Length   uint16
+	Packed   uint16
+	Encoding uint8
+	Reserved uint8
+}
+
+func main() {
+	if len(os.Args) < 2 {
+		fmt.Printf("Please supply a snapshot read from flash, and optionally a file for the memory image\n")
+		fmt.Printf("  stm32flash -r snapshot.bin -S 0x08036000:40960 /dev/ttyUSB0\n")
+		return
+	}
+
+	image, err := os.ReadFile(os.Args[1])
+	if err != nil {
+		fmt.Printf("Error reading snapshot: %+v\n", err)
+		return
+	}
+
+	memory := make([]byte, 0x10000)
+	var last header
+	for offset, i := 0, 0; offset+binary.Size(header{}) <= len(image); i++ {
+		var h header
+		binary.Read(bytes.NewReader(image[offset:]), binary.LittleEndian, &h)
+		if i == 0 && h.Magic != magic {
+			fmt.Printf("%s doesn't hold a snapshot\n", os.Args[1])
+			return
+		}
+		if i > 0 && (h.Magic != deltaMagic || h.Previous != last.checksum()) {
+			break
+		}
+		if h.Version != version {
+			fmt.Printf("Snapshot is version %d, this only reads version %d\n", h.Version, version)
+			return
+		}
+		start := offset + int(h.HeaderSize)
+		end := start + int(h.Length)
+		if end > len(image) {
+			fmt.Printf("Snapshot is cut short, it needs %d bytes but there are %d\n", end, len(image))
+			return
+		}
+		records := image[start:end]
+		if adler32.Checksum(records) != h.Checksum {
+			if i == 0 {
+				fmt.Printf("Snapshot checksum doesn't match\n")
+				return
+			}
+			fmt.Printf("Delta %d checksum doesn't match, so the firmware stops before it\n", i)
+			break
+		}
+
+		if i == 0 {
+			fmt.Printf("Snapshot version %d, %d bytes\n", h.Version, end-offset)
+		} else {
+			fmt.Printf("Delta %d, %d bytes\n", i, end-offset)
+		}
+		if err = load(memory, records); err != nil {
+			fmt.Printf("%+v\n", err)
+			return
+		}
+		last = h
+		offset = (end + 3) &^ 3
+	}
+
+	s := last.State
+	fmt.Printf("PC=%04X A=%02X X=%02X Y=%02X P=%02X S=%02X  %s\n", s.PC, s.A, s.X, s.Y, s.Status, s.SP, kim.Exact(s.PC))
+	fmt.Printf("%d cycles, serial mode %d, SST %d\n", s.Clockticks, s.SerialMode, s.SSTMode)
+	for i, name := range []string{"6530-002", "6530-003"} {
+		t := s.Timer[i]
+		fmt.Printf("%s: PADD=%02X SAD=%02X PBDD=%02X SBD=%02X  timer divide %d start %d count %d tick %d",
+			name, s.RIOT[i][0], s.RIOT[i][1], s.RIOT[i][2], s.RIOT[i][3], t[0], t[2], int32(t[3]), t[1])
+		if t[4] != 0 {
+			fmt.Printf(" timed out")
+		}
+		if s.IRQ&(2>>i) != 0 {
+			fmt.Printf(", interrupts")
+		}
+		fmt.Printf("\n")
+	}
+
+	if len(os.Args) > 2 {
+		if err = os.WriteFile(os.Args[2], memory, 0644); err != nil {
+			fmt.Printf("Error writing memory image: %+v\n", err)
+		}
+	}
+}
+
+// checksum is the Adler-32 of the whole header, which the next delta keeps
+func (h header) checksum() uint32 {
+	var b bytes.Buffer
+	binary.Write(&b, binary.LittleEndian, h)
+	return adler32.Checksum(b.Bytes())
+}
+
+// load copies the memory in records into memory, printing each run
+func load(memory []byte, records []byte) error {
+	r := bytes.NewReader(records)
+	for r.Len() > 0 {
+		var rec record
+		if err := binary.Read(r, binary.LittleEndian, &rec); err != nil {
+			return fmt.Errorf("record header cut short")
+		}
+		data := make([]byte, rec.Packed)
+		if n, _ := r.Read(data); n < len(data) {
+			return fmt.Errorf("record at %04X cut short", rec.Address)
+		}
+		if rec.Packed&1 != 0 {
+			r.ReadByte()
+		}
+
+		encoding := "raw"
+		if rec.Encoding == encodingLZ4 {
+			encoding = "LZ4"
+			var err error
+			data, err = kim.Decompress(data, int(rec.Length))
+			if err != nil {
+				return fmt.Errorf("record at %04X: %+v", rec.Address, err)
+			}
+		} else if rec.Encoding != encodingRaw || rec.Packed != rec.Length {
+			return fmt.Errorf("record at %04X has an unknown encoding %d", rec.Address, rec.Encoding)
+		}
+		if int(rec.Address)+len(data) > len(memory) {
+			return fmt.Errorf("record at %04X runs off the end of memory", rec.Address)
+		}
+		copy(memory[rec.Address:], data)
+		fmt.Printf("  %04X-%04X  %5d bytes, %5d packed %s\n",
+			rec.Address, int(rec.Address)+int(rec.Length)-1, rec.Length, rec.Packed, encoding)
+	}
+	return nil
+}
@@ -0,0 +1,102 @@
+// tracedump decodes the instruction trace from an INSTRUCTION_TRACE build
+// into a disassembly listing, oldest instruction first.
+package main
+
+import (
+	"bufio"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"kim1tools/kim"
+	"os"
+)
+
+const (
+	tracePC = 1 << iota
+	traceA
+	traceX
+	traceY
+	traceStatus
+	traceSP
+)
+
+type state struct {
+	pc                  uint16
+	opcode              uint8
+	a, x, y, status, sp uint8
+}
+
+func main() {
+	if len(os.Args) < 2 {
+		fmt.Printf("Please supply a serial device or a file holding a captured dump\n")
+		return
+	}
+
+	r, c, err := kim.OpenDump(os.Args[1], 0x14, "KTR1")
+	if err != nil {
+		fmt.Printf("Error reading dump: %+v\n", err)
+		return
+	}
+	defer c.Close()
+
+	var count uint16
+	if err = binary.Read(r, binary.LittleEndian, &count); err != nil {
+		fmt.Printf("Error reading header: %+v\n", err)
+		return
+	}
+
+	var s state
+	for i := 0; i < int(count); i++ {
+		operand, err := decode(r, &s, i == 0)
+		if err != nil {
+			fmt.Printf("Trace cut short after %d of %d records: %+v\n", i, count, err)
+			return
+		}
+		bytes := fmt.Sprintf("%02X", s.opcode)
+		for _, b := range operand {
+			bytes += fmt.Sprintf(" %02X", b)
+		}
+		fmt.Printf("%04X  %-8s  %-14s  A=%02X X=%02X Y=%02X P=%02X S=%02X  %s\n",
+			s.pc, bytes, kim.Disassemble(s.pc, s.opcode, operand),
+			s.a, s.x, s.y, s.status, s.sp, kim.Exact(s.pc))
+	}
+}
+
+// decode reads the next record, applying it on top of the previous state
+func decode(r *bufio.Reader, s *state, first bool) ([]byte, error) {
+	flags, err := r.ReadByte()
+	if err != nil {
+		return nil, err
+	}
+	if first && flags != tracePC|traceA|traceX|traceY|traceStatus|traceSP {
+		return nil, fmt.Errorf("first record only has fields %02x", flags)
+	}
+
+	if flags&tracePC != 0 {
+		if err = binary.Read(r, binary.LittleEndian, &s.pc); err != nil {
+			return nil, err
+		}
+	} else {
+		s.pc += uint16(kim.Ops[s.opcode].Length())
+	}
+
+	if s.opcode, err = r.ReadByte(); err != nil {
+		return nil, err
+	}
+	operand := make([]byte, kim.Ops[s.opcode].Length()-1)
+	if _, err = io.ReadFull(r, operand); err != nil {
+		return nil, err
+	}
+
+	for _, f := range []struct {
+		flag int
+		reg  *uint8
+	}{{traceA, &s.a}, {traceX, &s.x}, {traceY, &s.y}, {traceStatus, &s.status}, {traceSP, &s.sp}} {
+		if flags&byte(f.flag) != 0 {
+			if *f.reg, err = r.ReadByte(); err != nil {
+				return nil, err
+			}
+		}
+	}
+	return operand, nil
+}